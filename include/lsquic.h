@@ -21,6 +21,7 @@
 
 struct iovec;
 struct sockaddr;
+struct timespec;
 
 #ifdef __cplusplus
 extern "C" {
@@ -217,6 +218,54 @@ struct lsquic_stream_if {
 /** By default, packets are paced */
 #define LSQUIC_DF_PACE_PACKETS      1
 
+/** By default, UDP GSO is not used */
+#define LSQUIC_DF_MAX_GSO_SEGS      0
+
+/** By default, packets that can be encrypted in place are */
+#define LSQUIC_DF_SEAL_IN_PLACE     1
+
+/** By default, crypto is performed in the engine thread */
+#define LSQUIC_DF_CRYPTO_THREADS    0
+
+/** By default, the AEAD is es_aead regardless of the CPU */
+#define LSQUIC_DF_PREFER_CHACHA     0
+
+/** Maximum value of es_crypto_threads */
+#define LSQUIC_MAX_CRYPTO_THREADS   64
+
+/** By default, key shares are generated when they are needed */
+#define LSQUIC_DF_KXS_POOL_SIZE     0
+
+/** Maximum value of es_kxs_pool_size */
+#define LSQUIC_MAX_KXS_POOL_SIZE    (1 << 16)
+
+/** By default, every connection starts with default RTT and cwnd */
+#define LSQUIC_DF_PATH_HINTS        0
+
+/** Maximum value of es_path_hints */
+#define LSQUIC_MAX_PATH_HINTS       (1 << 16)
+
+/** By default, the Advisory Tick Time Queue is a binary heap */
+#define LSQUIC_DF_ATTQ_WHEEL        0
+
+/** By default, connections are ticked at the time they ask for */
+#define LSQUIC_DF_TICK_SLACK_US     0
+
+/** Maximum value of es_tick_slack_us */
+#define LSQUIC_MAX_TICK_SLACK_US    100000
+
+/** By default, there is no ingress queue */
+#define LSQUIC_DF_INGRESS_SIZE      0
+
+/** Maximum value of es_ingress_size */
+#define LSQUIC_MAX_INGRESS_SIZE     (1 << 16)
+
+/**
+ * Maximum number of segments the kernel accepts in a single UDP GSO
+ * send (UDP_MAX_SEGMENTS on Linux).
+ */
+#define LSQUIC_MAX_GSO_SEGS         64
+
 struct lsquic_engine_settings {
     /**
      * This is a bit mask wherein each bit corresponds to a value in
@@ -293,7 +342,7 @@ struct lsquic_engine_settings {
     const char     *es_ua;
 
     uint32_t        es_pdmd; /* One fixed value X509 */
-    uint32_t        es_aead; /* One fixed value AESG */
+    uint32_t        es_aead; /* AESG (default) or CC20 */
     uint32_t        es_kexs; /* One fixed value C255 */
 
     /**
@@ -397,6 +446,126 @@ struct lsquic_engine_settings {
      */
     int             es_pace_packets;
 
+    /**
+     * If set to a value larger than one, the engine coalesces runs of
+     * packets sent by the same connection into a single buffer holding up
+     * to this many packets.  Each packet but the last one in such a buffer
+     * is exactly `segsz' bytes long (see @ref lsquic_out_spec).  This
+     * matches the semantics of Linux UDP_SEGMENT socket option: the buffer
+     * can be passed to the kernel in a single sendmsg(2) call.
+     *
+     * Only enable this if your @ref ea_packets_out callback knows how to
+     * handle out specs with non-zero `segsz'.
+     *
+     * Valid values are 0 through @ref LSQUIC_MAX_GSO_SEGS.  The default
+     * value is @ref LSQUIC_DF_MAX_GSO_SEGS.
+     */
+    unsigned        es_max_gso_segs;
+
+    /**
+     * If set to true, packets that carry no retransmittable data -- for
+     * example, ACK-only packets -- are encrypted in place: they are not
+     * copied into a buffer allocated using @ref ea_pmi.  Packets with
+     * retransmittable data still are, as their plaintext is needed to
+     * resend them.
+     *
+     * The default value is @ref LSQUIC_DF_SEAL_IN_PLACE.
+     */
+    int             es_seal_in_place;
+
+    /**
+     * Number of worker threads used to encrypt outgoing packets and to
+     * decrypt incoming packets.  If set, each batch of outgoing packets is
+     * encrypted by these threads and the engine thread in parallel before
+     * the batch is handed to @ref ea_packets_out.  Likewise, packets passed
+     * to @ref lsquic_engine_packets_in() are decrypted in parallel once the
+     * handshake is complete.  Packets are still sent and processed in order
+     * and from the engine thread.  Worker threads do not log and do not call
+     * callbacks.  This makes sense if a single engine sends or receives a
+     * lot of data and has cores to spare.  This setting is ignored on
+     * Windows.
+     *
+     * Valid values are 0 through @ref LSQUIC_MAX_CRYPTO_THREADS.  The
+     * default value is @ref LSQUIC_DF_CRYPTO_THREADS.
+     */
+    unsigned        es_crypto_threads;
+
+    /**
+     * If set to true, the client uses ChaCha20-Poly1305 (CC20) instead of
+     * es_aead when the CPU has no AES instructions.  This is detected by
+     * @ref lsquic_global_init().  In either case, the AEAD is only used if
+     * the server supports it; otherwise, the client falls back to an AEAD
+     * the server lists.
+     *
+     * The default value is @ref LSQUIC_DF_PREFER_CHACHA.
+     */
+    int             es_prefer_chacha;
+
+    /**
+     * Number of Curve25519 key shares to generate in advance.  If set, a
+     * helper thread keeps a pool of key shares, which new connections use
+     * instead of generating their own in the engine thread.  This helps
+     * when many connections are created at once -- for example, after a
+     * failover.  If the pool runs dry, key shares are generated as usual.
+     * This setting is ignored on Windows.
+     *
+     * Valid values are 0 through @ref LSQUIC_MAX_KXS_POOL_SIZE.  The
+     * default value is @ref LSQUIC_DF_KXS_POOL_SIZE.
+     */
+    unsigned        es_kxs_pool_size;
+
+    /**
+     * Number of destinations for which the client remembers the QUIC
+     * version, RTT, congestion window, and packet size from the last
+     * connection that completed the handshake.  A new connection to the
+     * same peer address starts with these values instead of the defaults:
+     * it skips version negotiation, and short connections do not have to
+     * spend their lifetime in slow start.  The congestion window is capped
+     * when it is reused.  Zero disables this feature.  Client only.
+     *
+     * Valid values are 0 through @ref LSQUIC_MAX_PATH_HINTS.  The
+     * default value is @ref LSQUIC_DF_PATH_HINTS.
+     */
+    unsigned        es_path_hints;
+
+    /**
+     * If set to true value, connections waiting to be ticked at a later
+     * time are kept in a timing wheel instead of a binary heap.  Adding,
+     * removing, and rescheduling a connection is then O(1), which helps
+     * engines with many connections that change their tick time often.
+     * The wheel has a resolution of about one millisecond: connections
+     * due within the same millisecond are not ordered by their time.
+     *
+     * The default value is @ref LSQUIC_DF_ATTQ_WHEEL.
+     */
+    int             es_attq_wheel;
+
+    /**
+     * Timer slack in microseconds.  If non-zero, the time at which each
+     * connection wants to be ticked next is rounded up to a multiple of
+     * this value.  Connections that are due within the same window are
+     * then processed in a single pass: the application wakes up less
+     * often, at the cost of connections being ticked up to this many
+     * microseconds late.
+     *
+     * Valid values are 0 through @ref LSQUIC_MAX_TICK_SLACK_US.  The
+     * default value is @ref LSQUIC_DF_TICK_SLACK_US.
+     */
+    unsigned        es_tick_slack_us;
+
+    /**
+     * Number of packets in the ingress queue.  If set, other threads can
+     * pass incoming packets to the engine using
+     * @ref lsquic_engine_enqueue_packet().  The engine takes them out of
+     * the queue at the beginning of @ref lsquic_engine_process_conns().
+     * The value is rounded up to a power of two.  This setting is ignored
+     * on Windows.
+     *
+     * Valid values are 0 through @ref LSQUIC_MAX_INGRESS_SIZE.  The
+     * default value is @ref LSQUIC_DF_INGRESS_SIZE.
+     */
+    unsigned        es_ingress_size;
+
 };
 
 /* Initialize `settings' to default values */
@@ -432,10 +601,16 @@ struct lsquic_out_spec
     const struct sockaddr *local_sa;
     const struct sockaddr *dest_sa;
     void                  *peer_ctx;
+    /**
+     * If non-zero, `buf' contains several packets, each `segsz' bytes
+     * long except for the last one, which may be shorter.  This is only
+     * ever set if @ref es_max_gso_segs is enabled.
+     */
+    size_t                 segsz;
 };
 
 /**
- * Returns number of packets successfully sent out or -1 on error.  -1 should
+ * Returns number of specs successfully sent out or -1 on error.  -1 should
  * only be returned if no packets were sent out.  If -1 is returned,
  * no packets will be attempted to be sent out until
  * @ref lsquic_engine_send_unsent_packets() is called.
@@ -461,6 +636,26 @@ struct lsquic_packout_mem_if
     void    (*pmi_release)  (void *pmi_ctx, void *obj);
 };
 
+/** DER-encoded certificate */
+struct lsquic_cert
+{
+    const unsigned char *buf;
+    size_t               len;
+};
+
+/**
+ * Certificate chain verification callback.  It is called from the engine
+ * thread when the server sends a certificate chain and the server proof
+ * has been verified.  `chain' holds `n_certs' certificates, leaf first;
+ * it remains valid until @ref lsquic_conn_cert_verified() is called.
+ *
+ * The handshake does not proceed until the result is reported using
+ * @ref lsquic_conn_cert_verified(), which may be done from any thread --
+ * including from this callback.
+ */
+typedef void (*lsquic_verify_cert_f)(void *verify_ctx, lsquic_conn_t *,
+                        const struct lsquic_cert *chain, unsigned n_certs);
+
 /* TODO: describe this important data structure */
 typedef struct lsquic_engine_api
 {
@@ -474,6 +669,24 @@ typedef struct lsquic_engine_api
      */
     const struct lsquic_packout_mem_if  *ea_pmi;
     void                                *ea_pmi_ctx;
+    /**
+     * Optional callback to verify server certificate chain.  If it is not
+     * specified, only the server proof is verified.
+     */
+    lsquic_verify_cert_f                 ea_verify_cert;
+    void                                *ea_verify_cert_ctx;
+    /**
+     * Optional time source.  It returns time in microseconds; the time
+     * must never go backwards.  This can be a coarse clock that is cheaper
+     * to read or a virtual clock for testing.  If not specified, the
+     * monotonic system clock is used.
+     *
+     * The engine reads the time once at the beginning of each call to
+     * process connections or to feed it packets and uses it for the rest
+     * of the call.  It is read again when packets are sent.
+     */
+    uint64_t                           (*ea_get_time)(void *get_time_ctx);
+    void                                *ea_get_time_ctx;
 } lsquic_engine_api_t;
 
 /**
@@ -489,7 +702,8 @@ lsquic_engine_new (unsigned lsquic_engine_flags,
 /**
  * Create a client connection to peer identified by `peer_ctx'.
  * If `max_packet_size' is set to zero, it is inferred based on `peer_sa':
- * 1350 for IPv6 and 1370 for IPv4.
+ * 1350 for IPv6 and 1370 for IPv4.  If es_path_hints is set and there is
+ * a hint for `peer_sa', the packet size from the hint is used instead.
  */
 lsquic_conn_t *
 lsquic_engine_connect (lsquic_engine_t *, const struct sockaddr *peer_sa,
@@ -512,6 +726,57 @@ lsquic_engine_packet_in (lsquic_engine_t *,
         const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
         void *peer_ctx);
 
+/**
+ * Same as @ref lsquic_engine_packet_in(), but the caller supplies the time
+ * the packet was received.  This is wall-clock time (CLOCK_REALTIME), such
+ * as reported by SO_TIMESTAMPNS or SO_TIMESTAMPING.  It is used in place of
+ * the time the packet is passed to the engine, so that time the packet
+ * spent queued up in the socket buffer and in the application does not
+ * count toward RTT samples and ACK delay.
+ *
+ * If `received' is NULL, this is equivalent to lsquic_engine_packet_in().
+ */
+int
+lsquic_engine_packet_in_ts (lsquic_engine_t *,
+        const unsigned char *packet_in_data, size_t packet_in_size,
+        const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+        void *peer_ctx, const struct timespec *received);
+
+/**
+ * Used as argument to @ref lsquic_engine_packets_in().  Describes one or,
+ * if `segsz' is set, several incoming packets.
+ */
+struct lsquic_in_spec
+{
+    const unsigned char   *buf;
+    size_t                 sz;
+    const struct sockaddr *local_sa;
+    const struct sockaddr *peer_sa;
+    void                  *peer_ctx;
+    /**
+     * If non-zero, `buf' contains several packets, each `segsz' bytes
+     * long except for the last one, which may be shorter.  This is what
+     * Linux UDP GRO produces.  Set to zero if `buf' contains one packet.
+     */
+    size_t                 segsz;
+    /**
+     * Optional receive timestamp, see @ref lsquic_engine_packet_in_ts().
+     * If NULL, the engine reads the clock once for the whole batch.
+     */
+    const struct timespec *received;
+};
+
+/**
+ * Pass a batch of incoming packets to the QUIC engine.  This is equivalent
+ * to calling @ref lsquic_engine_packet_in() for each packet, but cheaper:
+ * it is meant to be used with recvmmsg(2) and UDP GRO.
+ *
+ * @retval  Number of packets processed by real connections.
+ */
+int
+lsquic_engine_packets_in (lsquic_engine_t *,
+                          const struct lsquic_in_spec *, unsigned n_specs);
+
 /**
  * Process tickable connections.  This function must be called often enough so
  * that packets and connections do not expire.
@@ -540,6 +805,186 @@ lsquic_engine_send_unsent_packets (lsquic_engine_t *engine);
 void
 lsquic_engine_destroy (lsquic_engine_t *);
 
+#ifndef WIN32
+/**
+ * Put incoming packet into the engine's ingress queue (see
+ * @ref es_ingress_size).  Unlike other functions, this one may be called
+ * from any thread, by several threads at once, without locking: this way,
+ * receiving packets can be done on cores other than the one that runs the
+ * engine.  The packet is copied.  If `received' is NULL, the time of the
+ * call is recorded as the time the packet was received.
+ *
+ * The packets are processed by the next call to
+ * @ref lsquic_engine_process_conns().
+ *
+ * Returns 0 on success and -1 if the packet was not queued: the queue is
+ * full, the packet is too large, or the ingress queue is not enabled.
+ */
+int
+lsquic_engine_enqueue_packet (lsquic_engine_t *,
+    const unsigned char *packet_in_data, size_t packet_in_size,
+    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+    void *peer_ctx, const struct timespec *received);
+
+/**
+ * Returns file descriptor that becomes readable when packets are put into
+ * the ingress queue.  The engine thread is to wait on it in addition to
+ * the timeout returned by @ref lsquic_engine_earliest_adv_tick() and call
+ * @ref lsquic_engine_process_conns() when it becomes readable.  Do not read
+ * from it: the engine does.
+ *
+ * Returns -1 if the ingress queue is not enabled.
+ */
+int
+lsquic_engine_ingress_fd (const lsquic_engine_t *);
+
+/**
+ * Built-in UDP I/O.  This is optional: the user may read and write
+ * packets by other means.  The UDP I/O object wraps a
+ * non-blocking UDP socket and reads and writes packets in batches using
+ * recvmmsg(2) and sendmmsg(2) where available.  Local address of incoming
+ * packets is recovered using IP_PKTINFO (IPV6_PKTINFO) and the same
+ * mechanism is used to set source address of outgoing packets.
+ */
+struct lsquic_udp_io;
+
+/** Default number of messages per recvmmsg(2) and sendmmsg(2) call. */
+#define LSQUIC_DF_UDP_IO_BATCH 64
+
+/**
+ * Create new UDP I/O object.  `fd' must be a bound non-blocking UDP
+ * socket; the object does not take ownership of it.  If `batch_size' is
+ * zero, @ref LSQUIC_DF_UDP_IO_BATCH is used.
+ *
+ * Incoming packets are passed to the engine with `peer_ctx' as their peer
+ * context.  If `peer_ctx' is NULL, the UDP I/O object itself is used.
+ *
+ * Returns NULL on error.
+ */
+struct lsquic_udp_io *
+lsquic_udp_io_new (int fd, unsigned batch_size, void *peer_ctx);
+
+void
+lsquic_udp_io_destroy (struct lsquic_udp_io *);
+
+/**
+ * Read all available packets from the socket and pass them to the engine
+ * using @ref lsquic_engine_packets_in().  Call this function when the
+ * socket becomes readable.
+ *
+ * Returns number of packets read or -1 if an error other than EAGAIN
+ * occurred before any packets were read.
+ */
+int
+lsquic_udp_io_read (struct lsquic_udp_io *, lsquic_engine_t *);
+
+/**
+ * Send packets out of the socket.  `peer_ctx' in the specs is ignored.
+ * Returns number of packets sent.  If the socket would block before
+ * anything was sent, -1 is returned and errno is set to EAGAIN; the object
+ * is then marked as blocked (see @ref lsquic_udp_io_blocked()).
+ */
+int
+lsquic_udp_io_send (struct lsquic_udp_io *,
+                    const struct lsquic_out_spec *, unsigned count);
+
+/**
+ * A ready-made @ref lsquic_packets_out_f callback.  Use it if peer context
+ * of every connection is the UDP I/O object (that is, `peer_ctx' passed
+ * to @ref lsquic_udp_io_new() was NULL).  `packets_out_ctx' is not used.
+ */
+int
+lsquic_udp_io_packets_out (void *packets_out_ctx,
+                    const struct lsquic_out_spec *, unsigned count);
+
+/**
+ * Returns true if the last send attempt failed because the socket would
+ * block.  In that case, the user should wait for the socket to become
+ * writeable and call @ref lsquic_udp_io_write_ready().
+ */
+int
+lsquic_udp_io_blocked (const struct lsquic_udp_io *);
+
+/**
+ * Clear the blocked state and call
+ * @ref lsquic_engine_send_unsent_packets().
+ */
+void
+lsquic_udp_io_write_ready (struct lsquic_udp_io *, lsquic_engine_t *);
+
+/**
+ * Engine group.  An engine is single-threaded: to use several cores, the
+ * group creates a number of client engines and runs each of them in its
+ * own worker thread.  Each engine has its own UDP socket (see
+ * @ref lsquic_udp_io) and its own memory manager.
+ *
+ * Stream and connection callbacks are called from the worker threads.  A
+ * connection is only ever used by the thread that runs its engine.
+ */
+struct lsquic_engine_group;
+
+enum lsquic_engine_group_flags
+{
+    /** Pin worker thread N to CPU N modulo number of CPUs (Linux only). */
+    LSQUIC_EGF_PIN_CPUS     = 1 << 0,
+};
+
+/** Statistics aggregated over all engines in the group */
+struct lsquic_engine_group_stats
+{
+    unsigned            n_engines;
+    unsigned            n_conns;            /* Connections currently open */
+    unsigned            n_pending;          /* Connects not yet picked up */
+    unsigned long long  n_conns_created;
+    unsigned long long  n_packets_in;
+    unsigned long long  n_packets_out;
+};
+
+/**
+ * Create engine group of `n_engines' client engines.  Each engine uses a
+ * UDP socket of address family `family' (AF_INET or AF_INET6) bound to the
+ * wildcard address.
+ *
+ * `api' is used to create each engine, except that `ea_packets_out' and
+ * `ea_packets_out_ctx' are ignored: the group sends packets itself.  If
+ * `ea_pmi' is specified, it must be thread-safe.
+ *
+ * Returns NULL on error.
+ */
+struct lsquic_engine_group *
+lsquic_engine_group_new (unsigned lsquic_engine_flags,
+                         const struct lsquic_engine_api *api, int family,
+                         unsigned n_engines,
+                         enum lsquic_engine_group_flags);
+
+/**
+ * Create a connection.  This is the group's equivalent of
+ * @ref lsquic_engine_connect().  The engines take turns: connections are
+ * distributed across them in round-robin fashion.  The connection is
+ * created asynchronously by the worker thread, which then calls
+ * on_new_conn() callback.
+ *
+ * Returns index of the engine the connection was handed to or -1 on error.
+ */
+int
+lsquic_engine_group_connect (struct lsquic_engine_group *,
+                             const struct sockaddr *peer_sa,
+                             lsquic_conn_ctx_t *conn_ctx,
+                             const char *hostname,
+                             unsigned short max_packet_size);
+
+void
+lsquic_engine_group_get_stats (struct lsquic_engine_group *,
+                               struct lsquic_engine_group_stats *);
+
+/**
+ * Stop worker threads and destroy the engines.  Connections that are
+ * still open are closed.
+ */
+void
+lsquic_engine_group_destroy (struct lsquic_engine_group *);
+#endif
+
 void lsquic_conn_make_stream(lsquic_conn_t *);
 
 /** Return number of delayed streams currently pending */
@@ -835,6 +1280,33 @@ lsquic_global_init (int flags);
 void
 lsquic_global_cleanup (void);
 
+#ifndef WIN32
+/** By default, the session cache file holds this many entries. */
+#define LSQUIC_DF_SESSION_CACHE_ENTRIES 4096
+
+/**
+ * Client: in addition to the in-memory cache, save server configs, source
+ * address tokens, and certificates in a memory-mapped file at `path'.
+ * Thus, after a restart, connections to known servers can still be
+ * established in zero round trips.  Entries expire as specified by the
+ * server (EXPY and STTL).
+ *
+ * The file can be shared by several processes -- for example, prefork
+ * workers -- which can open it either before or after fork().  If the
+ * file does not exist, it is created with room for `n_entries' entries
+ * (LSQUIC_DF_SESSION_CACHE_ENTRIES if zero).
+ *
+ * Call after @ref lsquic_global_init() with @ref LSQUIC_GLOBAL_CLIENT.
+ * If `path' is NULL, the file is no longer used.  The file may be changed
+ * while engines are running in other threads.
+ *
+ * @retval  0   Success.
+ * @retval -1   File could not be opened or mapped.
+ */
+int
+lsquic_global_set_session_cache_file (const char *path, unsigned n_entries);
+#endif
+
 /**
  * Get QUIC version used by the connection.
  *
@@ -869,6 +1341,16 @@ void *lsquic_conn_get_peer_ctx( const lsquic_conn_t *lconn);
 void
 lsquic_conn_abort (lsquic_conn_t *c);
 
+/**
+ * Report result of certificate chain verification requested using
+ * @ref ea_verify_cert.  This function may be called from any thread.  It
+ * must be called exactly once for each verification request, and before
+ * the engine is destroyed.  The connection is resumed (or closed, if `ok'
+ * is false) the next time @ref lsquic_engine_process_conns() is called.
+ */
+void
+lsquic_conn_cert_verified (lsquic_conn_t *c, int ok);
+
 /**
  * Returns true if there are connections to be processed, false otherwise.
  * If true, `diff' is set to the difference between the earliest advisory
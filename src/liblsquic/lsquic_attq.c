@@ -6,10 +6,14 @@
  * element having the minimum advsory time.  To speed up removal, each
  * element has an index it has in the heap array.  The index is updated
  * as elements are moved around in the array when heap is updated.
+ *
+ * If the queue is created by attq_create_wheel(), calls are passed on to
+ * the timing wheel in lsquic_attq_wheel.c.
  */
 
 #include <assert.h>
 #include <stdlib.h>
+#include <sys/queue.h>
 #ifdef WIN32
 #include <vc_compat.h>
 #endif
@@ -18,6 +22,7 @@
 #include "lsquic_types.h"
 #include "lsquic_int_types.h"
 #include "lsquic_attq.h"
+#include "lsquic_attq_wheel.h"
 #include "lsquic_malo.h"
 #include "lsquic_conn.h"
 
@@ -28,6 +33,7 @@ struct attq
     struct attq_elem  **aq_heap;
     unsigned            aq_nelem;
     unsigned            aq_nalloc;
+    struct attq_wheel  *aq_wheel;       /* Set if queue is a timing wheel */
 };
 
 
@@ -53,9 +59,35 @@ attq_create (void)
 }
 
 
+struct attq *
+attq_create_wheel (void)
+{
+    struct attq *q;
+
+    q = calloc(1, sizeof(*q));
+    if (!q)
+        return NULL;
+
+    q->aq_wheel = attq_wheel_create();
+    if (!q->aq_wheel)
+    {
+        free(q);
+        return NULL;
+    }
+
+    return q;
+}
+
+
 void
 attq_destroy (struct attq *q)
 {
+    if (q->aq_wheel)
+    {
+        attq_wheel_destroy(q->aq_wheel);
+        free(q);
+        return;
+    }
     lsquic_malo_destroy(q->aq_elem_malo);
     free(q->aq_heap);
     free(q);
@@ -110,6 +142,9 @@ attq_add (struct attq *q, struct lsquic_conn *conn,
     struct attq_elem *el, **heap;
     unsigned n, i;
 
+    if (q->aq_wheel)
+        return attq_wheel_add(q->aq_wheel, conn, advisory_time);
+
     if (q->aq_nelem >= q->aq_nalloc)
     {
         if (q->aq_nalloc > 0)
@@ -155,6 +190,9 @@ attq_pop (struct attq *q, lsquic_time_t cutoff)
     struct lsquic_conn *conn;
     struct attq_elem *el;
 
+    if (q->aq_wheel)
+        return attq_wheel_pop(q->aq_wheel, cutoff);
+
     if (q->aq_nelem == 0)
         return NULL;
 
@@ -198,12 +236,40 @@ attq_heapify (struct attq *q, unsigned i)
 }
 
 
+/* Move element at index `idx' up or down after its advisory time has
+ * changed.
+ */
+static void
+attq_restore (struct attq *q, unsigned idx)
+{
+    if (idx > 0 && q->aq_heap[ idx ]->ae_adv_time <
+                                q->aq_heap[ AE_PARENT(idx) ]->ae_adv_time)
+    {
+        do
+        {
+            attq_swap(q, idx, AE_PARENT(idx));
+            idx = AE_PARENT(idx);
+        }
+        while (idx > 0 && q->aq_heap[ idx ]->ae_adv_time <
+                                q->aq_heap[ AE_PARENT(idx) ]->ae_adv_time);
+    }
+    else if (q->aq_nelem > 1)
+        attq_heapify(q, idx);
+}
+
+
 void
 attq_remove (struct attq *q, struct lsquic_conn *conn)
 {
     struct attq_elem *el;
     unsigned idx;
 
+    if (q->aq_wheel)
+    {
+        attq_wheel_remove(q->aq_wheel, conn);
+        return;
+    }
+
     el = conn->cn_attq_elem;
     idx = el->ae_heap_idx;
 
@@ -216,19 +282,29 @@ attq_remove (struct attq *q, struct lsquic_conn *conn)
 
     q->aq_heap[ idx ] = q->aq_heap[ --q->aq_nelem ];
     q->aq_heap[ idx ]->ae_heap_idx = idx;
-    if (idx > 0 && q->aq_heap[ idx ]->ae_adv_time <
-                                q->aq_heap[ AE_PARENT(idx) ]->ae_adv_time)
+    if (idx < q->aq_nelem)
+        attq_restore(q, idx);
+    attq_verify(q);
+}
+
+
+void
+attq_reschedule (struct attq *q, struct lsquic_conn *conn,
+                                            lsquic_time_t advisory_time)
+{
+    struct attq_elem *el;
+
+    if (q->aq_wheel)
     {
-        do
-        {
-            attq_swap(q, idx, AE_PARENT(idx));
-            idx = AE_PARENT(idx);
-        }
-        while (idx > 0 && q->aq_heap[ idx ]->ae_adv_time <
-                                q->aq_heap[ AE_PARENT(idx) ]->ae_adv_time);
+        attq_wheel_reschedule(q->aq_wheel, conn, advisory_time);
+        return;
     }
-    else if (q->aq_nelem > 1 && idx < q->aq_nelem)
-        attq_heapify(q, idx);
+
+    el = conn->cn_attq_elem;
+    assert(q->aq_heap[ el->ae_heap_idx ] == el);
+
+    el->ae_adv_time = advisory_time;
+    attq_restore(q, el->ae_heap_idx);
     attq_verify(q);
 }
 
@@ -238,6 +314,9 @@ attq_count_before (struct attq *q, lsquic_time_t cutoff)
 {
     unsigned level, total_count, level_count, i, level_max;
 
+    if (q->aq_wheel)
+        return attq_wheel_count_before(q->aq_wheel, cutoff);
+
     total_count = 0;
     for (i = 0, level = 0;; ++level)
     {
@@ -256,6 +335,9 @@ attq_count_before (struct attq *q, lsquic_time_t cutoff)
 const lsquic_time_t *
 attq_next_time (struct attq *q)
 {
+    if (q->aq_wheel)
+        return attq_wheel_next_time(q->aq_wheel);
+
     if (q->aq_nelem > 0)
         return &q->aq_heap[0]->ae_adv_time;
     else
@@ -1,6 +1,11 @@
 /* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
 /*
  * lsquic_attq.h -- Advisory Tick Time Queue
+ *
+ * The queue is either a binary heap or a timing wheel.  The heap returns
+ * connections strictly in order of their advisory time.  The wheel does
+ * not order connections that are due at the same time when the queue is
+ * popped, but adding, removing, and rescheduling connections is O(1).
  */
 
 #ifndef LSQUIC_ATTQ_H
@@ -18,12 +23,21 @@ struct attq_elem
     struct lsquic_conn  *ae_conn;
     lsquic_time_t        ae_adv_time;
     unsigned             ae_heap_idx;
+    /* Used by the timing wheel: */
+    TAILQ_ENTRY(attq_elem)
+                         ae_next_slot;
+    unsigned char        ae_level,
+                         ae_slot;
 };
 
 
 struct attq *
 attq_create (void);
 
+/* Same as attq_create(), but the queue is a timing wheel */
+struct attq *
+attq_create_wheel (void);
+
 void
 attq_destroy (struct attq *);
 
@@ -34,6 +48,11 @@ attq_add (struct attq *, struct lsquic_conn *, lsquic_time_t advisory_time);
 void
 attq_remove (struct attq *, struct lsquic_conn *);
 
+/* Change advisory time of connection that is already in the queue */
+void
+attq_reschedule (struct attq *, struct lsquic_conn *,
+                                            lsquic_time_t advisory_time);
+
 struct lsquic_conn *
 attq_pop (struct attq *, lsquic_time_t cutoff);
 
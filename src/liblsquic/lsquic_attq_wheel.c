@@ -0,0 +1,585 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_attq_wheel.c -- Advisory Tick Time Queue as a timing wheel
+ *
+ * Time is divided into ticks of about a millisecond.  The wheel has four
+ * levels of 64 slots each.  A slot on level 0 holds connections due in
+ * one tick; a slot on level N covers 64 times as many ticks as a slot on
+ * level N - 1.  Connections far in the future live on higher levels and
+ * are moved down ("cascaded") as the current tick reaches them.  Adding,
+ * removing, and rescheduling a connection are O(1): the element is linked
+ * into or out of a slot list.
+ *
+ * The advisory time of each element is kept exactly, but elements that are
+ * too far in the future (see MAX_DELTA) are not placed by it: they sit in
+ * the top-level slot they were put into until they are cascaded.  When the
+ * queue is popped, elements whose time has come are moved onto the expired
+ * list, from which they are handed out.  The earliest element is found by
+ * looking at the non-empty slots on each level in order and is cached until
+ * that element is removed.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/queue.h>
+#ifdef WIN32
+#include <vc_compat.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_attq.h"
+#include "lsquic_attq_wheel.h"
+#include "lsquic_malo.h"
+#include "lsquic_conn.h"
+
+
+#define TICK_SHIFT      10      /* One tick is 1024 microseconds */
+#define SLOT_BITS       6
+#define N_SLOTS         (1 << SLOT_BITS)
+#define SLOT_MASK       (N_SLOTS - 1)
+#define N_LEVELS        4
+/* Value of ae_level for elements on the expired list */
+#define LEVEL_EXPIRED   N_LEVELS
+
+/* Each slot on level `l' covers this many ticks, as a power of two */
+#define LEVEL_SHIFT(l)  ((l) * SLOT_BITS)
+
+/* Elements farther in the future are placed as if they were due at
+ * this distance.  They are rescheduled when they are cascaded.
+ */
+#define MAX_DELTA       ((1ULL << LEVEL_SHIFT(N_LEVELS)) - 1)
+
+
+#if __GNUC__
+#   define ctz __builtin_ctzll
+#else
+static unsigned
+ctz (unsigned long long x)
+{
+    unsigned n = 0;
+    if (0 == (x & ((1ULL << 32) - 1))) { n += 32; x >>= 32; }
+    if (0 == (x & ((1ULL << 16) - 1))) { n += 16; x >>= 16; }
+    if (0 == (x & ((1ULL <<  8) - 1))) { n +=  8; x >>=  8; }
+    if (0 == (x & ((1ULL <<  4) - 1))) { n +=  4; x >>=  4; }
+    if (0 == (x & ((1ULL <<  2) - 1))) { n +=  2; x >>=  2; }
+    if (0 == (x & ((1ULL <<  1) - 1))) { n +=  1; x >>=  1; }
+    return n;
+}
+#endif
+
+
+TAILQ_HEAD(attq_slot_head, attq_elem);
+
+struct wheel_slot
+{
+    struct attq_slot_head   ws_elems;
+    unsigned                ws_count;
+};
+
+
+struct wheel_level
+{
+    uint64_t                wl_occupied;    /* Bitmask of non-empty slots */
+    struct wheel_slot       wl_slots[N_SLOTS];
+};
+
+
+struct attq_wheel
+{
+    struct malo            *aw_elem_malo;
+    /* Earliest element, cached by attq_wheel_next_time().  NULL if not
+     * known.
+     */
+    struct attq_elem       *aw_min;
+    uint64_t                aw_cur;         /* Current tick */
+    /* All elements with advisory time smaller than this are on the
+     * expired list.
+     */
+    lsquic_time_t           aw_last_cutoff;
+    unsigned                aw_count;
+    struct wheel_slot       aw_expired;
+    struct wheel_level      aw_levels[N_LEVELS];
+};
+
+
+struct attq_wheel *
+attq_wheel_create (void)
+{
+    struct attq_wheel *w;
+    unsigned level, idx;
+
+    w = calloc(1, sizeof(*w));
+    if (!w)
+        return NULL;
+
+    w->aw_elem_malo = lsquic_malo_create(sizeof(struct attq_elem));
+    if (!w->aw_elem_malo)
+    {
+        free(w);
+        return NULL;
+    }
+
+    TAILQ_INIT(&w->aw_expired.ws_elems);
+    for (level = 0; level < N_LEVELS; ++level)
+        for (idx = 0; idx < N_SLOTS; ++idx)
+            TAILQ_INIT(&w->aw_levels[level].wl_slots[idx].ws_elems);
+
+    return w;
+}
+
+
+void
+attq_wheel_destroy (struct attq_wheel *w)
+{
+    lsquic_malo_destroy(w->aw_elem_malo);
+    free(w);
+}
+
+
+static struct wheel_slot *
+elem_slot (struct attq_wheel *w, const struct attq_elem *el)
+{
+    if (el->ae_level == LEVEL_EXPIRED)
+        return &w->aw_expired;
+    else
+        return &w->aw_levels[ el->ae_level ].wl_slots[ el->ae_slot ];
+}
+
+
+static void
+slot_insert (struct attq_wheel *w, struct attq_elem *el, unsigned level,
+                                                                unsigned idx)
+{
+    struct wheel_slot *slot;
+
+    el->ae_level = level;
+    el->ae_slot  = idx;
+    slot = elem_slot(w, el);
+    TAILQ_INSERT_TAIL(&slot->ws_elems, el, ae_next_slot);
+    ++slot->ws_count;
+    if (level != LEVEL_EXPIRED)
+        w->aw_levels[level].wl_occupied |= 1ULL << idx;
+}
+
+
+static void
+slot_remove (struct attq_wheel *w, struct attq_elem *el)
+{
+    struct wheel_slot *slot;
+
+    slot = elem_slot(w, el);
+    assert(slot->ws_count > 0);
+    TAILQ_REMOVE(&slot->ws_elems, el, ae_next_slot);
+    if (0 == --slot->ws_count && el->ae_level != LEVEL_EXPIRED)
+        w->aw_levels[ el->ae_level ].wl_occupied &= ~(1ULL << el->ae_slot);
+}
+
+
+/* Place element into a slot according to its advisory time */
+static void
+wheel_place (struct attq_wheel *w, struct attq_elem *el)
+{
+    uint64_t tick, delta;
+    unsigned level;
+
+    if (el->ae_adv_time < w->aw_last_cutoff)
+    {
+        slot_insert(w, el, LEVEL_EXPIRED, 0);
+        return;
+    }
+
+    tick = el->ae_adv_time >> TICK_SHIFT;
+    if (tick < w->aw_cur)
+        tick = w->aw_cur;
+    delta = tick - w->aw_cur;
+    if (delta > MAX_DELTA)
+    {
+        delta = MAX_DELTA;
+        tick = w->aw_cur + MAX_DELTA;
+    }
+
+    for (level = 0; level < N_LEVELS - 1
+                        && delta >= (1ULL << LEVEL_SHIFT(level + 1)); ++level)
+        ;
+    slot_insert(w, el, level, (tick >> LEVEL_SHIFT(level)) & SLOT_MASK);
+}
+
+
+static void
+update_min (struct attq_wheel *w, struct attq_elem *el)
+{
+    if (w->aw_min && el->ae_adv_time < w->aw_min->ae_adv_time)
+        w->aw_min = el;
+}
+
+
+int
+attq_wheel_add (struct attq_wheel *w, struct lsquic_conn *conn,
+                                            lsquic_time_t advisory_time)
+{
+    struct attq_elem *el;
+
+    el = lsquic_malo_get(w->aw_elem_malo);
+    if (!el)
+        return -1;
+
+    el->ae_adv_time = advisory_time;
+    el->ae_conn = conn;
+    conn->cn_attq_elem = el;
+
+    if (0 == w->aw_count)
+    {
+        /* Skip over the time when the wheel was empty */
+        if ((advisory_time >> TICK_SHIFT) > w->aw_cur)
+            w->aw_cur = advisory_time >> TICK_SHIFT;
+        w->aw_min = el;
+    }
+    else
+        update_min(w, el);
+
+    wheel_place(w, el);
+    ++w->aw_count;
+    return 0;
+}
+
+
+void
+attq_wheel_remove (struct attq_wheel *w, struct lsquic_conn *conn)
+{
+    struct attq_elem *el;
+
+    el = conn->cn_attq_elem;
+    assert(el->ae_conn == conn);
+    assert(w->aw_count > 0);
+
+    slot_remove(w, el);
+    if (w->aw_min == el)
+        w->aw_min = NULL;
+    --w->aw_count;
+    conn->cn_attq_elem = NULL;
+    lsquic_malo_put(el);
+}
+
+
+void
+attq_wheel_reschedule (struct attq_wheel *w, struct lsquic_conn *conn,
+                                            lsquic_time_t advisory_time)
+{
+    struct attq_elem *el;
+
+    el = conn->cn_attq_elem;
+    assert(el->ae_conn == conn);
+
+    slot_remove(w, el);
+    if (w->aw_min == el && advisory_time > el->ae_adv_time)
+        w->aw_min = NULL;
+    el->ae_adv_time = advisory_time;
+    update_min(w, el);
+    wheel_place(w, el);
+}
+
+
+static void
+expire_slot (struct attq_wheel *w, struct wheel_slot *slot)
+{
+    struct attq_elem *el;
+
+    while ((el = TAILQ_FIRST(&slot->ws_elems)))
+    {
+        slot_remove(w, el);
+        slot_insert(w, el, LEVEL_EXPIRED, 0);
+    }
+}
+
+
+/* Move elements down from higher-level slots that have become current */
+static void
+wheel_cascade (struct attq_wheel *w)
+{
+    struct wheel_slot *slot;
+    struct attq_elem *el;
+    unsigned level, idx;
+
+    for (level = N_LEVELS - 1; level > 0; --level)
+        if (0 == (w->aw_cur & ((1ULL << LEVEL_SHIFT(level)) - 1)))
+        {
+            idx = (w->aw_cur >> LEVEL_SHIFT(level)) & SLOT_MASK;
+            slot = &w->aw_levels[level].wl_slots[idx];
+            while ((el = TAILQ_FIRST(&slot->ws_elems)))
+            {
+                slot_remove(w, el);
+                wheel_place(w, el);
+            }
+        }
+}
+
+
+/* First block (in units of slots on this level) that the level's slots
+ * map to.  On level 0, the current slot comes first; on higher levels,
+ * the current slot is for the block that is 64 slots away.
+ */
+static uint64_t
+level_first_block (const struct attq_wheel *w, unsigned level)
+{
+    return (w->aw_cur >> LEVEL_SHIFT(level)) + (level > 0);
+}
+
+
+static uint64_t
+slot_block (uint64_t first_block, unsigned idx)
+{
+    return first_block + ((idx - first_block) & SLOT_MASK);
+}
+
+
+/* Bitmask of non-empty slots on this level in time order: bit N is set
+ * if the slot for block `level_first_block() + N' is not empty.
+ */
+static uint64_t
+level_ordered_bits (const struct attq_wheel *w, unsigned level)
+{
+    uint64_t bits;
+    unsigned from;
+
+    bits = w->aw_levels[level].wl_occupied;
+    from = level_first_block(w, level) & SLOT_MASK;
+    if (from)
+        bits = (bits >> from) | (bits << (N_SLOTS - from));
+    return bits;
+}
+
+
+/* Return block of the first non-empty slot on this level in time order */
+static uint64_t
+level_first_occupied (const struct attq_wheel *w, unsigned level)
+{
+    assert(w->aw_levels[level].wl_occupied);
+    return level_first_block(w, level) + ctz(level_ordered_bits(w, level));
+}
+
+
+/* Advance current tick to `new_cur', expiring level-0 slots on the way.
+ * Empty stretches of the wheel are skipped.
+ */
+static void
+wheel_advance (struct attq_wheel *w, uint64_t new_cur)
+{
+    struct wheel_level *const level0 = &w->aw_levels[0];
+    uint64_t next, bits, block;
+    unsigned idx, level;
+
+    while (w->aw_cur < new_cur)
+    {
+        if (level0->wl_occupied)
+        {
+            idx = w->aw_cur & SLOT_MASK;
+            if (level0->wl_occupied & (1ULL << idx))
+                expire_slot(w, &level0->wl_slots[idx]);
+            /* Look for the next non-empty slot before the wheel turns */
+            bits = level0->wl_occupied & ~((2ULL << idx) - 1);
+            if (bits)
+                next = (w->aw_cur & ~(uint64_t) SLOT_MASK) + ctz(bits);
+            else
+                next = (w->aw_cur | SLOT_MASK) + 1;
+        }
+        else
+        {
+            /* Level 0 is empty: go to the earliest slot that has to be
+             * cascaded.  Every non-empty level is checked, as the first
+             * non-empty slot on a higher level may come before that on a
+             * lower level.
+             */
+            next = UINT64_MAX;
+            for (level = 1; level < N_LEVELS; ++level)
+                if (w->aw_levels[level].wl_occupied)
+                {
+                    block = level_first_occupied(w, level)
+                                                    << LEVEL_SHIFT(level);
+                    if (block < next)
+                        next = block;
+                }
+            if (next == UINT64_MAX)
+            {
+                w->aw_cur = new_cur;
+                break;
+            }
+        }
+        if (next > new_cur)
+            next = new_cur;
+        w->aw_cur = next;
+        if (0 == (w->aw_cur & SLOT_MASK))
+            wheel_cascade(w);
+    }
+}
+
+
+/* Move all elements with advisory time smaller than `cutoff' onto the
+ * expired list.
+ */
+static void
+wheel_collect (struct attq_wheel *w, lsquic_time_t cutoff)
+{
+    struct wheel_slot *slot;
+    struct attq_elem *el, *next;
+
+    wheel_advance(w, cutoff >> TICK_SHIFT);
+
+    /* Current slot may contain elements due both before and after cutoff */
+    slot = &w->aw_levels[0].wl_slots[ w->aw_cur & SLOT_MASK ];
+    for (el = TAILQ_FIRST(&slot->ws_elems); el; el = next)
+    {
+        next = TAILQ_NEXT(el, ae_next_slot);
+        if (el->ae_adv_time < cutoff)
+        {
+            slot_remove(w, el);
+            slot_insert(w, el, LEVEL_EXPIRED, 0);
+        }
+    }
+
+    w->aw_last_cutoff = cutoff;
+}
+
+
+struct lsquic_conn *
+attq_wheel_pop (struct attq_wheel *w, lsquic_time_t cutoff)
+{
+    struct lsquic_conn *conn;
+    struct attq_elem *el;
+
+    if (0 == w->aw_count)
+        return NULL;
+
+    if (cutoff > w->aw_last_cutoff)
+        wheel_collect(w, cutoff);
+
+    TAILQ_FOREACH(el, &w->aw_expired.ws_elems, ae_next_slot)
+        if (el->ae_adv_time < cutoff)
+        {
+            conn = el->ae_conn;
+            attq_wheel_remove(w, conn);
+            return conn;
+        }
+
+    return NULL;
+}
+
+
+static struct attq_elem *
+slot_min (const struct wheel_slot *slot, struct attq_elem *min)
+{
+    struct attq_elem *el;
+
+    TAILQ_FOREACH(el, &slot->ws_elems, ae_next_slot)
+        if (!min || el->ae_adv_time < min->ae_adv_time)
+            min = el;
+
+    return min;
+}
+
+
+static struct attq_elem *
+wheel_find_min (struct attq_wheel *w)
+{
+    struct attq_elem *min;
+    uint64_t first_block, block, bits;
+    unsigned level;
+
+    min = slot_min(&w->aw_expired, NULL);
+
+    /* No element is earlier than the start of its slot, except for overdue
+     * elements in the current slot on level 0.  Elements are not always
+     * later than the start of the next slot, however: those too far in the
+     * future are placed on the top level by the time they were added, not
+     * by their advisory time.  Thus, slots are checked in order until one
+     * starts after the earliest element found so far.
+     */
+    for (level = 0; level < N_LEVELS; ++level)
+    {
+        first_block = level_first_block(w, level);
+        for (bits = level_ordered_bits(w, level); bits; bits &= bits - 1)
+        {
+            block = first_block + ctz(bits);
+            if (min && !(level == 0 && block == w->aw_cur)
+                    && (block << LEVEL_SHIFT(level) << TICK_SHIFT)
+                                                        >= min->ae_adv_time)
+                break;
+            min = slot_min(&w->aw_levels[level].wl_slots[block & SLOT_MASK],
+                                                                        min);
+        }
+    }
+
+    return min;
+}
+
+
+const lsquic_time_t *
+attq_wheel_next_time (struct attq_wheel *w)
+{
+    if (0 == w->aw_count)
+        return NULL;
+
+    if (!w->aw_min)
+        w->aw_min = wheel_find_min(w);
+
+    assert(w->aw_min);
+    return &w->aw_min->ae_adv_time;
+}
+
+
+static unsigned
+slot_count_before (const struct wheel_slot *slot, lsquic_time_t cutoff)
+{
+    const struct attq_elem *el;
+    unsigned count;
+
+    count = 0;
+    TAILQ_FOREACH(el, &slot->ws_elems, ae_next_slot)
+        count += el->ae_adv_time < cutoff;
+
+    return count;
+}
+
+
+unsigned
+attq_wheel_count_before (struct attq_wheel *w, lsquic_time_t cutoff)
+{
+    const struct wheel_slot *slot;
+    uint64_t first_block, block, bits;
+    lsquic_time_t start, end;
+    unsigned level, idx, count;
+
+    if (cutoff >= w->aw_last_cutoff)
+        count = w->aw_expired.ws_count;
+    else
+        count = slot_count_before(&w->aw_expired, cutoff);
+
+    for (level = 0; level < N_LEVELS; ++level)
+    {
+        first_block = level_first_block(w, level);
+        for (bits = w->aw_levels[level].wl_occupied; bits; bits &= bits - 1)
+        {
+            idx = ctz(bits);
+            slot = &w->aw_levels[level].wl_slots[idx];
+            block = slot_block(first_block, idx);
+            start = block << LEVEL_SHIFT(level) << TICK_SHIFT;
+            end = (block + 1) << LEVEL_SHIFT(level) << TICK_SHIFT;
+            if (level == 0 && block == w->aw_cur)
+                /* May contain overdue elements */
+                count += slot_count_before(slot, cutoff);
+            else if (start >= cutoff)
+                continue;
+            else if (end <= cutoff && level < N_LEVELS - 1)
+                count += slot->ws_count;
+            else
+                /* Slots on the top level may contain elements placed
+                 * there because they are too far in the future.
+                 */
+                count += slot_count_before(slot, cutoff);
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,41 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_attq_wheel.h -- Advisory Tick Time Queue as a timing wheel
+ *
+ * This is used by lsquic_attq.c; see lsquic_attq.h for the description
+ * of each function.
+ */
+
+#ifndef LSQUIC_ATTQ_WHEEL_H
+#define LSQUIC_ATTQ_WHEEL_H
+
+struct attq_wheel;
+struct lsquic_conn;
+
+struct attq_wheel *
+attq_wheel_create (void);
+
+void
+attq_wheel_destroy (struct attq_wheel *);
+
+int
+attq_wheel_add (struct attq_wheel *, struct lsquic_conn *,
+                                            lsquic_time_t advisory_time);
+
+void
+attq_wheel_remove (struct attq_wheel *, struct lsquic_conn *);
+
+void
+attq_wheel_reschedule (struct attq_wheel *, struct lsquic_conn *,
+                                            lsquic_time_t advisory_time);
+
+struct lsquic_conn *
+attq_wheel_pop (struct attq_wheel *, lsquic_time_t cutoff);
+
+unsigned
+attq_wheel_count_before (struct attq_wheel *, lsquic_time_t cutoff);
+
+const lsquic_time_t *
+attq_wheel_next_time (struct attq_wheel *);
+
+#endif
@@ -69,7 +69,7 @@ lsquic_cfcw_fc_offsets_changed (struct lsquic_cfcw *fc)
     if (fc->cf_recv_off - fc->cf_read_off >= fc->cf_max_recv_win / 2)
         return 0;
 
-    now = lsquic_time_now();
+    now = lsquic_engine_now(fc->cf_conn_pub->enpub);
     since_last_update = now - fc->cf_last_updated;
     fc->cf_last_updated = now;
 
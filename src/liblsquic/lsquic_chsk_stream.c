@@ -21,6 +21,7 @@
 #include "lsquic_ver_neg.h"
 #include "lsquic_conn.h"
 #include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
 
 #define LSQUIC_LOGGER_MODULE LSQLM_HSK_ADAPTER
 #define LSQUIC_LOG_CONN_ID lsquic_conn_id(c_hsk->lconn)
@@ -41,10 +42,30 @@ hsk_client_on_new_stream (void *stream_if_ctx, lsquic_stream_t *stream)
 }
 
 
+static void
+hsk_client_reply_ok (struct client_hsk_ctx *c_hsk, lsquic_stream_t *stream)
+{
+    if (c_hsk->lconn->cn_esf->esf_is_hsk_done(c_hsk->lconn->cn_enc_session))
+    {
+        LSQ_DEBUG("handshake is successful, inform connection");
+        c_hsk->lconn->cn_if->ci_handshake_ok(c_hsk->lconn);
+    }
+    else
+    {
+        LSQ_DEBUG("handshake not yet complete, will generate another "
+                                                                "message");
+        c_hsk->lconn->cn_if->ci_handshake_rejected(c_hsk->lconn);
+        lsquic_stream_wantwrite(stream, 1);
+    }
+}
+
+
 static void
 hsk_client_on_read (lsquic_stream_t *stream, struct lsquic_stream_ctx *sh)
 {
     struct client_hsk_ctx *const c_hsk = (struct client_hsk_ctx *) sh;
+    const struct lsquic_cert *chain;
+    unsigned n_certs;
     ssize_t nread;
     int s;
 
@@ -103,17 +124,17 @@ hsk_client_on_read (lsquic_stream_t *stream, struct lsquic_stream_ctx *sh)
         lsquic_mm_put_16k(c_hsk->mm, c_hsk->buf_in);
         c_hsk->buf_in = NULL;
         lsquic_stream_wantread(stream, 0);
-        if (c_hsk->lconn->cn_esf->esf_is_hsk_done(c_hsk->lconn->cn_enc_session))
-        {
-            LSQ_DEBUG("handshake is successful, inform connection");
-            c_hsk->lconn->cn_if->ci_handshake_ok(c_hsk->lconn);
-        }
-        else
-        {
-            LSQ_DEBUG("handshake not yet complete, will generate another "
-                                                                    "message");
-            lsquic_stream_wantwrite(stream, 1);
-        }
+        hsk_client_reply_ok(c_hsk, stream);
+        break;
+    case HS_CERT_PENDING:
+        lsquic_mm_put_16k(c_hsk->mm, c_hsk->buf_in);
+        c_hsk->buf_in = NULL;
+        lsquic_stream_wantread(stream, 0);
+        s = c_hsk->lconn->cn_esf->esf_get_cert_chain(
+                            c_hsk->lconn->cn_enc_session, &chain, &n_certs);
+        assert(0 == s);
+        LSQ_DEBUG("wait for the user to verify certificate chain");
+        lsquic_engine_verify_cert(c_hsk->enpub, c_hsk->lconn, chain, n_certs);
         break;
     default:
         LSQ_WARN("lsquic_enc_session_handle_chlo_reply returned unknown value %d", s);
@@ -187,6 +208,22 @@ hsk_client_on_close (lsquic_stream_t *stream, struct lsquic_stream_ctx *sh)
 }
 
 
+void
+lsquic_client_hsk_cert_verified (struct client_hsk_ctx *c_hsk,
+                                        lsquic_stream_t *stream, int ok)
+{
+    if (0 == c_hsk->lconn->cn_esf->esf_cert_verified(
+                                        c_hsk->lconn->cn_enc_session, ok))
+        hsk_client_reply_ok(c_hsk, stream);
+    else
+    {
+        LSQ_INFO("server certificate chain was rejected");
+        c_hsk->lconn->cn_if->ci_handshake_failed(c_hsk->lconn);
+        lsquic_conn_close(c_hsk->lconn);
+    }
+}
+
+
 const struct lsquic_stream_if lsquic_client_hsk_stream_if =
 {
     .on_new_stream = hsk_client_on_new_stream,
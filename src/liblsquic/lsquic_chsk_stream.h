@@ -7,11 +7,14 @@
 #define LSQUIC_CHSK_STREAM_H 1
 
 struct lsquic_conn;
+struct lsquic_engine_public;
 struct lsquic_mm;
+struct lsquic_stream;
 struct ver_neg;
 
 struct client_hsk_ctx {
     struct lsquic_conn          *lconn;
+    struct lsquic_engine_public *enpub;
     struct lsquic_mm            *mm;
     const struct ver_neg        *ver_neg;
     unsigned char               *buf_in;    /* Server response may have to be buffered */
@@ -21,4 +24,9 @@ struct client_hsk_ctx {
 
 extern const struct lsquic_stream_if lsquic_client_hsk_stream_if;
 
+/* Resume handshake after the user has verified the certificate chain */
+void
+lsquic_client_hsk_cert_verified (struct client_hsk_ctx *,
+                                        struct lsquic_stream *, int ok);
+
 #endif
@@ -112,11 +112,19 @@ lsquic_conn_decrypt_packet (lsquic_conn_t *lconn,
     size_t header_len, data_len;
     enum enc_level enc_level;
     size_t out_len = 0;
-    unsigned char *copy = lsquic_mm_get_1370(&enpub->enp_mm);
-    if (!copy)
+    unsigned char *copy;
+
+    /* If we own the packet buffer, decrypt in place */
+    if (packet_in->pi_flags & PI_OWN_DATA)
+        copy = packet_in->pi_data;
+    else
     {
-        LSQ_WARN("cannot allocate memory to copy incoming packet data");
-        return -1;
+        copy = lsquic_mm_get_1370(&enpub->enp_mm);
+        if (!copy)
+        {
+            LSQ_WARN("cannot allocate memory to copy incoming packet data");
+            return -1;
+        }
     }
 
     header_len = packet_in->pi_header_sz;
@@ -129,15 +137,14 @@ lsquic_conn_decrypt_packet (lsquic_conn_t *lconn,
                         copy, 1370, &out_len);
     if ((enum enc_level) -1 == enc_level)
     {
-        lsquic_mm_put_1370(&enpub->enp_mm, copy);
+        if (copy != packet_in->pi_data)
+            lsquic_mm_put_1370(&enpub->enp_mm, copy);
         EV_LOG_CONN_EVENT(lconn->cn_cid, "could not decrypt packet %"PRIu64,
                                                         packet_in->pi_packno);
         return -1;
     }
 
     assert(header_len + out_len <= 1370);
-    if (packet_in->pi_flags & PI_OWN_DATA)
-        lsquic_mm_put_1370(&enpub->enp_mm, packet_in->pi_data);
     packet_in->pi_data = copy;
     packet_in->pi_flags |= PI_OWN_DATA | PI_DECRYPTED
                         | (enc_level << PIBIT_ENC_LEV_SHIFT);
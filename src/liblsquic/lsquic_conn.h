@@ -22,6 +22,7 @@ struct lsquic_packet_in;
 struct sockaddr;
 struct parse_funcs;
 struct attq_elem;
+struct path_hint;
 
 enum lsquic_conn_flags {
     LSCONN_TICKED         = (1 << 0),
@@ -41,6 +42,7 @@ enum lsquic_conn_flags {
     LSCONN_SEND_BLOCKED   = (1 <<15),   /* Send connection blocked frame */
     LSCONN_NEVER_TICKABLE = (1 <<17),   /* Do not put onto the Tickable Queue */
     LSCONN_ATTQ           = (1 <<19),
+    LSCONN_CERT_PENDING   = (1 <<20),   /* User is verifying certificates */
 };
 
 /* A connection may have things to send and be closed at the same time.
@@ -75,9 +77,30 @@ struct conn_iface
     void
     (*ci_handshake_failed) (struct lsquic_conn *);
 
+    /* Server rejected CHLO: packets sent using 0-RTT keys are lost */
+    void
+    (*ci_handshake_rejected) (struct lsquic_conn *);
+
+    /* User finished verifying server certificate chain */
+    void
+    (*ci_cert_verified) (struct lsquic_conn *, int ok);
+
     void
     (*ci_destroy) (struct lsquic_conn *);
 
+    /* Optional: returns 0 and fills in `hint' if connection learned
+     * something useful about the path.
+     */
+    int
+    (*ci_get_path_hint) (struct lsquic_conn *, struct path_hint *);
+
+    /* Optional: returns 0 and fills in full packet number if incoming
+     * packet can be decrypted before it is passed to ci_packet_in().
+     */
+    int
+    (*ci_packno_to_decrypt) (struct lsquic_conn *,
+                    const struct lsquic_packet_in *, lsquic_packno_t *);
+
     int
     (*ci_is_tickable) (struct lsquic_conn *);
 
@@ -95,7 +118,8 @@ struct lsquic_conn
     STAILQ_ENTRY(lsquic_conn)    cn_next_closed_conn;
     TAILQ_ENTRY(lsquic_conn)     cn_next_ticked;
     TAILQ_ENTRY(lsquic_conn)     cn_next_out,
-                                 cn_next_hash;
+                                 cn_next_hash,
+                                 cn_next_cert;
     const struct conn_iface     *cn_if;
     const struct parse_funcs    *cn_pf;
     struct attq_elem            *cn_attq_elem;
@@ -105,6 +129,11 @@ struct lsquic_conn
     enum lsquic_version          cn_version;
     unsigned                     cn_hash;
     unsigned short               cn_pack_size;
+    /* Result of certificate verification: zero while it is in progress,
+     * positive if the chain is good, negative otherwise.  Protected by
+     * the engine's certificate lock.
+     */
+    signed char                  cn_cert_result;
     unsigned char                cn_peer_addr[sizeof(struct sockaddr_in6)],
                                  cn_local_addr[sizeof(struct sockaddr_in6)];
 };
@@ -1,6 +1,7 @@
 /* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
 #include <assert.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <zlib.h>
@@ -162,17 +163,12 @@ const common_cert_t common_cert_set[common_certs_num] = {
 
 static lsquic_str_t *s_ccsbuf;
 
+/* Built once by lsquic_crt_init() so that it can be read from several
+ * threads without locking.
+ */
 lsquic_str_t * get_common_certs_hash()
 {
-    int i;
-    if (s_ccsbuf == NULL)
-    {
-        s_ccsbuf = lsquic_str_new(NULL, 0);
-        for (i=0 ;i<common_certs_num; ++i)
-        {
-            lsquic_str_append(s_ccsbuf, (const char *)&common_cert_set[i].hash, 8);
-        }
-    }
+    assert(s_ccsbuf);
     return s_ccsbuf;
 }
 
@@ -198,35 +194,51 @@ int get_common_cert(uint64_t hash, uint32_t index, lsquic_str_t *buf)
 }
 
 
-/* result is written to dict */
-static void
-make_zlib_dict_for_entries(cert_entry_t *entries,
-                                lsquic_str_t **certs, size_t certs_count,
-                                lsquic_str_t *dict)
+/* Returns zlib dictionary for the entries.  The dictionary consists of
+ * cached and common certificates followed by the block of common
+ * certificate substrings.  When all certificates are compressed, the
+ * dictionary is just the static block and nothing is allocated; otherwise,
+ * the dictionary is assembled in a single buffer, which is returned in
+ * `buf' and must be freed by the caller.  Returns NULL on failure.
+ */
+static const unsigned char *
+get_zlib_dict_for_entries (const cert_entry_t *entries,
+                    lsquic_str_t **certs, size_t certs_count,
+                    unsigned char **buf, size_t *dict_size)
 {
+    unsigned char *p;
+    size_t size;
     int i;
-    size_t zlib_dict_size = 0;
+
+    size = 0;
     for (i = certs_count - 1; i >= 0; --i)
-    {
         if (entries[i].type != ENTRY_COMPRESSED)
-        {
-            zlib_dict_size += lsquic_str_len(certs[i]);
-        }
+            size += lsquic_str_len(certs[i]);
+
+    if (0 == size)
+    {
+        *buf = NULL;
+        *dict_size = sizeof(common_cert_sub_strings);
+        return common_cert_sub_strings;
     }
 
     // At the end of the dictionary is a block of common certificate substrings.
-    zlib_dict_size += sizeof(common_cert_sub_strings);
-    
+    size += sizeof(common_cert_sub_strings);
+    *buf = p = malloc(size);
+    if (!p)
+        return NULL;
+
     for (i = certs_count - 1; i >= 0; --i)
-    {
         if (entries[i].type != ENTRY_COMPRESSED)
         {
-            lsquic_str_append(dict, lsquic_str_buf(certs[i]), lsquic_str_len(certs[i]));
+            memcpy(p, lsquic_str_buf(certs[i]), lsquic_str_len(certs[i]));
+            p += lsquic_str_len(certs[i]);
         }
-    }
 
-    lsquic_str_append(dict, (const char *)common_cert_sub_strings, sizeof(common_cert_sub_strings));
-    assert((size_t)lsquic_str_len(dict) == zlib_dict_size);
+    memcpy(p, common_cert_sub_strings, sizeof(common_cert_sub_strings));
+    assert(p + sizeof(common_cert_sub_strings) == *buf + size);
+    *dict_size = size;
+    return *buf;
 }
 
 
@@ -446,7 +458,9 @@ int decompress_certs(const unsigned char *in, const unsigned char *in_end,
     int ret;
     size_t i;
     uint8_t* uncompressed_data, *uncompressed_data_buf;
-    lsquic_str_t *dict;
+    const unsigned char *dict;
+    unsigned char *dict_buf;
+    size_t dict_size;
     uint32_t uncompressed_size;
     size_t count = *out_certs_count;
     cert_entry_t *entries;
@@ -458,10 +472,7 @@ int decompress_certs(const unsigned char *in, const unsigned char *in_end,
     if (count == 0 || count > 10000)
         return -1;
 
-    dict = lsquic_str_new(NULL, 0);
-    if (!dict)
-        return -1;
-
+    dict_buf = NULL;
     uncompressed_data_buf = NULL;
 #ifdef WIN32
     uncompressed_data = NULL;
@@ -505,9 +516,11 @@ int decompress_certs(const unsigned char *in, const unsigned char *in_end,
         ret = inflate(&z, Z_FINISH);
         if (ret == Z_NEED_DICT)
         {
-            lsquic_str_d(dict);
-            make_zlib_dict_for_entries(entries, out_certs, count, dict);
-            if (Z_OK != inflateSetDictionary(&z, (const unsigned char *)lsquic_str_buf(dict), lsquic_str_len(dict)))
+            dict = get_zlib_dict_for_entries(entries, out_certs, count,
+                                                    &dict_buf, &dict_size);
+            if (!dict)
+                goto err;
+            if (Z_OK != inflateSetDictionary(&z, dict, dict_size))
                 goto err;
             ret = inflate(&z, Z_FINISH);
         }
@@ -544,7 +557,7 @@ int decompress_certs(const unsigned char *in, const unsigned char *in_end,
     }
 
   cleanup:
-    lsquic_str_delete(dict);
+    free(dict_buf);
     free(entries);
     if (uncompressed_data_buf)
         inflateEnd(&z);
@@ -560,6 +573,23 @@ int decompress_certs(const unsigned char *in, const unsigned char *in_end,
 }
 
 
+int
+lsquic_crt_init (void)
+{
+    int i;
+
+    if (s_ccsbuf)
+        return 0;
+
+    s_ccsbuf = lsquic_str_new(NULL, 0);
+    if (!s_ccsbuf)
+        return -1;
+    for (i = 0; i < common_certs_num; ++i)
+        lsquic_str_append(s_ccsbuf, (const char *)&common_cert_set[i].hash, 8);
+    return 0;
+}
+
+
 void
 lsquic_crt_cleanup (void)
 {
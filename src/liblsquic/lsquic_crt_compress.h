@@ -40,6 +40,10 @@ int decompress_certs(const unsigned char *in, const unsigned char *in_end,
                      struct lsquic_str **out_certs, 
                      size_t *out_certs_count);
 
+/* Called from lsquic_global_init() */
+int
+lsquic_crt_init (void);
+
 void
 lsquic_crt_cleanup (void);
 
@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include <openssl/ssl.h>
+#include <openssl/aead.h>
 #include <openssl/crypto.h>
 #include <openssl/stack.h>
 #include <openssl/x509.h>
@@ -28,6 +29,7 @@
 
 static const char s_hs_signature[] = "QUIC CHLO and server config signature";
 static int crypto_inited = 0;
+static int s_have_aes_hw;
 
 
 void rand_bytes(void *data, int len)
@@ -680,8 +682,17 @@ void crypto_init(void)
     make_uint128(&s_prime, 16777216, 315);
     make_uint128(&s_init_hash, 7809847782465536322, 7113472399480571277);
 #endif
+
+    s_have_aes_hw = EVP_has_aes_hardware();
     
     /* MORE .... */
     crypto_inited = 1;
 }
 
+
+int
+crypto_have_aes_hw (void)
+{
+    return s_have_aes_hw;
+}
+
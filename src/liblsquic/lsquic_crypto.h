@@ -27,6 +27,10 @@ struct lsquic_str;
 
 void crypto_init(void);
 
+/* Returns true if the CPU has AES instructions.  Valid after crypto_init() */
+int
+crypto_have_aes_hw (void);
+
 /* XXX: why have a wrapper around RAND_bytes? */
 void rand_bytes(void *data, int len);
 
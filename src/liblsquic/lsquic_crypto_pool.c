@@ -0,0 +1,183 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_crypto_pool.c -- Worker threads to spread crypto work over cores
+ *
+ * Each call to lsquic_crypto_pool_run() starts a new generation.  All
+ * workers are counted as busy when the generation is started, and each
+ * worker, having copied the job description, is done with the generation
+ * only when it leaves.  The caller does not return until every worker has
+ * left.  Thus a worker that wakes up late never performs jobs of one
+ * generation using the description of another.
+ *
+ * Jobs are claimed using an atomic counter, so that fast threads take on
+ * more jobs than slow ones.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic_crypto_pool.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_CRYPTO_POOL
+#include "lsquic_logger.h"
+
+
+struct crypto_pool
+{
+    pthread_mutex_t             cp_lock;
+    pthread_cond_t              cp_work_cond;   /* New generation or stop */
+    pthread_cond_t              cp_idle_cond;   /* cp_n_busy became zero */
+    /* The members below are protected by the lock */
+    crypto_pool_job_f           cp_job;
+    void                       *cp_job_ctx;
+    unsigned                    cp_n_jobs;
+    unsigned                    cp_generation;
+    unsigned                    cp_n_busy;      /* Not done with generation */
+    int                         cp_stop;
+    /* Incremented atomically */
+    unsigned                    cp_next_job;
+    unsigned                    cp_n_threads;   /* Threads started */
+    pthread_t                   cp_threads[0];
+};
+
+
+static void
+do_jobs (struct crypto_pool *pool, crypto_pool_job_f job, void *ctx,
+                                                            unsigned n_jobs)
+{
+    unsigned idx;
+
+    while ((idx = __sync_fetch_and_add(&pool->cp_next_job, 1)) < n_jobs)
+        job(ctx, idx);
+}
+
+
+static void *
+worker_thread (void *arg)
+{
+    struct crypto_pool *const pool = arg;
+    crypto_pool_job_f job;
+    unsigned generation, n_jobs;
+    void *ctx;
+
+    /* Counted in from the first generation, even if the thread starts after
+     * it has begun.
+     */
+    generation = 0;
+    pthread_mutex_lock(&pool->cp_lock);
+    while (1)
+    {
+        while (!pool->cp_stop && generation == pool->cp_generation)
+            pthread_cond_wait(&pool->cp_work_cond, &pool->cp_lock);
+        if (pool->cp_stop)
+            break;
+        generation = pool->cp_generation;
+        job        = pool->cp_job;
+        ctx        = pool->cp_job_ctx;
+        n_jobs     = pool->cp_n_jobs;
+        pthread_mutex_unlock(&pool->cp_lock);
+
+        do_jobs(pool, job, ctx, n_jobs);
+
+        pthread_mutex_lock(&pool->cp_lock);
+        if (0 == --pool->cp_n_busy)
+            pthread_cond_signal(&pool->cp_idle_cond);
+    }
+    pthread_mutex_unlock(&pool->cp_lock);
+
+    return NULL;
+}
+
+
+struct crypto_pool *
+lsquic_crypto_pool_new (unsigned n_threads)
+{
+    struct crypto_pool *pool;
+    int s;
+
+    if (n_threads == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(*pool) + n_threads * sizeof(pool->cp_threads[0]));
+    if (!pool)
+        return NULL;
+
+    pthread_mutex_init(&pool->cp_lock, NULL);
+    pthread_cond_init(&pool->cp_work_cond, NULL);
+    pthread_cond_init(&pool->cp_idle_cond, NULL);
+
+    for ( ; pool->cp_n_threads < n_threads; ++pool->cp_n_threads)
+    {
+        s = pthread_create(&pool->cp_threads[pool->cp_n_threads], NULL,
+                                                        worker_thread, pool);
+        if (s != 0)
+        {
+            LSQ_WARN("cannot create thread: %s", strerror(s));
+            lsquic_crypto_pool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    LSQ_INFO("started %u worker thread%.*s", n_threads, n_threads != 1, "s");
+    return pool;
+}
+
+
+void
+lsquic_crypto_pool_destroy (struct crypto_pool *pool)
+{
+    unsigned n;
+
+    pthread_mutex_lock(&pool->cp_lock);
+    pool->cp_stop = 1;
+    pthread_cond_broadcast(&pool->cp_work_cond);
+    pthread_mutex_unlock(&pool->cp_lock);
+
+    for (n = 0; n < pool->cp_n_threads; ++n)
+        pthread_join(pool->cp_threads[n], NULL);
+
+    pthread_cond_destroy(&pool->cp_idle_cond);
+    pthread_cond_destroy(&pool->cp_work_cond);
+    pthread_mutex_destroy(&pool->cp_lock);
+    free(pool);
+}
+
+
+void
+lsquic_crypto_pool_run (struct crypto_pool *pool, crypto_pool_job_f job,
+                        void *ctx, unsigned n_jobs)
+{
+    if (n_jobs < 2)
+    {
+        if (n_jobs)
+            job(ctx, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->cp_lock);
+    assert(0 == pool->cp_n_busy);
+    pool->cp_job      = job;
+    pool->cp_job_ctx  = ctx;
+    pool->cp_n_jobs   = n_jobs;
+    pool->cp_next_job = 0;
+    pool->cp_n_busy   = pool->cp_n_threads;
+    ++pool->cp_generation;
+    pthread_cond_broadcast(&pool->cp_work_cond);
+    pthread_mutex_unlock(&pool->cp_lock);
+
+    do_jobs(pool, job, ctx, n_jobs);
+
+    /* All jobs have been claimed; wait for workers to finish theirs and
+     * for those that have not woken up yet to leave the generation.
+     */
+    pthread_mutex_lock(&pool->cp_lock);
+    while (pool->cp_n_busy > 0)
+        pthread_cond_wait(&pool->cp_idle_cond, &pool->cp_lock);
+    pthread_mutex_unlock(&pool->cp_lock);
+}
@@ -0,0 +1,32 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_crypto_pool.h -- Worker threads to spread crypto work over cores
+ *
+ * The pool runs a set of independent jobs in parallel and returns when all
+ * of them have completed.  The calling thread takes part in the work.
+ */
+
+#ifndef LSQUIC_CRYPTO_POOL_H
+#define LSQUIC_CRYPTO_POOL_H
+
+struct crypto_pool;
+
+/* Function called to perform job number `job_idx' */
+typedef void (*crypto_pool_job_f)(void *ctx, unsigned job_idx);
+
+/* Start `n_threads' worker threads.  Returns NULL on failure. */
+struct crypto_pool *
+lsquic_crypto_pool_new (unsigned n_threads);
+
+void
+lsquic_crypto_pool_destroy (struct crypto_pool *);
+
+/* Call `job' for each job index from 0 to `n_jobs - 1'.  The order in which
+ * the jobs are performed is not defined.  The function returns when all jobs
+ * are done.  Not reentrant: one pool is to be used by a single thread.
+ */
+void
+lsquic_crypto_pool_run (struct crypto_pool *, crypto_pool_job_f job,
+                        void *ctx, unsigned n_jobs);
+
+#endif
@@ -127,6 +127,20 @@ lsquic_cubic_init_ext (struct lsquic_cubic *cubic, lsquic_cid_t cid,
 } while (0)
 
 
+void
+lsquic_cubic_seed_cwnd (struct lsquic_cubic *cubic, unsigned long cwnd)
+{
+    LSQ_DEBUG("%s(cubic, %lu)", __func__, cwnd);
+    if (cwnd > cubic->cu_cwnd)
+    {
+        cubic->cu_cwnd          = cwnd;
+        cubic->cu_last_max_cwnd = cwnd;
+        cubic->cu_tcp_cwnd      = cwnd;
+        LOG_CWND(cubic);
+    }
+}
+
+
 void
 lsquic_cubic_was_quiet (struct lsquic_cubic *cubic, lsquic_time_t now)
 {
@@ -33,6 +33,12 @@ lsquic_cubic_init_ext (struct lsquic_cubic *, lsquic_cid_t, enum cubic_flags);
 #define lsquic_cubic_init(cubic, cid) \
             lsquic_cubic_init_ext(cubic, cid, DEFAULT_CUBIC_FLAGS)
 
+/* Start with congestion window learned by an earlier connection to the
+ * same destination.  Only larger than default values are used.
+ */
+void
+lsquic_cubic_seed_cwnd (struct lsquic_cubic *, unsigned long cwnd);
+
 void
 lsquic_cubic_ack (struct lsquic_cubic *cubic, lsquic_time_t now,
                   lsquic_time_t rtt, int app_limited, unsigned n_bytes);
@@ -20,6 +20,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <pthread.h>
+#else
+#include <vc_compat.h>
 #endif
 
 
@@ -54,6 +57,12 @@
 #include "lsquic_hash.h"
 #include "lsquic_attq.h"
 #include "lsquic_min_heap.h"
+#include "lsquic_path_hints.h"
+#ifndef WIN32
+#include "lsquic_crypto_pool.h"
+#include "lsquic_kxs_pool.h"
+#include "lsquic_ingress.h"
+#endif
 
 #define LSQUIC_LOGGER_MODULE LSQLM_ENGINE
 #include "lsquic_logger.h"
@@ -64,19 +73,85 @@
 #define MIN_OUT_BATCH_SIZE 256
 #define INITIAL_OUT_BATCH_SIZE 512
 
+/* Certificate verification results are posted from user threads */
+#ifndef WIN32
+typedef pthread_mutex_t eng_lock_t;
+#define eng_lock_init(lock) pthread_mutex_init(lock, NULL)
+#define eng_lock_destroy(lock) pthread_mutex_destroy(lock)
+#define eng_lock(lock) pthread_mutex_lock(lock)
+#define eng_unlock(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK eng_lock_t;
+#define eng_lock_init(lock) InitializeSRWLock(lock)
+#define eng_lock_destroy(lock) do { } while (0)
+#define eng_lock(lock) AcquireSRWLockExclusive(lock)
+#define eng_unlock(lock) ReleaseSRWLockExclusive(lock)
+#endif
+
 struct out_batch
 {
     lsquic_conn_t           *conns  [MAX_OUT_BATCH_SIZE];
     lsquic_packet_out_t     *packets[MAX_OUT_BATCH_SIZE];
     struct lsquic_out_spec   outs   [MAX_OUT_BATCH_SIZE];
+    /* Packets that need to be encrypted and their indexes in the arrays
+     * above.
+     */
+    struct enc_op            ops    [MAX_OUT_BATCH_SIZE];
+    unsigned                 op_idx [MAX_OUT_BATCH_SIZE];
+};
+
+/* Maximum UDP payload over IPv4: this is how much a single GSO buffer can
+ * hold.
+ */
+#define MAX_GSO_BUF_SZ 65507
+
+/* When UDP GSO is used, packets in the out batch are copied into `buf' and
+ * described by `outs', each element of which corresponds to `n_packets'
+ * consecutive packets in the out batch.
+ */
+struct gso_batch
+{
+    struct lsquic_out_spec   outs     [MAX_OUT_BATCH_SIZE];
+    unsigned                 n_packets[MAX_OUT_BATCH_SIZE];
+    unsigned char            buf      [MAX_OUT_BATCH_SIZE * QUIC_MAX_PACKET_SZ];
+};
+
+#ifndef WIN32
+#define IN_BATCH_SIZE 64
+
+/* When crypto threads are used, incoming packets are collected so that
+ * they can be decrypted in parallel before they are passed to their
+ * connections.  See in_batch_flush().
+ */
+struct in_batch
+{
+    unsigned                 n_packets;
+    lsquic_conn_t           *conns    [IN_BATCH_SIZE];
+    lsquic_packet_in_t      *packets  [IN_BATCH_SIZE];
+    const struct sockaddr   *local_sas[IN_BATCH_SIZE];
+    const struct sockaddr   *peer_sas [IN_BATCH_SIZE];
+    void                    *peer_ctxs[IN_BATCH_SIZE];
+    /* Packets that are decrypted by the engine and their indexes in the
+     * arrays above.
+     */
+    struct dec_op            ops      [IN_BATCH_SIZE];
+    unsigned                 op_idx   [IN_BATCH_SIZE];
 };
+#endif
 
 typedef struct lsquic_conn * (*conn_iter_f)(struct lsquic_engine *);
 
+STAILQ_HEAD(conns_stailq, lsquic_conn);
+TAILQ_HEAD(conns_tailq, lsquic_conn);
+
 static void
 process_connections (struct lsquic_engine *engine, conn_iter_f iter,
                      lsquic_time_t now);
 
+static int
+engine_packets_in (lsquic_engine_t *engine,
+        const struct lsquic_in_spec *specs, unsigned n_specs, int own_data);
+
 static void
 engine_incref_conn (lsquic_conn_t *conn, enum lsquic_conn_flags flag);
 
@@ -91,14 +166,16 @@ force_close_conn (lsquic_engine_t *engine, lsquic_conn_t *conn);
 #define ENGINE_IN(e) do {                               \
     assert(!((e)->pub.enp_flags & ENPUB_PROC));         \
     (e)->pub.enp_flags |= ENPUB_PROC;                   \
+    (e)->pub.enp_now = engine_read_clock(&(e)->pub);    \
 } while (0)
 
 #define ENGINE_OUT(e) do {                              \
     assert((e)->pub.enp_flags & ENPUB_PROC);            \
     (e)->pub.enp_flags &= ~ENPUB_PROC;                  \
+    (e)->pub.enp_now = 0;                               \
 } while (0)
 
-/* A connection can be referenced from one of six places:
+/* A connection can be referenced from one of seven places:
  *
  *   1. Connection hash: a connection starts its life in one of those.
  *
@@ -113,6 +190,9 @@ force_close_conn (lsquic_engine_t *engine, lsquic_conn_t *conn);
  *
  *   6. Ticked connections queue.  Another transient queue, similar to (5).
  *
+ *   7. Certificate verification queue: connections whose server certificate
+ *      chain is being verified by the user.
+ *
  * The idea is to destroy the connection when it is no longer referenced.
  * For example, a connection tick may return TICK_SEND|TICK_CLOSE.  In
  * that case, the connection is referenced from two places: (2) and (5).
@@ -128,7 +208,8 @@ force_close_conn (lsquic_engine_t *engine, lsquic_conn_t *conn);
                         |LSCONN_TICKABLE        \
                         |LSCONN_TICKED          \
                         |LSCONN_CLOSING         \
-                        |LSCONN_ATTQ)
+                        |LSCONN_ATTQ            \
+                        |LSCONN_CERT_PENDING)
 
 
 
@@ -144,6 +225,7 @@ struct lsquic_engine
                         = (1 <<  8),    /* Previous call to a processing
                                          * function went past time threshold.
                                          */
+        ENG_IN_BATCH    = (1 <<  9),    /* Incoming packets go to in_batch */
 #ifndef NDEBUG
         ENG_DTOR        = (1 << 26),    /* Engine destructor */
 #endif
@@ -166,9 +248,66 @@ struct lsquic_engine
     unsigned                           n_conns;
     lsquic_time_t                      deadline;
     struct out_batch                   out_batch;
+    struct gso_batch                  *gso_batch;   /* Set if GSO is used */
+#ifndef WIN32
+    struct crypto_pool                *crypto_pool; /* es_crypto_threads */
+    struct in_batch                    in_batch;
+    struct ingress                    *ingress;     /* es_ingress_size */
+#endif
+    struct path_hints                 *path_hints;  /* es_path_hints */
+    /* Connections waiting for lsquic_conn_cert_verified() */
+    struct conns_tailq                 conns_cert;
+    eng_lock_t                         cert_lock;
+    unsigned                           n_certs_done;    /* Protected by
+                                                         * cert_lock
+                                                         */
 };
 
 
+static lsquic_time_t
+engine_read_clock (const struct lsquic_engine_public *enpub)
+{
+    if (enpub->enp_get_time)
+        return enpub->enp_get_time(enpub->enp_get_time_ctx);
+    else
+        return lsquic_time_now();
+}
+
+
+lsquic_time_t
+lsquic_engine_now (struct lsquic_engine_public *enpub)
+{
+    if (enpub->enp_now)
+        return enpub->enp_now;
+    else
+        return engine_read_clock(enpub);
+}
+
+
+/* Cache the time for the duration of a processing pass that is not
+ * delimited by ENGINE_IN and ENGINE_OUT.  Such passes may be nested:
+ * the outer pass's time is kept.  Returns value to pass to
+ * engine_end_pass().
+ */
+static lsquic_time_t
+engine_begin_pass (struct lsquic_engine *engine)
+{
+    lsquic_time_t prev;
+
+    prev = engine->pub.enp_now;
+    if (!prev)
+        engine->pub.enp_now = engine_read_clock(&engine->pub);
+    return prev;
+}
+
+
+static void
+engine_end_pass (struct lsquic_engine *engine, lsquic_time_t prev)
+{
+    engine->pub.enp_now = prev;
+}
+
+
 void
 lsquic_engine_init_settings (struct lsquic_engine_settings *settings,
                              unsigned flags)
@@ -206,6 +345,15 @@ lsquic_engine_init_settings (struct lsquic_engine_settings *settings,
     settings->es_rw_once         = LSQUIC_DF_RW_ONCE;
     settings->es_proc_time_thresh= LSQUIC_DF_PROC_TIME_THRESH;
     settings->es_pace_packets    = LSQUIC_DF_PACE_PACKETS;
+    settings->es_max_gso_segs    = LSQUIC_DF_MAX_GSO_SEGS;
+    settings->es_seal_in_place   = LSQUIC_DF_SEAL_IN_PLACE;
+    settings->es_crypto_threads  = LSQUIC_DF_CRYPTO_THREADS;
+    settings->es_prefer_chacha   = LSQUIC_DF_PREFER_CHACHA;
+    settings->es_kxs_pool_size   = LSQUIC_DF_KXS_POOL_SIZE;
+    settings->es_path_hints      = LSQUIC_DF_PATH_HINTS;
+    settings->es_attq_wheel      = LSQUIC_DF_ATTQ_WHEEL;
+    settings->es_tick_slack_us   = LSQUIC_DF_TICK_SLACK_US;
+    settings->es_ingress_size    = LSQUIC_DF_INGRESS_SIZE;
 }
 
 
@@ -237,6 +385,54 @@ lsquic_engine_check_settings (const struct lsquic_engine_settings *settings,
                         "one or more unsupported QUIC version is specified");
         return -1;
     }
+    if (settings->es_aead != QTAG_AESG && settings->es_aead != QTAG_CC20)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "%s", "unsupported AEAD");
+        return -1;
+    }
+    if (settings->es_max_gso_segs > LSQUIC_MAX_GSO_SEGS)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "max_gso_segs cannot be larger "
+                                            "than %u", LSQUIC_MAX_GSO_SEGS);
+        return -1;
+    }
+    if (settings->es_crypto_threads > LSQUIC_MAX_CRYPTO_THREADS)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "crypto_threads cannot be larger "
+                                        "than %u", LSQUIC_MAX_CRYPTO_THREADS);
+        return -1;
+    }
+    if (settings->es_kxs_pool_size > LSQUIC_MAX_KXS_POOL_SIZE)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "kxs_pool_size cannot be larger "
+                                        "than %u", LSQUIC_MAX_KXS_POOL_SIZE);
+        return -1;
+    }
+    if (settings->es_path_hints > LSQUIC_MAX_PATH_HINTS)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "path_hints cannot be larger "
+                                            "than %u", LSQUIC_MAX_PATH_HINTS);
+        return -1;
+    }
+    if (settings->es_tick_slack_us > LSQUIC_MAX_TICK_SLACK_US)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "tick_slack_us cannot be larger "
+                                        "than %u", LSQUIC_MAX_TICK_SLACK_US);
+        return -1;
+    }
+    if (settings->es_ingress_size > LSQUIC_MAX_INGRESS_SIZE)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "ingress_size cannot be larger "
+                                        "than %u", LSQUIC_MAX_INGRESS_SIZE);
+        return -1;
+    }
     return 0;
 }
 
@@ -306,6 +502,10 @@ lsquic_engine_new (unsigned flags,
     }
     engine->pub.enp_ver_tags_len = tag_buf_len;
     engine->pub.enp_flags = ENPUB_CAN_SEND;
+    engine->pub.enp_verify_cert     = api->ea_verify_cert;
+    engine->pub.enp_verify_cert_ctx = api->ea_verify_cert_ctx;
+    engine->pub.enp_get_time        = api->ea_get_time;
+    engine->pub.enp_get_time_ctx    = api->ea_get_time_ctx;
 
     engine->flags           = flags;
     engine->stream_if       = api->ea_stream_if;
@@ -322,9 +522,88 @@ lsquic_engine_new (unsigned flags,
         engine->pub.enp_pmi      = &stock_pmi;
         engine->pub.enp_pmi_ctx  = NULL;
     }
+    if (engine->pub.enp_settings.es_max_gso_segs > 1)
+    {
+        engine->gso_batch = malloc(sizeof(*engine->gso_batch));
+        if (!engine->gso_batch)
+        {
+            LSQ_ERROR("cannot allocate GSO batch");
+            free(engine);
+            return NULL;
+        }
+    }
+#ifndef WIN32
+    if (engine->pub.enp_settings.es_crypto_threads > 0)
+    {
+        engine->crypto_pool = lsquic_crypto_pool_new(
+                                engine->pub.enp_settings.es_crypto_threads);
+        if (!engine->crypto_pool)
+        {
+            LSQ_ERROR("cannot create crypto pool");
+            free(engine->gso_batch);
+            free(engine);
+            return NULL;
+        }
+    }
+    if (engine->pub.enp_settings.es_kxs_pool_size > 0)
+    {
+        engine->pub.enp_kxs_pool = lsquic_kxs_pool_new(
+                                engine->pub.enp_settings.es_kxs_pool_size);
+        if (!engine->pub.enp_kxs_pool)
+        {
+            LSQ_ERROR("cannot create key share pool");
+            if (engine->crypto_pool)
+                lsquic_crypto_pool_destroy(engine->crypto_pool);
+            free(engine->gso_batch);
+            free(engine);
+            return NULL;
+        }
+    }
+    if (engine->pub.enp_settings.es_ingress_size > 0)
+    {
+        engine->ingress = lsquic_ingress_new(
+                                engine->pub.enp_settings.es_ingress_size);
+        if (!engine->ingress)
+        {
+            LSQ_ERROR("cannot create ingress queue");
+            if (engine->pub.enp_kxs_pool)
+                lsquic_kxs_pool_destroy(engine->pub.enp_kxs_pool);
+            if (engine->crypto_pool)
+                lsquic_crypto_pool_destroy(engine->crypto_pool);
+            free(engine->gso_batch);
+            free(engine);
+            return NULL;
+        }
+    }
+#endif
+    if (!(flags & ENG_SERVER) && engine->pub.enp_settings.es_path_hints > 0)
+    {
+        engine->path_hints = lsquic_path_hints_new(
+                                    engine->pub.enp_settings.es_path_hints);
+        if (!engine->path_hints)
+        {
+            LSQ_ERROR("cannot create path hints");
+#ifndef WIN32
+            if (engine->ingress)
+                lsquic_ingress_destroy(engine->ingress);
+            if (engine->pub.enp_kxs_pool)
+                lsquic_kxs_pool_destroy(engine->pub.enp_kxs_pool);
+            if (engine->crypto_pool)
+                lsquic_crypto_pool_destroy(engine->crypto_pool);
+#endif
+            free(engine->gso_batch);
+            free(engine);
+            return NULL;
+        }
+    }
     engine->pub.enp_engine = engine;
+    TAILQ_INIT(&engine->conns_cert);
+    eng_lock_init(&engine->cert_lock);
     conn_hash_init(&engine->conns_hash);
-    engine->attq = attq_create();
+    if (engine->pub.enp_settings.es_attq_wheel)
+        engine->attq = attq_create_wheel();
+    else
+        engine->attq = attq_create();
     eng_hist_init(&engine->history);
     engine->batch_size = INITIAL_OUT_BATCH_SIZE;
 
@@ -348,12 +627,32 @@ shrink_batch_size (struct lsquic_engine *engine)
 }
 
 
+/* Remember what the connection learned about the path for the next
+ * connection to the same destination.
+ */
+static void
+save_path_hint (struct lsquic_engine *engine, lsquic_conn_t *conn)
+{
+    struct path_hint hint;
+
+    if (conn->cn_if->ci_get_path_hint
+                            && 0 == conn->cn_if->ci_get_path_hint(conn, &hint))
+    {
+        LSQ_DEBUG("save path hint from connection %"PRIu64, conn->cn_cid);
+        lsquic_path_hints_put(engine->path_hints,
+                                (struct sockaddr *) conn->cn_peer_addr, &hint);
+    }
+}
+
+
 /* Wrapper to make sure important things occur before the connection is
  * really destroyed.
  */
 static void
 destroy_conn (struct lsquic_engine *engine, lsquic_conn_t *conn)
 {
+    if (engine->path_hints)
+        save_path_hint(engine, conn);
     --engine->n_conns;
     conn->cn_flags |= LSCONN_NEVER_TICKABLE;
     conn->cn_if->ci_destroy(conn);
@@ -397,7 +696,8 @@ maybe_grow_conn_heaps (struct lsquic_engine *engine)
 
 static lsquic_conn_t *
 new_full_conn_client (lsquic_engine_t *engine, const char *hostname,
-                      unsigned short max_packet_size)
+                      unsigned short max_packet_size,
+                      const struct path_hint *hint)
 {
     lsquic_conn_t *conn;
     unsigned flags;
@@ -405,7 +705,8 @@ new_full_conn_client (lsquic_engine_t *engine, const char *hostname,
         return NULL;
     flags = engine->flags & (ENG_SERVER|ENG_HTTP);
     conn = full_conn_client_new(&engine->pub, engine->stream_if,
-                    engine->stream_if_ctx, flags, hostname, max_packet_size);
+                    engine->stream_if_ctx, flags, hostname, max_packet_size,
+                    hint);
     if (!conn)
         return NULL;
     ++engine->n_conns;
@@ -426,10 +727,13 @@ new_full_conn_client (lsquic_engine_t *engine, const char *hostname,
 }
 
 
+/* If `last_conn' is set, it is checked before the connection hash is
+ * searched: consecutive packets usually belong to the same connection.
+ */
 static lsquic_conn_t *
 find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
          struct packin_parse_state *ppstate, const struct sockaddr *sa_peer,
-         void *peer_ctx)
+         void *peer_ctx, lsquic_conn_t *last_conn)
 {
     lsquic_conn_t *conn;
 
@@ -446,7 +750,13 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
         return NULL;
     }
 
-    conn = conn_hash_find(&engine->conns_hash, packet_in->pi_conn_id);
+    if (last_conn && last_conn->cn_cid == packet_in->pi_conn_id)
+    {
+        assert(last_conn->cn_flags & LSCONN_HASHED);
+        conn = last_conn;
+    }
+    else
+        conn = conn_hash_find(&engine->conns_hash, packet_in->pi_conn_id);
     if (conn)
     {
         conn->cn_pf->pf_parse_packet_in_finish(packet_in, ppstate);
@@ -474,11 +784,98 @@ lsquic_engine_add_conn_to_tickable (struct lsquic_engine_public *enpub,
 }
 
 
+void
+lsquic_engine_verify_cert (struct lsquic_engine_public *enpub,
+        lsquic_conn_t *conn, const struct lsquic_cert *chain, unsigned n_certs)
+{
+    lsquic_engine_t *const engine = (lsquic_engine_t *) enpub;
+
+    assert(enpub->enp_verify_cert);
+    conn->cn_cert_result = 0;
+    TAILQ_INSERT_TAIL(&engine->conns_cert, conn, cn_next_cert);
+    engine_incref_conn(conn, LSCONN_CERT_PENDING);
+    enpub->enp_verify_cert(enpub->enp_verify_cert_ctx, conn, chain, n_certs);
+}
+
+
+void
+lsquic_conn_cert_verified (lsquic_conn_t *conn, int ok)
+{
+    lsquic_engine_t *const engine = lsquic_conn_get_engine(conn);
+
+    eng_lock(&engine->cert_lock);
+    assert(conn->cn_cert_result == 0);
+    conn->cn_cert_result = ok ? 1 : -1;
+    ++engine->n_certs_done;
+    eng_unlock(&engine->cert_lock);
+}
+
+
+/* Pass results of certificate verification to connections and make them
+ * tickable.
+ */
+static void
+process_verified_certs (lsquic_engine_t *engine)
+{
+    lsquic_conn_t *conn, *next;
+    struct conns_tailq done_conns = TAILQ_HEAD_INITIALIZER(done_conns);
+
+    eng_lock(&engine->cert_lock);
+    if (engine->n_certs_done)
+    {
+        for (conn = TAILQ_FIRST(&engine->conns_cert); conn; conn = next)
+        {
+            next = TAILQ_NEXT(conn, cn_next_cert);
+            if (conn->cn_cert_result)
+            {
+                TAILQ_REMOVE(&engine->conns_cert, conn, cn_next_cert);
+                TAILQ_INSERT_TAIL(&done_conns, conn, cn_next_cert);
+            }
+        }
+        engine->n_certs_done = 0;
+    }
+    eng_unlock(&engine->cert_lock);
+
+    while ((conn = TAILQ_FIRST(&done_conns)))
+    {
+        TAILQ_REMOVE(&done_conns, conn, cn_next_cert);
+        if (conn->cn_flags & LSCONN_HASHED)
+        {
+            conn->cn_if->ci_cert_verified(conn, conn->cn_cert_result > 0);
+            if (!(conn->cn_flags & LSCONN_TICKABLE))
+            {
+                lsquic_mh_insert(&engine->conns_tickable, conn,
+                                                    conn->cn_last_ticked);
+                engine_incref_conn(conn, LSCONN_TICKABLE);
+            }
+        }
+        (void) engine_decref_conn(engine, conn, LSCONN_CERT_PENDING);
+    }
+}
+
+
+/* Round tick time up to a multiple of es_tick_slack_us, so that
+ * connections due at about the same time are processed together.
+ */
+static lsquic_time_t
+coalesce_tick_time (const struct lsquic_engine *engine,
+                                                    lsquic_time_t tick_time)
+{
+    const unsigned slack = engine->pub.enp_settings.es_tick_slack_us;
+
+    if (slack)
+        return (tick_time + slack - 1) / slack * slack;
+    else
+        return tick_time;
+}
+
+
 void
 lsquic_engine_add_conn_to_attq (struct lsquic_engine_public *enpub,
                                 lsquic_conn_t *conn, lsquic_time_t tick_time)
 {
     lsquic_engine_t *const engine = (lsquic_engine_t *) enpub;
+    tick_time = coalesce_tick_time(engine, tick_time);
     if (conn->cn_flags & LSCONN_TICKABLE)
     {
         /* Optimization: no need to add the connection to the Advisory Tick
@@ -489,32 +886,18 @@ lsquic_engine_add_conn_to_attq (struct lsquic_engine_public *enpub,
     else if (conn->cn_flags & LSCONN_ATTQ)
     {
         if (lsquic_conn_adv_time(conn) != tick_time)
-        {
-            attq_remove(engine->attq, conn);
-            if (0 != attq_add(engine->attq, conn, tick_time))
-                engine_decref_conn(engine, conn, LSCONN_ATTQ);
-        }
+            attq_reschedule(engine->attq, conn, tick_time);
     }
     else if (0 == attq_add(engine->attq, conn, tick_time))
         engine_incref_conn(conn, LSCONN_ATTQ);
 }
 
 
-/* Return 0 if packet is being processed by a connections, otherwise return 1 */
-static int
-process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
-       struct packin_parse_state *ppstate, const struct sockaddr *sa_local,
+static void
+deliver_packet_in (lsquic_engine_t *engine, lsquic_conn_t *conn,
+       lsquic_packet_in_t *packet_in, const struct sockaddr *sa_local,
        const struct sockaddr *sa_peer, void *peer_ctx)
 {
-    lsquic_conn_t *conn;
-
-    conn = find_or_create_conn(engine, packet_in, ppstate, sa_peer, peer_ctx);
-    if (!conn)
-    {
-        lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
-        return 1;
-    }
-
     if (0 == (conn->cn_flags & LSCONN_TICKABLE))
     {
         lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
@@ -525,6 +908,145 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
     conn->cn_peer_ctx = peer_ctx;
     conn->cn_if->ci_packet_in(conn, packet_in);
     lsquic_packet_in_put(&engine->pub.enp_mm, packet_in);
+}
+
+
+#ifndef WIN32
+/* Called from crypto pool threads, like seal_one() */
+static void
+open_one (void *ctx, unsigned op_idx)
+{
+    struct in_batch *const batch = ctx;
+    const lsquic_conn_t *const conn = batch->conns[ batch->op_idx[op_idx] ];
+
+    conn->cn_esf->esf_decrypt_batch(&batch->ops[op_idx], 1);
+}
+
+
+/* Decrypt packets in the batch using crypto threads and pass all of them
+ * to their connections in the order they came in.  A packet is decrypted
+ * here only if its connection can tell its full packet number.  Packets
+ * that were not decrypted are decrypted by their connections as usual.
+ */
+static void
+in_batch_flush (lsquic_engine_t *engine)
+{
+    struct in_batch *const batch = &engine->in_batch;
+    lsquic_packet_in_t *packet_in;
+    lsquic_conn_t *conn;
+    lsquic_packno_t packno;
+    struct dec_op *op;
+    unsigned i, k, n_ops;
+
+    n_ops = 0;
+    for (i = 0; i < batch->n_packets; ++i)
+    {
+        conn = batch->conns[i];
+        packet_in = batch->packets[i];
+        if (!(conn->cn_esf && conn->cn_esf->esf_decrypt_batch
+                && conn->cn_if->ci_packno_to_decrypt
+                && 0 == conn->cn_if->ci_packno_to_decrypt(conn, packet_in,
+                                                                &packno)))
+            continue;
+        op = &batch->ops[n_ops];
+        op->do_out = lsquic_mm_get_1370(&engine->pub.enp_mm);
+        if (!op->do_out)
+            continue;
+        op->do_enc_session = conn->cn_enc_session;
+        op->do_packno      = packno;
+        op->do_buf         = packet_in->pi_data;
+        op->do_header_len  = packet_in->pi_header_sz;
+        op->do_data_len    = packet_in->pi_data_sz - packet_in->pi_header_sz;
+        op->do_out_sz      = 1370;
+        batch->op_idx[n_ops++] = i;
+    }
+
+    lsquic_crypto_pool_run(engine->crypto_pool, open_one, batch, n_ops);
+
+    for (k = 0; k < n_ops; ++k)
+    {
+        op = &batch->ops[k];
+        i = batch->op_idx[k];
+        packet_in = batch->packets[i];
+        if ((enum enc_level) -1 == op->do_enc_level)
+        {
+            lsquic_mm_put_1370(&engine->pub.enp_mm, op->do_out);
+            continue;
+        }
+        if (packet_in->pi_flags & PI_OWN_DATA)
+            lsquic_mm_put_1370(&engine->pub.enp_mm, packet_in->pi_data);
+        packet_in->pi_data = op->do_out;
+        packet_in->pi_data_sz = op->do_out_len;
+        packet_in->pi_packno = op->do_packno;
+        packet_in->pi_flags |= PI_OWN_DATA | PI_DECRYPTED
+                            | (op->do_enc_level << PIBIT_ENC_LEV_SHIFT);
+        EV_LOG_CONN_EVENT(batch->conns[i]->cn_cid, "decrypted packet %"PRIu64,
+                                                    packet_in->pi_packno);
+    }
+
+    for (i = 0; i < batch->n_packets; ++i)
+        deliver_packet_in(engine, batch->conns[i], batch->packets[i],
+                batch->local_sas[i], batch->peer_sas[i], batch->peer_ctxs[i]);
+    batch->n_packets = 0;
+}
+
+
+static void
+in_batch_add (lsquic_engine_t *engine, lsquic_conn_t *conn,
+       lsquic_packet_in_t *packet_in, const struct sockaddr *sa_local,
+       const struct sockaddr *sa_peer, void *peer_ctx)
+{
+    struct in_batch *const batch = &engine->in_batch;
+    unsigned n;
+
+    /* The Tickable Queue keeps the connection alive until the packet is
+     * delivered.
+     */
+    if (0 == (conn->cn_flags & LSCONN_TICKABLE))
+    {
+        lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
+        engine_incref_conn(conn, LSCONN_TICKABLE);
+    }
+    n = batch->n_packets++;
+    batch->conns[n]     = conn;
+    batch->packets[n]   = packet_in;
+    batch->local_sas[n] = sa_local;
+    batch->peer_sas[n]  = sa_peer;
+    batch->peer_ctxs[n] = peer_ctx;
+    if (IN_BATCH_SIZE == batch->n_packets)
+        in_batch_flush(engine);
+}
+
+
+#endif
+/* Return 0 if packet is being processed by a connections, otherwise return 1.
+ * The connection that got the packet is recorded in `last_conn', if it is
+ * not NULL.
+ */
+static int
+process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
+       struct packin_parse_state *ppstate, const struct sockaddr *sa_local,
+       const struct sockaddr *sa_peer, void *peer_ctx,
+       lsquic_conn_t **last_conn)
+{
+    lsquic_conn_t *conn;
+
+    conn = find_or_create_conn(engine, packet_in, ppstate, sa_peer, peer_ctx,
+                                            last_conn ? *last_conn : NULL);
+    if (!conn)
+    {
+        lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
+        return 1;
+    }
+    if (last_conn)
+        *last_conn = conn;
+
+#ifndef WIN32
+    if (engine->flags & ENG_IN_BATCH)
+        in_batch_add(engine, conn, packet_in, sa_local, sa_peer, peer_ctx);
+    else
+#endif
+    deliver_packet_in(engine, conn, packet_in, sa_local, sa_peer, peer_ctx);
     return 0;
 }
 
@@ -551,10 +1073,17 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
         (void) engine_decref_conn(engine, conn, LSCONN_TICKABLE);
     }
 
+    while ((conn = TAILQ_FIRST(&engine->conns_cert)))
+    {
+        TAILQ_REMOVE(&engine->conns_cert, conn, cn_next_cert);
+        (void) engine_decref_conn(engine, conn, LSCONN_CERT_PENDING);
+    }
+
     for (conn = conn_hash_first(&engine->conns_hash); conn;
                             conn = conn_hash_next(&engine->conns_hash))
         force_close_conn(engine, conn);
     conn_hash_cleanup(&engine->conns_hash);
+    eng_lock_destroy(&engine->cert_lock);
 
     assert(0 == engine->n_conns);
     attq_destroy(engine->attq);
@@ -562,6 +1091,17 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
     assert(0 == lsquic_mh_count(&engine->conns_out));
     assert(0 == lsquic_mh_count(&engine->conns_tickable));
     free(engine->conns_tickable.mh_elems);
+    free(engine->gso_batch);
+#ifndef WIN32
+    if (engine->crypto_pool)
+        lsquic_crypto_pool_destroy(engine->crypto_pool);
+    if (engine->pub.enp_kxs_pool)
+        lsquic_kxs_pool_destroy(engine->pub.enp_kxs_pool);
+    if (engine->ingress)
+        lsquic_ingress_destroy(engine->ingress);
+#endif
+    if (engine->path_hints)
+        lsquic_path_hints_destroy(engine->path_hints);
     free(engine);
 }
 
@@ -572,6 +1112,8 @@ lsquic_engine_connect (lsquic_engine_t *engine, const struct sockaddr *peer_sa,
                        const char *hostname, unsigned short max_packet_size)
 {
     lsquic_conn_t *conn;
+    struct path_hint hint;
+    int have_hint;
     ENGINE_IN(engine);
 
     if (engine->flags & ENG_SERVER)
@@ -580,7 +1122,12 @@ lsquic_engine_connect (lsquic_engine_t *engine, const struct sockaddr *peer_sa,
         goto err;
     }
 
-    if (0 == max_packet_size)
+    have_hint = engine->path_hints
+        && 0 == lsquic_path_hints_get(engine->path_hints, peer_sa, &hint);
+
+    if (0 == max_packet_size && have_hint)
+        max_packet_size = hint.ph_pack_size;
+    else if (0 == max_packet_size)
     {
         switch (peer_sa->sa_family)
         {
@@ -593,7 +1140,8 @@ lsquic_engine_connect (lsquic_engine_t *engine, const struct sockaddr *peer_sa,
         }
     }
 
-    conn = new_full_conn_client(engine, hostname, max_packet_size);
+    conn = new_full_conn_client(engine, hostname, max_packet_size,
+                                                have_hint ? &hint : NULL);
     if (!conn)
         goto err;
     lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
@@ -620,7 +1168,7 @@ remove_conn_from_hash (lsquic_engine_t *engine, lsquic_conn_t *conn)
 
 
 static void
-refflags2str (enum lsquic_conn_flags flags, char s[6])
+refflags2str (enum lsquic_conn_flags flags, char s[8])
 {
     *s = 'C'; s += !!(flags & LSCONN_CLOSING);
     *s = 'H'; s += !!(flags & LSCONN_HASHED);
@@ -628,6 +1176,7 @@ refflags2str (enum lsquic_conn_flags flags, char s[6])
     *s = 'T'; s += !!(flags & LSCONN_TICKABLE);
     *s = 'A'; s += !!(flags & LSCONN_ATTQ);
     *s = 'K'; s += !!(flags & LSCONN_TICKED);
+    *s = 'V'; s += !!(flags & LSCONN_CERT_PENDING);
     *s = '\0';
 }
 
@@ -635,7 +1184,7 @@ refflags2str (enum lsquic_conn_flags flags, char s[6])
 static void
 engine_incref_conn (lsquic_conn_t *conn, enum lsquic_conn_flags flag)
 {
-    char str[2][7];
+    char str[2][8];
     assert(flag & CONN_REF_FLAGS);
     assert(!(conn->cn_flags & flag));
     conn->cn_flags |= flag;
@@ -649,7 +1198,7 @@ static lsquic_conn_t *
 engine_decref_conn (lsquic_engine_t *engine, lsquic_conn_t *conn,
                                         enum lsquic_conn_flags flags)
 {
-    char str[2][7];
+    char str[2][8];
     assert(flags & CONN_REF_FLAGS);
     assert(conn->cn_flags & flags);
 #ifndef NDEBUG
@@ -714,6 +1263,17 @@ conn_iter_next_tickable (struct lsquic_engine *engine)
 }
 
 
+#ifndef WIN32
+static void
+ingress_packets_in (void *ctx, const struct lsquic_in_spec *specs,
+                                                            unsigned n_specs)
+{
+    lsquic_engine_t *const engine = ctx;
+    (void) engine_packets_in(engine, specs, n_specs, 0);
+}
+#endif
+
+
 void
 lsquic_engine_process_conns (lsquic_engine_t *engine)
 {
@@ -722,16 +1282,26 @@ lsquic_engine_process_conns (lsquic_engine_t *engine)
 
     ENGINE_IN(engine);
 
-    now = lsquic_time_now();
+#ifndef WIN32
+    if (engine->ingress)
+        (void) lsquic_ingress_drain(engine->ingress, ingress_packets_in,
+                                                                    engine);
+#endif
+
+    if (!TAILQ_EMPTY(&engine->conns_cert))
+        process_verified_certs(engine);
+
+    now = engine->pub.enp_now;
     while ((conn = attq_pop(engine->attq, now)))
     {
         conn = engine_decref_conn(engine, conn, LSCONN_ATTQ);
         if (conn && !(conn->cn_flags & LSCONN_TICKABLE))
         {
-            lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
+            lsquic_mh_append(&engine->conns_tickable, conn, conn->cn_last_ticked);
             engine_incref_conn(conn, LSCONN_TICKABLE);
         }
     }
+    lsquic_mh_heapify(&engine->conns_tickable);
 
     process_connections(engine, conn_iter_next_tickable, now);
     ENGINE_OUT(engine);
@@ -751,83 +1321,117 @@ generate_header (const lsquic_packet_out_t *packet_out,
 }
 
 
-static ssize_t
-really_encrypt_packet (const lsquic_conn_t *conn,
-                       const lsquic_packet_out_t *packet_out,
-                       unsigned char *buf, size_t bufsz)
-{
-    int enc, header_sz, is_hello_packet;
-    size_t packet_sz;
-    unsigned char header_buf[QUIC_MAX_PUBHDR_SZ];
+enum encpa { ENCPA_OK, ENCPA_NOMEM, ENCPA_BADCRYPT, };
 
-    header_sz = generate_header(packet_out, conn->cn_pf, conn->cn_cid,
-                                            header_buf, sizeof(header_buf));
-    if (header_sz < 0)
-        return -1;
 
-    is_hello_packet = !!(packet_out->po_flags & PO_HELLO);
-    enc = conn->cn_esf->esf_encrypt(conn->cn_enc_session, conn->cn_version, 0,
-                packet_out->po_packno, header_buf, header_sz,
-                packet_out->po_data, packet_out->po_data_sz,
-                buf, bufsz, &packet_sz, is_hello_packet);
-    if (0 == enc)
-    {
-        LSQ_DEBUG("encrypted packet %"PRIu64"; plaintext is %u bytes, "
-            "ciphertext is %zd bytes",
-            packet_out->po_packno,
-            lsquic_po_header_length(packet_out->po_flags) +
-                                                packet_out->po_data_sz,
-            packet_sz);
-        return packet_sz;
+/* Set up encryption of a single packet.  Packets whose frames are all
+ * regenerated (ACK and STOP_WAITING) are never resent: these are encrypted
+ * in place, using the headroom and tailroom of the packet buffer.  Other
+ * packets are encrypted into a new buffer, so that their plaintext can be
+ * used to resend them.
+ */
+static enum encpa
+prepare_enc_op (struct lsquic_engine *engine, const lsquic_conn_t *conn,
+                lsquic_packet_out_t *packet_out, struct enc_op *op)
+{
+    const unsigned header_sz = lsquic_po_header_length(packet_out->po_flags);
+
+    op->eo_enc_session = conn->cn_enc_session;
+    op->eo_version     = conn->cn_version;
+    op->eo_packno      = packet_out->po_packno;
+    op->eo_is_hello    = !!(packet_out->po_flags & PO_HELLO);
+    op->eo_header_len  = header_sz;
+    op->eo_data        = packet_out->po_data;
+    op->eo_data_len    = packet_out->po_data_sz;
+    if (engine->pub.enp_settings.es_seal_in_place
+                && packet_out->po_regen_sz == packet_out->po_data_sz)
+    {
+        op->eo_in_place = 1;
+        op->eo_buf      = packet_out->po_data - header_sz;
+        op->eo_buf_sz   = header_sz + packet_out->po_data_sz + PO_TAILROOM;
     }
     else
-        return -1;
+    {
+        op->eo_in_place = 0;
+        op->eo_buf_sz   = header_sz + packet_out->po_data_sz
+                                                    + QUIC_PACKET_HASH_SZ;
+        op->eo_buf = engine->pub.enp_pmi->pmi_allocate(
+                                    engine->pub.enp_pmi_ctx, op->eo_buf_sz);
+        if (!op->eo_buf)
+        {
+            LSQ_DEBUG("could not allocate memory for outgoing packet of "
+                                                "size %zd", op->eo_buf_sz);
+            return ENCPA_NOMEM;
+        }
+    }
+    op->eo_header = op->eo_buf;
+
+    if ((int) header_sz != generate_header(packet_out, conn->cn_pf,
+                                    conn->cn_cid, op->eo_buf, header_sz))
+    {
+        if (!op->eo_in_place)
+            engine->pub.enp_pmi->pmi_release(engine->pub.enp_pmi_ctx,
+                                                                op->eo_buf);
+        return ENCPA_BADCRYPT;
+    }
+
+    return ENCPA_OK;
 }
 
 
-static enum { ENCPA_OK, ENCPA_NOMEM, ENCPA_BADCRYPT, }
-encrypt_packet (lsquic_engine_t *engine, const lsquic_conn_t *conn,
-                                            lsquic_packet_out_t *packet_out)
+/* Record results of encryption in the packet */
+static enum encpa
+finish_enc_op (struct lsquic_engine *engine, const lsquic_conn_t *conn,
+                lsquic_packet_out_t *packet_out, struct enc_op *op)
 {
-    ssize_t enc_sz;
-    size_t bufsz;
-    unsigned sent_sz;
     unsigned char *buf;
 
-    bufsz = lsquic_po_header_length(packet_out->po_flags) +
-                                packet_out->po_data_sz + QUIC_PACKET_HASH_SZ;
-    buf = engine->pub.enp_pmi->pmi_allocate(engine->pub.enp_pmi_ctx, bufsz);
-    if (!buf)
+    if (op->eo_in_place && op->eo_status > 0)
     {
-        LSQ_DEBUG("could not allocate memory for outgoing packet of size %zd",
-                                                                        bufsz);
-        return ENCPA_NOMEM;
-    }
-
-    {
-        enc_sz = really_encrypt_packet(conn, packet_out, buf, bufsz);
-        sent_sz = enc_sz;
+        /* Packet could not be encrypted in place.  The header has already
+         * been generated in the headroom: use it as is.
+         */
+        op->eo_buf_sz = op->eo_header_len + op->eo_data_len
+                                                    + QUIC_PACKET_HASH_SZ;
+        buf = engine->pub.enp_pmi->pmi_allocate(engine->pub.enp_pmi_ctx,
+                                                            op->eo_buf_sz);
+        if (!buf)
+        {
+            LSQ_DEBUG("could not allocate memory for outgoing packet of "
+                                                "size %zd", op->eo_buf_sz);
+            return ENCPA_NOMEM;
+        }
+        op->eo_in_place = 0;
+        op->eo_status = conn->cn_esf->esf_encrypt(op->eo_enc_session,
+                op->eo_version, 0, op->eo_packno, op->eo_header,
+                op->eo_header_len, op->eo_data, op->eo_data_len, buf,
+                op->eo_buf_sz, &op->eo_out_len, op->eo_is_hello);
+        op->eo_buf = buf;
     }
 
-    if (enc_sz < 0)
+    if (op->eo_status != 0)
     {
-        engine->pub.enp_pmi->pmi_release(engine->pub.enp_pmi_ctx, buf);
+        if (!op->eo_in_place)
+            engine->pub.enp_pmi->pmi_release(engine->pub.enp_pmi_ctx,
+                                                                op->eo_buf);
         return ENCPA_BADCRYPT;
     }
 
-    packet_out->po_enc_data    = buf;
-    packet_out->po_enc_data_sz = enc_sz;
-    packet_out->po_sent_sz     = sent_sz;
+    LSQ_DEBUG("encrypted packet %"PRIu64"%s; plaintext is %zu bytes, "
+        "ciphertext is %zu bytes", packet_out->po_packno,
+        op->eo_in_place ? " in place" : "",
+        op->eo_header_len + op->eo_data_len, op->eo_out_len);
+    packet_out->po_enc_data    = op->eo_buf;
+    packet_out->po_enc_data_sz = op->eo_out_len;
+    packet_out->po_sent_sz     = op->eo_out_len;
     packet_out->po_flags |= PO_ENCRYPTED|PO_SENT_SZ;
+    if (op->eo_in_place)
+        packet_out->po_flags |= PO_INPLACE;
 
     return ENCPA_OK;
 }
 
 
-STAILQ_HEAD(conns_stailq, lsquic_conn);
-TAILQ_HEAD(conns_tailq, lsquic_conn);
-
-
 struct conns_out_iter
 {
     struct min_heap            *coi_heap;
@@ -889,7 +1493,12 @@ coi_deactivate (struct conns_out_iter *iter, lsquic_conn_t *conn)
 {
     if (!(conn->cn_flags & LSCONN_EVANESCENT))
     {
-        assert(!TAILQ_EMPTY(&iter->coi_active_list));
+        assert(conn->cn_flags & LSCONN_COI_ACTIVE);
+        /* Connection other than the one last returned by coi_next() may be
+         * deactivated when it is closed.
+         */
+        if (iter->coi_next == conn)
+            iter->coi_next = TAILQ_NEXT(conn, cn_next_out);
         TAILQ_REMOVE(&iter->coi_active_list, conn, cn_next_out);
         conn->cn_flags &= ~LSCONN_COI_ACTIVE;
         TAILQ_INSERT_TAIL(&iter->coi_inactive_list, conn, cn_next_out);
@@ -917,8 +1526,9 @@ coi_reheap (struct conns_out_iter *iter, lsquic_engine_t *engine)
     {
         TAILQ_REMOVE(&iter->coi_active_list, conn, cn_next_out);
         conn->cn_flags &= ~LSCONN_COI_ACTIVE;
-        lsquic_mh_insert(iter->coi_heap, conn, conn->cn_last_sent);
+        lsquic_mh_append(iter->coi_heap, conn, conn->cn_last_sent);
     }
+    lsquic_mh_heapify(iter->coi_heap);
     while ((conn = TAILQ_FIRST(&iter->coi_inactive_list)))
     {
         TAILQ_REMOVE(&iter->coi_inactive_list, conn, cn_next_out);
@@ -928,6 +1538,65 @@ coi_reheap (struct conns_out_iter *iter, lsquic_engine_t *engine)
 }
 
 
+/* Coalesce runs of packets belonging to the same connection into GSO
+ * buffers and send them out.  Like packets_out(), returns -1 on error.
+ * Otherwise, the number of packets -- not out specs -- sent out is
+ * returned.
+ */
+static int
+send_gso_batch (lsquic_engine_t *engine, const struct out_batch *batch,
+                                                        unsigned n_to_send)
+{
+    struct gso_batch *const gso = engine->gso_batch;
+    const struct lsquic_out_spec *first;
+    unsigned char *p;
+    unsigned i, j, n_specs, max_segs;
+    int n_specs_sent, n_sent;
+
+    max_segs = engine->pub.enp_settings.es_max_gso_segs;
+    p = gso->buf;
+    n_specs = 0;
+    for (i = 0; i < n_to_send; i = j)
+    {
+        /* All packets but the last one must be of the same size: */
+        first = &batch->outs[i];
+        for (j = i + 1; j < n_to_send
+                && j - i < max_segs
+                && batch->conns[j] == batch->conns[i]
+                && batch->outs[j - 1].sz == first->sz
+                && batch->outs[j].sz <= first->sz
+                && (j - i + 1) * first->sz <= MAX_GSO_BUF_SZ; ++j)
+            ;
+        gso->outs[n_specs] = *first;
+        gso->n_packets[n_specs] = j - i;
+        if (j - i > 1)
+        {
+            gso->outs[n_specs].buf   = p;
+            gso->outs[n_specs].segsz = first->sz;
+            for ( ; i < j; ++i)
+            {
+                memcpy(p, batch->outs[i].buf, batch->outs[i].sz);
+                p += batch->outs[i].sz;
+            }
+            gso->outs[n_specs].sz = p - gso->outs[n_specs].buf;
+        }
+        ++n_specs;
+    }
+
+    n_specs_sent = engine->packets_out(engine->packets_out_ctx, gso->outs,
+                                                                    n_specs);
+    if (n_specs_sent < 0)
+        return -1;
+
+    n_sent = 0;
+    for (i = 0; i < (unsigned) n_specs_sent; ++i)
+        n_sent += gso->n_packets[i];
+    LSQ_DEBUG("sent %d packet%.*s in %d GSO spec%.*s", n_sent, n_sent != 1,
+                            "s", n_specs_sent, n_specs_sent != 1, "s");
+    return n_sent;
+}
+
+
 static unsigned
 send_batch (lsquic_engine_t *engine, struct conns_out_iter *conns_iter,
                   struct out_batch *batch, unsigned n_to_send)
@@ -935,11 +1604,18 @@ send_batch (lsquic_engine_t *engine, struct conns_out_iter *conns_iter,
     int n_sent, i;
     lsquic_time_t now;
 
-    /* Set sent time before the write to avoid underestimating RTT */
-    now = lsquic_time_now();
+    /* Set sent time before the write to avoid underestimating RTT.  Code
+     * called after the packets are sent sees this time, too.
+     */
+    now = engine_read_clock(&engine->pub);
+    if (engine->pub.enp_now)
+        engine->pub.enp_now = now;
     for (i = 0; i < (int) n_to_send; ++i)
         batch->packets[i]->po_sent = now;
-    n_sent = engine->packets_out(engine->packets_out_ctx, batch->outs,
+    if (engine->gso_batch)
+        n_sent = send_gso_batch(engine, batch, n_to_send);
+    else
+        n_sent = engine->packets_out(engine->packets_out_ctx, batch->outs,
                                                                 n_to_send);
     if (n_sent >= 0)
         LSQ_DEBUG("packets out returned %d (out of %u)", n_sent, n_to_send);
@@ -964,8 +1640,14 @@ send_batch (lsquic_engine_t *engine, struct conns_out_iter *conns_iter,
          * successfully.  If not successfully sent, we hold on to
          * this buffer until the packet sending is attempted again
          * or until it times out and regenerated.
+         *
+         * A packet encrypted in place has no separate buffer.  It is not
+         * going to be encrypted again, as it carries no retransmittable
+         * frames; it keeps PO_ENCRYPTED so that its ciphertext is not
+         * mistaken for plaintext.
          */
-        if (batch->packets[i]->po_flags & PO_ENCRYPTED)
+        if ((batch->packets[i]->po_flags & (PO_ENCRYPTED|PO_INPLACE))
+                                                            == PO_ENCRYPTED)
         {
             batch->packets[i]->po_flags &= ~PO_ENCRYPTED;
             engine->pub.enp_pmi->pmi_release(engine->pub.enp_pmi_ctx,
@@ -995,7 +1677,7 @@ static int
 check_deadline (lsquic_engine_t *engine)
 {
     if (engine->pub.enp_settings.es_proc_time_thresh &&
-                                lsquic_time_now() > engine->deadline)
+                        engine_read_clock(&engine->pub) > engine->deadline)
     {
         LSQ_INFO("went past threshold of %u usec, stop sending",
                             engine->pub.enp_settings.es_proc_time_thresh);
@@ -1007,26 +1689,176 @@ check_deadline (lsquic_engine_t *engine)
 }
 
 
+/* This is pretty bad: close connection immediately */
+static void
+close_unsendable_conn (struct lsquic_engine *engine,
+                       struct conns_out_iter *conns_iter, lsquic_conn_t *conn,
+                       struct conns_tailq *ticked_conns,
+                       struct conns_stailq *closed_conns)
+{
+    LSQ_INFO("conn %"PRIu64" has unsendable packets", conn->cn_cid);
+    if (!(conn->cn_flags & LSCONN_EVANESCENT))
+    {
+        if (!(conn->cn_flags & LSCONN_CLOSING))
+        {
+            STAILQ_INSERT_TAIL(closed_conns, conn, cn_next_closed_conn);
+            engine_incref_conn(conn, LSCONN_CLOSING);
+            if (conn->cn_flags & LSCONN_HASHED)
+                remove_conn_from_hash(engine, conn);
+        }
+        if (conn->cn_flags & LSCONN_COI_ACTIVE)
+            coi_deactivate(conns_iter, conn);
+        if (conn->cn_flags & LSCONN_TICKED)
+        {
+            TAILQ_REMOVE(ticked_conns, conn, cn_next_ticked);
+            engine_decref_conn(engine, conn, LSCONN_TICKED);
+        }
+    }
+}
+
+
+#ifndef WIN32
+/* Called from crypto pool threads.  Encrypting a packet only reads the
+ * enc session and does not log, so packets belonging to the same
+ * connection can be encrypted concurrently.
+ */
+static void
+seal_one (void *ctx, unsigned op_idx)
+{
+    struct out_batch *const batch = ctx;
+    const lsquic_conn_t *const conn = batch->conns[ batch->op_idx[op_idx] ];
+
+    conn->cn_esf->esf_encrypt_batch(&batch->ops[op_idx], 1);
+}
+
+
+#endif
+/* Second phase of batching: encrypt packets in the batch in one go, so that
+ * crypto is not interleaved with packet scheduling and the enc session can
+ * seal several packets at once.
+ *
+ * Returns the number of packets at the head of the batch that are ready to
+ * be sent.  The packets after them are returned to their connections.  If
+ * a packet could not be encrypted, `*encpa' says why.
+ */
+static unsigned
+seal_batch (struct lsquic_engine *engine, struct conns_out_iter *conns_iter,
+            struct out_batch *batch, unsigned n_packets,
+            struct conns_tailq *ticked_conns,
+            struct conns_stailq *closed_conns, enum encpa *encpa)
+{
+    const struct enc_session_funcs *esf;
+    lsquic_packet_out_t *packet_out;
+    lsquic_conn_t *conn;
+    enum encpa st;
+    unsigned i, j, k, n_ops, n_ready;
+
+    *encpa = ENCPA_OK;
+    n_ops = 0;
+    for (i = 0; i < n_packets; ++i)
+    {
+        if (batch->packets[i]->po_flags & (PO_ENCRYPTED|PO_NOENCRYPT))
+            continue;
+        *encpa = prepare_enc_op(engine, batch->conns[i], batch->packets[i],
+                                                        &batch->ops[n_ops]);
+        if (*encpa != ENCPA_OK)
+            break;
+        batch->op_idx[n_ops++] = i;
+    }
+    n_ready = i;
+
+#ifndef WIN32
+    if (engine->crypto_pool)
+        lsquic_crypto_pool_run(engine->crypto_pool, seal_one, batch, n_ops);
+    else
+#endif
+    for (k = 0; k < n_ops; k = j)
+    {
+        esf = batch->conns[ batch->op_idx[k] ]->cn_esf;
+        for (j = k + 1; j < n_ops
+                    && batch->conns[ batch->op_idx[j] ]->cn_esf == esf; ++j)
+            ;
+        esf->esf_encrypt_batch(&batch->ops[k], j - k);
+    }
+
+    for (k = 0; k < n_ops; ++k)
+    {
+        i = batch->op_idx[k];
+        st = finish_enc_op(engine, batch->conns[i], batch->packets[i],
+                                                            &batch->ops[k]);
+        if (st != ENCPA_OK && i < n_ready)
+        {
+            n_ready = i;
+            *encpa = st;
+        }
+    }
+
+    for (i = 0; i < n_ready; ++i)
+    {
+        packet_out = batch->packets[i];
+        if (packet_out->po_flags & PO_ENCRYPTED)
+        {
+            batch->outs[i].buf = packet_out->po_enc_data;
+            batch->outs[i].sz  = packet_out->po_enc_data_sz;
+        }
+        else
+        {
+            batch->outs[i].buf = packet_out->po_data;
+            batch->outs[i].sz  = packet_out->po_data_sz;
+        }
+    }
+
+    /* Return packets to the connection in reverse order so that the packet
+     * ordering is maintained.
+     */
+    for (i = n_packets; i > n_ready; --i)
+    {
+        conn = batch->conns[i - 1];
+        conn->cn_if->ci_packet_not_sent(conn, batch->packets[i - 1]);
+        if (!(conn->cn_flags & (LSCONN_COI_ACTIVE|LSCONN_EVANESCENT)))
+            coi_reactivate(conns_iter, conn);
+    }
+
+    if (*encpa == ENCPA_BADCRYPT)
+        close_unsendable_conn(engine, conns_iter, batch->conns[n_ready],
+                                                ticked_conns, closed_conns);
+
+    return n_ready;
+}
+
+
+/* Packets are sent in two phases: first, a batch of packets is collected
+ * from the connections; then, the whole batch is encrypted and sent.
+ */
 static void
 send_packets_out (struct lsquic_engine *engine,
                   struct conns_tailq *ticked_conns,
                   struct conns_stailq *closed_conns)
 {
-    unsigned n, w, n_sent, n_batches_sent;
+    unsigned n, w, n_sent, n_batches_sent, n_run, n_ready;
     lsquic_packet_out_t *packet_out;
-    lsquic_conn_t *conn;
+    lsquic_conn_t *conn, *run_conn;
     struct out_batch *const batch = &engine->out_batch;
     struct conns_out_iter conns_iter;
     int shrink, deadline_exceeded;
+    enum encpa encpa;
 
     coi_init(&conns_iter, engine);
     n_batches_sent = 0;
     n_sent = 0, n = 0;
     shrink = 0;
     deadline_exceeded = 0;
+    run_conn = NULL;
+    n_run = 0;
 
-    while ((conn = coi_next(&conns_iter)))
+    /* When GSO is used, `run_conn' is set to keep on batching packets
+     * from the same connection, so that they can be coalesced.
+     */
+    while ((conn = run_conn ? run_conn : coi_next(&conns_iter)))
     {
+        if (conn != run_conn)
+            n_run = 0;
+        run_conn = NULL;
         packet_out = conn->cn_if->ci_next_packet_to_send(conn);
         if (!packet_out) {
             LSQ_DEBUG("batched all outgoing packets for conn %"PRIu64,
@@ -1034,65 +1866,34 @@ send_packets_out (struct lsquic_engine *engine,
             coi_deactivate(&conns_iter, conn);
             continue;
         }
-        if (!(packet_out->po_flags & (PO_ENCRYPTED|PO_NOENCRYPT)))
-        {
-            switch (encrypt_packet(engine, conn, packet_out))
-            {
-            case ENCPA_NOMEM:
-                /* Send what we have and wait for a more opportune moment */
-                conn->cn_if->ci_packet_not_sent(conn, packet_out);
-                goto end_for;
-            case ENCPA_BADCRYPT:
-                /* This is pretty bad: close connection immediately */
-                conn->cn_if->ci_packet_not_sent(conn, packet_out);
-                LSQ_INFO("conn %"PRIu64" has unsendable packets", conn->cn_cid);
-                if (!(conn->cn_flags & LSCONN_EVANESCENT))
-                {
-                    if (!(conn->cn_flags & LSCONN_CLOSING))
-                    {
-                        STAILQ_INSERT_TAIL(closed_conns, conn, cn_next_closed_conn);
-                        engine_incref_conn(conn, LSCONN_CLOSING);
-                        if (conn->cn_flags & LSCONN_HASHED)
-                            remove_conn_from_hash(engine, conn);
-                    }
-                    coi_deactivate(&conns_iter, conn);
-                    if (conn->cn_flags & LSCONN_TICKED)
-                    {
-                        TAILQ_REMOVE(ticked_conns, conn, cn_next_ticked);
-                        engine_decref_conn(engine, conn, LSCONN_TICKED);
-                    }
-                }
-                continue;
-            case ENCPA_OK:
-                break;
-            }
-        }
         LSQ_DEBUG("batched packet %"PRIu64" for connection %"PRIu64,
                                         packet_out->po_packno, conn->cn_cid);
         assert(conn->cn_flags & LSCONN_HAS_PEER_SA);
-        if (packet_out->po_flags & PO_ENCRYPTED)
-        {
-            batch->outs[n].buf     = packet_out->po_enc_data;
-            batch->outs[n].sz      = packet_out->po_enc_data_sz;
-        }
-        else
-        {
-            batch->outs[n].buf     = packet_out->po_data;
-            batch->outs[n].sz      = packet_out->po_data_sz;
-        }
         batch->outs   [n].peer_ctx = conn->cn_peer_ctx;
         batch->outs   [n].local_sa = (struct sockaddr *) conn->cn_local_addr;
         batch->outs   [n].dest_sa  = (struct sockaddr *) conn->cn_peer_addr;
+        batch->outs   [n].segsz    = 0;
         batch->conns  [n]          = conn;
         batch->packets[n]          = packet_out;
         ++n;
+        if (engine->gso_batch
+                && ++n_run < engine->pub.enp_settings.es_max_gso_segs)
+            run_conn = conn;
         if (n == engine->batch_size)
         {
+            n_ready = seal_batch(engine, &conns_iter, batch, n,
+                                        ticked_conns, closed_conns, &encpa);
             n = 0;
-            w = send_batch(engine, &conns_iter, batch, engine->batch_size);
+            /* Do not take more packets from connection that was closed */
+            if (encpa == ENCPA_BADCRYPT && run_conn == batch->conns[n_ready])
+                run_conn = NULL;
+            w = n_ready ? send_batch(engine, &conns_iter, batch, n_ready) : 0;
             ++n_batches_sent;
             n_sent += w;
-            if (w < engine->batch_size)
+            /* On NOMEM, wait for a more opportune moment */
+            if (encpa == ENCPA_NOMEM)
+                break;
+            if (w < n_ready)
             {
                 shrink = 1;
                 break;
@@ -1100,15 +1901,17 @@ send_packets_out (struct lsquic_engine *engine,
             deadline_exceeded = check_deadline(engine);
             if (deadline_exceeded)
                 break;
-            grow_batch_size(engine);
+            if (n_ready == engine->batch_size)
+                grow_batch_size(engine);
         }
     }
-  end_for:
 
     if (n > 0) {
-        w = send_batch(engine, &conns_iter, batch, n);
+        n_ready = seal_batch(engine, &conns_iter, batch, n,
+                                        ticked_conns, closed_conns, &encpa);
+        w = n_ready ? send_batch(engine, &conns_iter, batch, n_ready) : 0;
         n_sent += w;
-        shrink = w < n;
+        shrink = w < n_ready;
         ++n_batches_sent;
         deadline_exceeded = check_deadline(engine);
     }
@@ -1147,9 +1950,11 @@ lsquic_engine_send_unsent_packets (lsquic_engine_t *engine)
     lsquic_conn_t *conn;
     struct conns_stailq closed_conns;
     struct conns_tailq ticked_conns = TAILQ_HEAD_INITIALIZER(ticked_conns);
+    lsquic_time_t prev_now;
 
     STAILQ_INIT(&closed_conns);
-    reset_deadline(engine, lsquic_time_now());
+    prev_now = engine_begin_pass(engine);
+    reset_deadline(engine, engine->pub.enp_now);
     if (!(engine->pub.enp_flags & ENPUB_CAN_SEND))
     {
         LSQ_DEBUG("can send again");
@@ -1164,6 +1969,7 @@ lsquic_engine_send_unsent_packets (lsquic_engine_t *engine)
         (void) engine_decref_conn(engine, conn, LSCONN_CLOSING);
     }
 
+    engine_end_pass(engine, prev_now);
 }
 
 
@@ -1194,7 +2000,7 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
         {
             if (!(conn->cn_flags & LSCONN_HAS_OUTGOING))
             {
-                lsquic_mh_insert(&engine->conns_out, conn, conn->cn_last_sent);
+                lsquic_mh_append(&engine->conns_out, conn, conn->cn_last_sent);
                 engine_incref_conn(conn, LSCONN_HAS_OUTGOING);
             }
         }
@@ -1211,6 +2017,7 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
             engine_incref_conn(conn, LSCONN_TICKED);
         }
     }
+    lsquic_mh_heapify(&engine->conns_out);
 
     if ((engine->pub.enp_flags & ENPUB_CAN_SEND)
                         && lsquic_engine_has_unsent_packets(engine))
@@ -1221,8 +2028,8 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
         (void) engine_decref_conn(engine, conn, LSCONN_CLOSING);
     }
 
-    /* TODO Heapification can be optimized by switching to the Floyd method:
-     * https://en.wikipedia.org/wiki/Binary_heap#Building_a_heap
+    /* Connections are appended to the Tickable Queue and the heap is built
+     * once at the end, using Floyd's method.
      */
     while ((conn = TAILQ_FIRST(&ticked_conns)))
     {
@@ -1231,7 +2038,7 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
         if (!(conn->cn_flags & LSCONN_TICKABLE)
             && conn->cn_if->ci_is_tickable(conn))
         {
-            lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
+            lsquic_mh_append(&engine->conns_tickable, conn, conn->cn_last_ticked);
             engine_incref_conn(conn, LSCONN_TICKABLE);
         }
         else if (!(conn->cn_flags & LSCONN_ATTQ))
@@ -1239,6 +2046,7 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
             next_tick_time = conn->cn_if->ci_next_tick_time(conn);
             if (next_tick_time)
             {
+                next_tick_time = coalesce_tick_time(engine, next_tick_time);
                 if (0 == attq_add(engine->attq, conn, next_tick_time))
                     engine_incref_conn(conn, LSCONN_ATTQ);
             }
@@ -1246,18 +2054,22 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
                 assert(0);
         }
     }
+    lsquic_mh_heapify(&engine->conns_tickable);
 
 }
 
 
 /* Return 0 if packet is being processed by a real connection, 1 if the
- * packet was processed, but not by a connection, and -1 on error.
+ * packet was processed, but not by a connection, and -1 on error.  If
+ * `own_data' is set, packet_in_data is a buffer obtained using
+ * lsquic_engine_get_packet_in_buf() and the engine takes ownership of it.
  */
-int
-lsquic_engine_packet_in (lsquic_engine_t *engine,
+static int
+engine_packet_in (lsquic_engine_t *engine,
     const unsigned char *packet_in_data, size_t packet_in_size,
     const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
-    void *peer_ctx)
+    void *peer_ctx, lsquic_time_t received, lsquic_conn_t **last_conn,
+    int own_data)
 {
     struct packin_parse_state ppstate;
     lsquic_packet_in_t *packet_in;
@@ -1267,18 +2079,21 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
         LSQ_DEBUG("Cannot handle packet_in_size(%zd) > %d packet incoming "
             "packet's header", packet_in_size, QUIC_MAX_PACKET_SZ);
         errno = E2BIG;
-        return -1;
+        goto err;
     }
 
     packet_in = lsquic_mm_get_packet_in(&engine->pub.enp_mm);
     if (!packet_in)
-        return -1;
+        goto err;
 
-    /* Library does not modify packet_in_data, it is not referenced after
-     * this function returns and subsequent release of pi_data is guarded
-     * by PI_OWN_DATA flag.
+    /* Unless it owns it, library does not modify packet_in_data, it is not
+     * referenced after this function returns and subsequent release of
+     * pi_data is guarded by PI_OWN_DATA flag.  An owned buffer is decrypted
+     * in place.
      */
     packet_in->pi_data = (unsigned char *) packet_in_data;
+    if (own_data)
+        packet_in->pi_flags |= PI_OWN_DATA;
     if (0 != parse_packet_in_begin(packet_in, packet_in_size,
                                         engine->flags & ENG_SERVER, &ppstate))
     {
@@ -1288,10 +2103,203 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
         return -1;
     }
 
-    packet_in->pi_received = lsquic_time_now();
+    packet_in->pi_received = received;
     eng_hist_inc(&engine->history, packet_in->pi_received, sl_packets_in);
     return process_packet_in(engine, packet_in, &ppstate, sa_local, sa_peer,
-                                                                    peer_ctx);
+                                                        peer_ctx, last_conn);
+
+  err:
+    if (own_data)
+        lsquic_mm_put_1370(&engine->pub.enp_mm,
+                                        (unsigned char *) packet_in_data);
+    return -1;
+}
+
+
+int
+lsquic_engine_packet_in (lsquic_engine_t *engine,
+    const unsigned char *packet_in_data, size_t packet_in_size,
+    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+    void *peer_ctx)
+{
+    lsquic_time_t prev_now;
+    int s;
+
+    prev_now = engine_begin_pass(engine);
+    s = engine_packet_in(engine, packet_in_data, packet_in_size, sa_local,
+                        sa_peer, peer_ctx, engine->pub.enp_now, NULL, 0);
+    engine_end_pass(engine, prev_now);
+    return s;
+}
+
+
+/* Convert user-supplied wall-clock receive time to engine time.  `now' and
+ * `real_now' are readings of the two clocks taken at about the same time.
+ * The timestamp cannot be in the future: if it is, the clocks are out of
+ * sync and the best we can do is `now'.
+ */
+static lsquic_time_t
+user_ts_to_received (const struct timespec *ts, lsquic_time_t now,
+                                                    lsquic_time_t real_now)
+{
+    lsquic_time_t ts_usec, age;
+
+    ts_usec = (lsquic_time_t) ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+    if (ts_usec < real_now)
+    {
+        age = real_now - ts_usec;
+        if (age < now)
+            return now - age;
+    }
+    return now;
+}
+
+
+int
+lsquic_engine_packet_in_ts (lsquic_engine_t *engine,
+    const unsigned char *packet_in_data, size_t packet_in_size,
+    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+    void *peer_ctx, const struct timespec *ts)
+{
+    lsquic_time_t received, prev_now;
+    int s;
+
+    prev_now = engine_begin_pass(engine);
+    received = engine->pub.enp_now;
+    if (ts)
+        received = user_ts_to_received(ts, received, lsquic_time_now_real());
+    s = engine_packet_in(engine, packet_in_data, packet_in_size, sa_local,
+                            sa_peer, peer_ctx, received, NULL, 0);
+    engine_end_pass(engine, prev_now);
+    return s;
+}
+
+
+/* The clocks are read once for the whole batch and connection hash lookup
+ * is skipped for runs of packets destined to the same connection.
+ */
+static int
+engine_packets_in (lsquic_engine_t *engine,
+        const struct lsquic_in_spec *specs, unsigned n_specs, int own_data)
+{
+    const struct lsquic_in_spec *spec;
+    const unsigned char *p, *end;
+    lsquic_conn_t *last_conn;
+    lsquic_time_t now, real_now, received, prev_now;
+    size_t sz;
+    int n_processed;
+
+    prev_now = engine_begin_pass(engine);
+    now = engine->pub.enp_now;
+    real_now = 0;
+    last_conn = NULL;
+    n_processed = 0;
+#ifndef WIN32
+    if (engine->crypto_pool)
+        engine->flags |= ENG_IN_BATCH;
+#endif
+    for (spec = specs; spec < specs + n_specs; ++spec)
+    {
+        if (spec->received)
+        {
+            if (0 == real_now)
+                real_now = lsquic_time_now_real();
+            received = user_ts_to_received(spec->received, now, real_now);
+        }
+        else
+            received = now;
+        if (own_data && (0 == spec->sz || spec->segsz))
+        {
+            /* The buffer holds no packet or cannot be shared by several
+             * packets: take it back.
+             */
+            LSQ_INFO("drop owned buffer of %zu bytes, segsz %zu", spec->sz,
+                                                                spec->segsz);
+            lsquic_mm_put_1370(&engine->pub.enp_mm,
+                                                (unsigned char *) spec->buf);
+            continue;
+        }
+        end = spec->buf + spec->sz;
+        for (p = spec->buf; p < end; p += sz)
+        {
+            if (spec->segsz && spec->segsz < (size_t) (end - p))
+                sz = spec->segsz;
+            else
+                sz = end - p;
+            if (0 == engine_packet_in(engine, p, sz, spec->local_sa,
+                                spec->peer_sa, spec->peer_ctx, received,
+                                &last_conn, own_data))
+                ++n_processed;
+        }
+    }
+
+#ifndef WIN32
+    if (engine->flags & ENG_IN_BATCH)
+    {
+        engine->flags &= ~ENG_IN_BATCH;
+        in_batch_flush(engine);
+    }
+#endif
+    engine_end_pass(engine, prev_now);
+    LSQ_DEBUG("%d packet%.*s in %u spec%.*s processed by connections",
+        n_processed, n_processed != 1, "s", n_specs, n_specs != 1, "s");
+    return n_processed;
+}
+
+
+int
+lsquic_engine_packets_in (lsquic_engine_t *engine,
+                    const struct lsquic_in_spec *specs, unsigned n_specs)
+{
+    return engine_packets_in(engine, specs, n_specs, 0);
+}
+
+
+#ifndef WIN32
+int
+lsquic_engine_enqueue_packet (lsquic_engine_t *engine,
+    const unsigned char *packet_in_data, size_t packet_in_size,
+    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+    void *peer_ctx, const struct timespec *received)
+{
+    if (engine->ingress)
+        return lsquic_ingress_put(engine->ingress, packet_in_data,
+                packet_in_size, sa_local, sa_peer, peer_ctx, received);
+    else
+        return -1;
+}
+
+
+int
+lsquic_engine_ingress_fd (const lsquic_engine_t *engine)
+{
+    if (engine->ingress)
+        return lsquic_ingress_fd(engine->ingress);
+    else
+        return -1;
+}
+#endif
+
+
+int
+lsquic_engine_packets_in_owned (lsquic_engine_t *engine,
+                    const struct lsquic_in_spec *specs, unsigned n_specs)
+{
+    return engine_packets_in(engine, specs, n_specs, 1);
+}
+
+
+unsigned char *
+lsquic_engine_get_packet_in_buf (lsquic_engine_t *engine)
+{
+    return lsquic_mm_get_1370(&engine->pub.enp_mm);
+}
+
+
+void
+lsquic_engine_put_packet_in_buf (lsquic_engine_t *engine, unsigned char *buf)
+{
+    lsquic_mm_put_1370(&engine->pub.enp_mm, buf);
 }
 
 
@@ -1310,6 +2318,7 @@ lsquic_engine_earliest_adv_tick (lsquic_engine_t *engine, int *diff)
 {
     const lsquic_time_t *next_time;
     lsquic_time_t now;
+    unsigned n_certs_done;
 
     if (((engine->flags & ENG_PAST_DEADLINE)
                                     && lsquic_mh_count(&engine->conns_out))
@@ -1319,11 +2328,23 @@ lsquic_engine_earliest_adv_tick (lsquic_engine_t *engine, int *diff)
         return 1;
     }
 
+    if (!TAILQ_EMPTY(&engine->conns_cert))
+    {
+        eng_lock(&engine->cert_lock);
+        n_certs_done = engine->n_certs_done;
+        eng_unlock(&engine->cert_lock);
+        if (n_certs_done)
+        {
+            *diff = 0;
+            return 1;
+        }
+    }
+
     next_time = attq_next_time(engine->attq);
     if (!next_time)
         return 0;
 
-    now = lsquic_time_now();
+    now = lsquic_engine_now(&engine->pub);
     *diff = (int) ((int64_t) *next_time - (int64_t) now);
     return 1;
 }
@@ -1333,7 +2354,7 @@ unsigned
 lsquic_engine_count_attq (lsquic_engine_t *engine, int from_now)
 {
     lsquic_time_t now;
-    now = lsquic_time_now();
+    now = lsquic_engine_now(&engine->pub);
     if (from_now < 0)
         now -= from_now;
     else
@@ -0,0 +1,602 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_engine_group.c -- Group of engines, each running in its own thread
+ *
+ * An engine is single-threaded.  To use more than one core, the group
+ * creates several engines -- shards -- and runs each of them in a separate
+ * worker thread.  Each shard has its own UDP socket and, since every engine
+ * has its own memory manager, there is no contention on the packet path.
+ *
+ * The only thing the shards share is the command queue, via which new
+ * connections are handed off to them, and the stats counters.  Both are
+ * protected by the per-shard lock.
+ */
+
+#if __GNUC__
+#define _GNU_SOURCE     /* For pthread_setaffinity_np */
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "lsquic.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_ENGINE_GROUP
+#include "lsquic_logger.h"
+
+
+struct group_cmd
+{
+    TAILQ_ENTRY(group_cmd)          gc_next;
+    struct sockaddr_storage         gc_peer_sa;
+    lsquic_conn_ctx_t              *gc_conn_ctx;
+    char                           *gc_hostname;
+    unsigned short                  gc_max_packet_size;
+};
+
+
+struct engine_shard
+{
+    struct lsquic_engine_group     *es_group;
+    lsquic_engine_t                *es_engine;
+    struct lsquic_udp_io           *es_io;
+    int                             es_fd;
+    int                             es_wakeup[2];   /* Pipe */
+    unsigned                        es_idx;
+    pthread_t                       es_thread;
+    int                             es_lock_inited;
+    /* The lock protects members below it */
+    pthread_mutex_t                 es_lock;
+    enum {
+        ES_STOP         = 1 << 0,   /* Worker thread should exit */
+    }                               es_flags;
+    TAILQ_HEAD(, group_cmd)         es_cmds;
+    unsigned                        es_n_pending;   /* Number of es_cmds */
+    unsigned                        es_n_conns;
+    unsigned long long              es_n_conns_created,
+                                    es_n_packets_in,
+                                    es_n_packets_out;
+};
+
+
+struct lsquic_engine_group
+{
+    const struct lsquic_stream_if  *eg_user_stream_if;
+    void                           *eg_user_stream_if_ctx;
+    struct lsquic_stream_if         eg_stream_if;   /* Wraps the user's */
+    struct engine_shard            *eg_shards;
+    unsigned                        eg_n_shards;
+    unsigned                        eg_n_started;   /* Threads started */
+    unsigned                        eg_next_shard;  /* Round-robin */
+    enum lsquic_engine_group_flags  eg_flags;
+};
+
+
+/* Stream callbacks that do not take stream_if_ctx go straight to the user.
+ * We intercept connection creation and destruction to keep count.
+ */
+static lsquic_conn_ctx_t *
+group_on_new_conn (void *stream_if_ctx, lsquic_conn_t *conn)
+{
+    struct engine_shard *const shard = stream_if_ctx;
+    struct lsquic_engine_group *const group = shard->es_group;
+
+    pthread_mutex_lock(&shard->es_lock);
+    ++shard->es_n_conns;
+    ++shard->es_n_conns_created;
+    pthread_mutex_unlock(&shard->es_lock);
+
+    return group->eg_user_stream_if->on_new_conn(
+                                        group->eg_user_stream_if_ctx, conn);
+}
+
+
+static void
+group_on_conn_closed (lsquic_conn_t *conn)
+{
+    struct engine_shard *const shard = lsquic_conn_get_peer_ctx(conn);
+
+    pthread_mutex_lock(&shard->es_lock);
+    assert(shard->es_n_conns > 0);
+    --shard->es_n_conns;
+    pthread_mutex_unlock(&shard->es_lock);
+
+    shard->es_group->eg_user_stream_if->on_conn_closed(conn);
+}
+
+
+static lsquic_stream_ctx_t *
+group_on_new_stream (void *stream_if_ctx, lsquic_stream_t *stream)
+{
+    struct engine_shard *const shard = stream_if_ctx;
+    struct lsquic_engine_group *const group = shard->es_group;
+
+    return group->eg_user_stream_if->on_new_stream(
+                                    group->eg_user_stream_if_ctx, stream);
+}
+
+
+/* Every connection in the shard has the shard as its peer context, so all
+ * specs go out via the shard's socket.
+ */
+static int
+shard_packets_out (void *ctx, const struct lsquic_out_spec *specs,
+                                                                unsigned count)
+{
+    struct engine_shard *const shard = ctx;
+    int n_sent;
+
+    n_sent = lsquic_udp_io_send(shard->es_io, specs, count);
+    if (n_sent > 0)
+    {
+        pthread_mutex_lock(&shard->es_lock);
+        shard->es_n_packets_out += (unsigned) n_sent;
+        pthread_mutex_unlock(&shard->es_lock);
+    }
+    return n_sent;
+}
+
+
+static void
+shard_wakeup (struct engine_shard *shard)
+{
+    const char c = 0;
+    /* If the pipe is full, the thread is going to wake up anyway */
+    if (write(shard->es_wakeup[1], &c, 1) < 0 && EAGAIN != errno)
+        LSQ_WARN("shard %u: cannot write to pipe: %s", shard->es_idx,
+                                                            strerror(errno));
+}
+
+
+static void
+shard_drain_wakeup (struct engine_shard *shard)
+{
+    char buf[0x40];
+    while (read(shard->es_wakeup[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+
+static void
+destroy_cmd (struct group_cmd *cmd)
+{
+    free(cmd->gc_hostname);
+    free(cmd);
+}
+
+
+/* Returns true if the thread should stop */
+static int
+shard_run_commands (struct engine_shard *shard)
+{
+    TAILQ_HEAD(, group_cmd) cmds;
+    struct group_cmd *cmd;
+    lsquic_conn_t *conn;
+    int stop;
+
+    TAILQ_INIT(&cmds);
+    pthread_mutex_lock(&shard->es_lock);
+    TAILQ_CONCAT(&cmds, &shard->es_cmds, gc_next);
+    shard->es_n_pending = 0;
+    stop = !!(shard->es_flags & ES_STOP);
+    pthread_mutex_unlock(&shard->es_lock);
+
+    while ((cmd = TAILQ_FIRST(&cmds)))
+    {
+        TAILQ_REMOVE(&cmds, cmd, gc_next);
+        if (!stop)
+        {
+            conn = lsquic_engine_connect(shard->es_engine,
+                        (struct sockaddr *) &cmd->gc_peer_sa, shard,
+                        cmd->gc_conn_ctx, cmd->gc_hostname,
+                        cmd->gc_max_packet_size);
+            if (!conn)
+                LSQ_WARN("shard %u: cannot create connection", shard->es_idx);
+        }
+        destroy_cmd(cmd);
+    }
+
+    return stop;
+}
+
+
+static void
+shard_pin_cpu (struct engine_shard *shard)
+{
+#if __linux__
+    cpu_set_t cpu_set;
+    long n_cpus;
+    int s;
+
+    n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus <= 0)
+        return;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(shard->es_idx % (unsigned) n_cpus, &cpu_set);
+    s = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (0 == s)
+        LSQ_DEBUG("shard %u: pinned to CPU %u", shard->es_idx,
+                                        shard->es_idx % (unsigned) n_cpus);
+    else
+        LSQ_WARN("shard %u: cannot set CPU affinity: %s", shard->es_idx,
+                                                                strerror(s));
+#else
+    LSQ_INFO("shard %u: CPU affinity is not supported on this platform",
+                                                            shard->es_idx);
+#endif
+}
+
+
+static void *
+shard_thread (void *arg)
+{
+    struct engine_shard *const shard = arg;
+    lsquic_engine_t *const engine = shard->es_engine;
+    struct pollfd fds[2];
+    int diff, timeout, s;
+
+    if (shard->es_group->eg_flags & LSQUIC_EGF_PIN_CPUS)
+        shard_pin_cpu(shard);
+
+    fds[0].fd = shard->es_fd;
+    fds[1].fd = shard->es_wakeup[0];
+    fds[1].events = POLLIN;
+
+    while (!shard_run_commands(shard))
+    {
+        /* While the socket is blocked, there is no point in processing
+         * connections: wait for it to become writeable.
+         */
+        if (lsquic_udp_io_blocked(shard->es_io))
+        {
+            fds[0].events = POLLIN|POLLOUT;
+            timeout = -1;
+        }
+        else
+        {
+            fds[0].events = POLLIN;
+            if (lsquic_engine_earliest_adv_tick(engine, &diff) && diff <= 0)
+                lsquic_engine_process_conns(engine);
+            if (lsquic_engine_earliest_adv_tick(engine, &diff))
+                timeout = diff > 0 ? (diff + 999) / 1000 : 0;
+            else
+                timeout = -1;
+        }
+
+        s = poll(fds, 2, timeout);
+        if (s < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            LSQ_ERROR("shard %u: poll failed: %s", shard->es_idx,
+                                                            strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+            shard_drain_wakeup(shard);
+        if (fds[0].revents & POLLOUT)
+            lsquic_udp_io_write_ready(shard->es_io, engine);
+        if (fds[0].revents & POLLIN)
+        {
+            s = lsquic_udp_io_read(shard->es_io, engine);
+            if (s > 0)
+            {
+                pthread_mutex_lock(&shard->es_lock);
+                shard->es_n_packets_in += (unsigned) s;
+                pthread_mutex_unlock(&shard->es_lock);
+            }
+        }
+    }
+
+    LSQ_DEBUG("shard %u: thread exits", shard->es_idx);
+    return NULL;
+}
+
+
+static int
+set_nonblocking (int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (-1 == flags)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+static int
+open_shard_socket (int family)
+{
+    union {
+        struct sockaddr     sa;
+        struct sockaddr_in  sin;
+        struct sockaddr_in6 sin6;
+    } u;
+    socklen_t socklen;
+    int fd, saved_errno;
+
+    memset(&u, 0, sizeof(u));
+    if (AF_INET == family)
+    {
+        u.sin.sin_family = AF_INET;
+        socklen = sizeof(u.sin);
+    }
+    else
+    {
+        u.sin6.sin6_family = AF_INET6;
+        socklen = sizeof(u.sin6);
+    }
+
+    fd = socket(family, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (0 != bind(fd, &u.sa, socklen) || 0 != set_nonblocking(fd))
+    {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static int
+init_shard (struct lsquic_engine_group *group, struct engine_shard *shard,
+            unsigned idx, unsigned engine_flags,
+            const struct lsquic_engine_api *user_api, int family)
+{
+    struct lsquic_engine_api api;
+
+    shard->es_group = group;
+    shard->es_idx = idx;
+    shard->es_fd = -1;
+    shard->es_wakeup[0] = shard->es_wakeup[1] = -1;
+    TAILQ_INIT(&shard->es_cmds);
+    if (0 != pthread_mutex_init(&shard->es_lock, NULL))
+        return -1;
+    shard->es_lock_inited = 1;
+
+    shard->es_fd = open_shard_socket(family);
+    if (shard->es_fd < 0)
+    {
+        LSQ_WARN("shard %u: cannot open socket: %s", idx, strerror(errno));
+        return -1;
+    }
+
+    if (0 != pipe(shard->es_wakeup)
+            || 0 != set_nonblocking(shard->es_wakeup[0])
+            || 0 != set_nonblocking(shard->es_wakeup[1]))
+    {
+        LSQ_WARN("shard %u: cannot create pipe: %s", idx, strerror(errno));
+        return -1;
+    }
+
+    shard->es_io = lsquic_udp_io_new(shard->es_fd, 0, shard);
+    if (!shard->es_io)
+        return -1;
+
+    api = *user_api;
+    api.ea_stream_if       = &group->eg_stream_if;
+    api.ea_stream_if_ctx   = shard;
+    api.ea_packets_out     = shard_packets_out;
+    api.ea_packets_out_ctx = shard;
+    shard->es_engine = lsquic_engine_new(engine_flags, &api);
+    if (!shard->es_engine)
+        return -1;
+
+    return 0;
+}
+
+
+static void
+cleanup_shard (struct engine_shard *shard)
+{
+    struct group_cmd *cmd;
+
+    while ((cmd = TAILQ_FIRST(&shard->es_cmds)))
+    {
+        TAILQ_REMOVE(&shard->es_cmds, cmd, gc_next);
+        destroy_cmd(cmd);
+    }
+    if (shard->es_engine)
+        lsquic_engine_destroy(shard->es_engine);
+    if (shard->es_io)
+        lsquic_udp_io_destroy(shard->es_io);
+    if (shard->es_fd >= 0)
+        close(shard->es_fd);
+    if (shard->es_wakeup[0] >= 0)
+        close(shard->es_wakeup[0]);
+    if (shard->es_wakeup[1] >= 0)
+        close(shard->es_wakeup[1]);
+    if (shard->es_lock_inited)
+        pthread_mutex_destroy(&shard->es_lock);
+}
+
+
+struct lsquic_engine_group *
+lsquic_engine_group_new (unsigned engine_flags,
+                         const struct lsquic_engine_api *api, int family,
+                         unsigned n_engines,
+                         enum lsquic_engine_group_flags group_flags)
+{
+    struct lsquic_engine_group *group;
+    struct engine_shard *shard;
+    unsigned n_inited;
+    int s;
+
+    if (engine_flags & LSENG_SERVER)
+    {
+        LSQ_ERROR("engine group only supports client mode");
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!(AF_INET == family || AF_INET6 == family) || 0 == n_engines)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    group = calloc(1, sizeof(*group));
+    if (!group)
+        return NULL;
+
+    group->eg_shards = calloc(n_engines, sizeof(group->eg_shards[0]));
+    if (!group->eg_shards)
+    {
+        free(group);
+        return NULL;
+    }
+
+    group->eg_user_stream_if     = api->ea_stream_if;
+    group->eg_user_stream_if_ctx = api->ea_stream_if_ctx;
+    group->eg_stream_if          = *api->ea_stream_if;
+    group->eg_stream_if.on_new_conn    = group_on_new_conn;
+    group->eg_stream_if.on_conn_closed = group_on_conn_closed;
+    group->eg_stream_if.on_new_stream  = group_on_new_stream;
+    group->eg_flags = group_flags;
+
+    for (n_inited = 0; n_inited < n_engines; ++n_inited)
+    {
+        shard = &group->eg_shards[n_inited];
+        if (0 != init_shard(group, shard, n_inited, engine_flags, api,
+                                                                    family))
+        {
+            cleanup_shard(shard);
+            goto err;
+        }
+        group->eg_n_shards = n_inited + 1;
+    }
+
+    for (group->eg_n_started = 0; group->eg_n_started < n_engines;
+                                                    ++group->eg_n_started)
+    {
+        shard = &group->eg_shards[group->eg_n_started];
+        s = pthread_create(&shard->es_thread, NULL, shard_thread, shard);
+        if (0 != s)
+        {
+            LSQ_ERROR("cannot create thread: %s", strerror(s));
+            errno = s;
+            goto err;
+        }
+    }
+
+    LSQ_INFO("created engine group with %u engine%.*s", n_engines,
+                                                    n_engines != 1, "s");
+    return group;
+
+  err:
+    lsquic_engine_group_destroy(group);
+    return NULL;
+}
+
+
+int
+lsquic_engine_group_connect (struct lsquic_engine_group *group,
+                             const struct sockaddr *peer_sa,
+                             lsquic_conn_ctx_t *conn_ctx,
+                             const char *hostname,
+                             unsigned short max_packet_size)
+{
+    struct engine_shard *shard;
+    struct group_cmd *cmd;
+    unsigned idx;
+
+    cmd = calloc(1, sizeof(*cmd));
+    if (!cmd)
+        return -1;
+
+    memcpy(&cmd->gc_peer_sa, peer_sa, AF_INET == peer_sa->sa_family ?
+                sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+    cmd->gc_conn_ctx = conn_ctx;
+    cmd->gc_max_packet_size = max_packet_size;
+    if (hostname)
+    {
+        cmd->gc_hostname = strdup(hostname);
+        if (!cmd->gc_hostname)
+        {
+            free(cmd);
+            return -1;
+        }
+    }
+
+    idx = __sync_fetch_and_add(&group->eg_next_shard, 1) % group->eg_n_shards;
+    shard = &group->eg_shards[idx];
+
+    pthread_mutex_lock(&shard->es_lock);
+    TAILQ_INSERT_TAIL(&shard->es_cmds, cmd, gc_next);
+    ++shard->es_n_pending;
+    pthread_mutex_unlock(&shard->es_lock);
+    shard_wakeup(shard);
+
+    LSQ_DEBUG("connection to %s handed off to shard %u",
+                                    hostname ? hostname : "(null)", idx);
+    return (int) idx;
+}
+
+
+void
+lsquic_engine_group_get_stats (struct lsquic_engine_group *group,
+                               struct lsquic_engine_group_stats *stats)
+{
+    struct engine_shard *shard;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->n_engines = group->eg_n_shards;
+    for (shard = group->eg_shards; shard < group->eg_shards
+                                            + group->eg_n_shards; ++shard)
+    {
+        pthread_mutex_lock(&shard->es_lock);
+        stats->n_conns         += shard->es_n_conns;
+        stats->n_pending       += shard->es_n_pending;
+        stats->n_conns_created += shard->es_n_conns_created;
+        stats->n_packets_in    += shard->es_n_packets_in;
+        stats->n_packets_out   += shard->es_n_packets_out;
+        pthread_mutex_unlock(&shard->es_lock);
+    }
+}
+
+
+void
+lsquic_engine_group_destroy (struct lsquic_engine_group *group)
+{
+    struct engine_shard *shard;
+    unsigned n;
+
+    for (n = 0; n < group->eg_n_started; ++n)
+    {
+        shard = &group->eg_shards[n];
+        pthread_mutex_lock(&shard->es_lock);
+        shard->es_flags |= ES_STOP;
+        pthread_mutex_unlock(&shard->es_lock);
+        shard_wakeup(shard);
+    }
+
+    for (n = 0; n < group->eg_n_started; ++n)
+        (void) pthread_join(group->eg_shards[n].es_thread, NULL);
+
+    /* The engines are destroyed after all the threads have stopped, but
+     * that is OK: each engine is only ever used by one thread at a time.
+     */
+    for (n = 0; n < group->eg_n_shards; ++n)
+        cleanup_shard(&group->eg_shards[n]);
+
+    free(group->eg_shards);
+    free(group);
+}
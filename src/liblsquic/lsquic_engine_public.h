@@ -9,6 +9,7 @@
 
 struct lsquic_conn;
 struct lsquic_engine;
+struct kxs_pool;
 
 struct lsquic_engine_public {
     struct lsquic_mm                enp_mm;
@@ -17,6 +18,16 @@ struct lsquic_engine_public {
                                    *enp_pmi;
     void                           *enp_pmi_ctx;
     struct lsquic_engine           *enp_engine;
+    struct kxs_pool                *enp_kxs_pool;   /* es_kxs_pool_size */
+    lsquic_verify_cert_f            enp_verify_cert;
+    void                           *enp_verify_cert_ctx;
+    uint64_t                      (*enp_get_time)(void *);
+    void                           *enp_get_time_ctx;
+    /* Time read at the beginning of the current processing pass; zero
+     * outside of one.  Use lsquic_engine_now() instead of reading it
+     * directly.
+     */
+    lsquic_time_t                   enp_now;
     enum {
         ENPUB_PROC  = (1 << 0), /* Being processed by one of the user-facing
                                  * functions.
@@ -40,4 +51,37 @@ void
 lsquic_engine_add_conn_to_attq (struct lsquic_engine_public *enpub,
                                             lsquic_conn_t *, lsquic_time_t);
 
+/* Return current time.  Inside a processing pass, this is the time the
+ * pass started (or when the last batch of packets was sent); otherwise,
+ * the engine's time source is read.
+ */
+lsquic_time_t
+lsquic_engine_now (struct lsquic_engine_public *);
+
+/* Call user's certificate verification callback.  The connection is kept
+ * alive until the result is processed.
+ */
+void
+lsquic_engine_verify_cert (struct lsquic_engine_public *, lsquic_conn_t *,
+                        const struct lsquic_cert *chain, unsigned n_certs);
+
+/* Incoming packet buffers, QUIC_MAX_PACKET_SZ bytes each.  They are passed
+ * to lsquic_engine_packets_in_owned(), which takes ownership of them: this
+ * way, packets can be decrypted in place.  Buffers that are not passed to
+ * the engine are returned using lsquic_engine_put_packet_in_buf().
+ */
+unsigned char *
+lsquic_engine_get_packet_in_buf (struct lsquic_engine *);
+
+void
+lsquic_engine_put_packet_in_buf (struct lsquic_engine *, unsigned char *);
+
+/* Same as lsquic_engine_packets_in(), except `buf' of each spec holds
+ * a single packet and belongs to the engine.  Specs that are empty or have
+ * `segsz' set are dropped and their buffers are returned.
+ */
+int
+lsquic_engine_packets_in_owned (struct lsquic_engine *,
+                        const struct lsquic_in_spec *, unsigned n_specs);
+
 #endif
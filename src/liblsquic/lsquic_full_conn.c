@@ -48,6 +48,7 @@
 #include "lsquic_ev_log.h"
 #include "lsquic_version.h"
 #include "lsquic_hash.h"
+#include "lsquic_path_hints.h"
 
 #include "lsquic_conn.h"
 #include "lsquic_conn_public.h"
@@ -397,6 +398,33 @@ init_ver_neg (struct full_conn *conn, unsigned versions)
 }
 
 
+/* Start with the version negotiated by an earlier connection to the same
+ * destination.  Other versions remain available in case the server no
+ * longer supports it.
+ */
+static void
+start_with_version (struct full_conn *conn, enum lsquic_version version)
+{
+    assert(conn->fc_ver_neg.vn_supp & (1 << version));
+    conn->fc_ver_neg.vn_ver  = version;
+    conn->fc_ver_neg.vn_buf  = lsquic_ver2tag(version);
+    conn->fc_conn.cn_version = version;
+    LSQ_DEBUG("start with version %s from path hint",
+                                                lsquic_ver2str[version]);
+}
+
+
+static void
+apply_path_hint (struct full_conn *conn, const struct path_hint *hint)
+{
+    LSQ_DEBUG("path hint: srtt: %"PRIu64"; rttvar: %"PRIu64"; cwnd: %lu",
+                            hint->ph_srtt, hint->ph_rttvar, hint->ph_cwnd);
+    conn->fc_pub.rtt_stats.srtt   = hint->ph_srtt;
+    conn->fc_pub.rtt_stats.rttvar = hint->ph_rttvar;
+    lsquic_send_ctl_seed_cwnd(&conn->fc_send_ctl, hint->ph_cwnd);
+}
+
+
 /* If peer supplies odd values, we abort the connection immediately rather
  * that wait for it to finish "naturally" due to inability to send things.
  */
@@ -640,14 +668,18 @@ struct lsquic_conn *
 full_conn_client_new (struct lsquic_engine_public *enpub,
                       const struct lsquic_stream_if *stream_if,
                       void *stream_if_ctx, unsigned flags,
-                      const char *hostname, unsigned short max_packet_size)
+                      const char *hostname, unsigned short max_packet_size,
+                      const struct path_hint *hint)
 {
     struct full_conn *conn;
     enum lsquic_version version;
     lsquic_cid_t cid;
     const struct enc_session_funcs *esf;
 
-    version = highest_bit_set(enpub->enp_settings.es_versions);
+    if (hint && (enpub->enp_settings.es_versions & (1 << hint->ph_version)))
+        version = hint->ph_version;
+    else
+        version = highest_bit_set(enpub->enp_settings.es_versions);
     esf = select_esf_by_ver(version);
     cid = esf->esf_generate_cid();
     conn = new_conn_common(cid, enpub, stream_if, stream_if_ctx, flags,
@@ -669,16 +701,21 @@ full_conn_client_new (struct lsquic_engine_public *enpub,
     else
         conn->fc_last_stream_id = LSQUIC_STREAM_HANDSHAKE;
     conn->fc_hsk_ctx.client.lconn   = &conn->fc_conn;
+    conn->fc_hsk_ctx.client.enpub   = enpub;
     conn->fc_hsk_ctx.client.mm      = &enpub->enp_mm;
     conn->fc_hsk_ctx.client.ver_neg = &conn->fc_ver_neg;
     conn->fc_stream_ifs[STREAM_IF_HSK]
                 .stream_if     = &lsquic_client_hsk_stream_if;
     conn->fc_stream_ifs[STREAM_IF_HSK].stream_if_ctx = &conn->fc_hsk_ctx.client;
     init_ver_neg(conn, conn->fc_settings->es_versions);
+    if (version != conn->fc_ver_neg.vn_ver)
+        start_with_version(conn, version);
+    if (hint)
+        apply_path_hint(conn, hint);
     conn->fc_conn.cn_pf = select_pf_by_ver(conn->fc_ver_neg.vn_ver);
     if (conn->fc_settings->es_handshake_to)
         lsquic_alarmset_set(&conn->fc_alset, AL_HANDSHAKE,
-                    lsquic_time_now() + conn->fc_settings->es_handshake_to);
+                    lsquic_engine_now(enpub) + conn->fc_settings->es_handshake_to);
     if (!new_stream(conn, LSQUIC_STREAM_HANDSHAKE, SCF_CALL_ON_NEW))
     {
         LSQ_WARN("could not create handshake stream: %s", strerror(errno));
@@ -1879,13 +1916,29 @@ process_regular_packet (struct full_conn *conn, lsquic_packet_in_t *packet_in)
     enum quic_ft_bit frame_types;
     int was_missing;
 
-    reconstruct_packet_number(conn, packet_in);
+    /* If the engine decrypted the packet, its number was reconstructed
+     * then and verified by decryption.
+     */
+    if (0 == (packet_in->pi_flags & PI_DECRYPTED))
+        reconstruct_packet_number(conn, packet_in);
     EV_LOG_PACKET_IN(LSQUIC_LOG_CONN_ID, packet_in);
 
 #if FULL_CONN_STATS
     ++conn->fc_stats.n_all_packets_in;
 #endif
 
+    /* Packets that are known to be duplicates are dropped before spending
+     * time on decrypting them.
+     */
+    if (!lsquic_rechist_would_accept(&conn->fc_rechist, packet_in->pi_packno))
+    {
+#if FULL_CONN_STATS
+        ++conn->fc_stats.n_dup_packets;
+#endif
+        LSQ_INFO("packet %"PRIu64" is a duplicate", packet_in->pi_packno);
+        return 0;
+    }
+
     /* The packet is decrypted before receive history is updated.  This is
      * done to make sure that a bad packet won't occupy a slot in receive
      * history and subsequent good packet won't be marked as a duplicate.
@@ -2462,6 +2515,19 @@ process_streams_write_events (struct full_conn *conn, int high_prio)
 }
 
 
+/* Client can send requests before the handshake is complete if it has
+ * initial keys, which it derives from cached server config.
+ */
+static int
+zero_rtt_ok (const struct full_conn *conn)
+{
+    return !(conn->fc_flags & FC_SERVER)
+        && conn->fc_conn.cn_enc_session
+        && conn->fc_conn.cn_esf->esf_is_zero_rtt_enabled(
+                                            conn->fc_conn.cn_enc_session);
+}
+
+
 static void
 process_hsk_stream_read_events (struct full_conn *conn)
 {
@@ -2543,7 +2609,7 @@ generate_ack_frame (struct full_conn *conn)
     }
 
     lsquic_send_ctl_scheduled_one(&conn->fc_send_ctl, packet_out);
-    now = lsquic_time_now();
+    now = lsquic_engine_now(conn->fc_enpub);
     w = conn->fc_conn.cn_pf->pf_gen_ack_frame(
             packet_out->po_data + packet_out->po_data_sz,
             lsquic_packet_out_avail(packet_out),
@@ -2744,11 +2810,11 @@ full_conn_ci_tick (lsquic_conn_t *lconn, lsquic_time_t now)
     lsquic_alarmset_ring_expired(&conn->fc_alset, now);
     CLOSE_IF_NECESSARY();
 
-    /* To make things simple, only stream 1 is active until the handshake
-     * has been completed.  This will be adjusted in the future: the client
-     * does not want to wait if it has the server information.
+    /* Only stream 1 is active until the handshake has been completed,
+     * unless the client has the server information and can send 0-RTT
+     * data.
      */
-    if (conn->fc_conn.cn_flags & LSCONN_HANDSHAKE_DONE)
+    if ((conn->fc_conn.cn_flags & LSCONN_HANDSHAKE_DONE) || zero_rtt_ok(conn))
         process_streams_read_events(conn);
     else
         process_hsk_stream_read_events(conn);
@@ -2870,8 +2936,10 @@ full_conn_ci_tick (lsquic_conn_t *lconn, lsquic_time_t now)
     lsquic_send_ctl_set_buffer_stream_packets(&conn->fc_send_ctl, 0);
     if (!(conn->fc_conn.cn_flags & LSCONN_HANDSHAKE_DONE))
     {
+        /* CHLO goes first: generating it is what derives 0-RTT keys */
         process_hsk_stream_write_events(conn);
-        goto end_write;
+        if (!zero_rtt_ok(conn))
+            goto end_write;
     }
 
     maybe_conn_flush_headers_stream(conn);
@@ -2944,7 +3012,7 @@ full_conn_ci_tick (lsquic_conn_t *lconn, lsquic_time_t now)
         conn->fc_flags &= ~FC_SEND_PING;   /* It may have rung */
     }
 
-    now = lsquic_time_now();
+    now = lsquic_engine_now(conn->fc_enpub);
     lsquic_alarmset_set(&conn->fc_alset, AL_IDLE,
                                 now + conn->fc_settings->es_idle_conn_to);
 
@@ -3038,6 +3106,87 @@ full_conn_ci_handshake_ok (lsquic_conn_t *lconn)
 }
 
 
+/* Only regular packets that are not known duplicates are decrypted ahead
+ * of time.  The packet number is reconstructed using the receive history
+ * as it is now; if it comes out wrong, decryption fails and the packet is
+ * decrypted again in process_regular_packet().
+ */
+static int
+full_conn_ci_packno_to_decrypt (lsquic_conn_t *lconn,
+                const lsquic_packet_in_t *packet_in, lsquic_packno_t *packno)
+{
+    struct full_conn *conn = (struct full_conn *) lconn;
+    lsquic_packno_t max_packno;
+
+    if ((conn->fc_flags & FC_ERROR)
+            || (lsquic_packet_in_public_flags(packet_in)
+                    & (PACKET_PUBLIC_FLAGS_RST|PACKET_PUBLIC_FLAGS_VERSION)))
+        return -1;
+
+    max_packno = lsquic_rechist_largest_packno(&conn->fc_rechist);
+    *packno = restore_packno(packet_in->pi_packno,
+                    lsquic_packet_in_packno_bits(packet_in), max_packno);
+    if (!lsquic_rechist_would_accept(&conn->fc_rechist, *packno))
+        return -1;
+
+    return 0;
+}
+
+
+/* Only connections that completed the handshake and did not fail provide
+ * path hints.
+ */
+static int
+full_conn_ci_get_path_hint (lsquic_conn_t *lconn, struct path_hint *hint)
+{
+    struct full_conn *conn = (struct full_conn *) lconn;
+    lsquic_time_t srtt;
+
+    if ((conn->fc_flags & (FC_SERVER|FC_IMMEDIATE_CLOSE_FLAGS|FC_GOT_PRST))
+                        || !(lconn->cn_flags & LSCONN_HANDSHAKE_DONE))
+        return -1;
+
+    srtt = lsquic_rtt_stats_get_srtt(&conn->fc_pub.rtt_stats);
+    if (0 == srtt)
+        return -1;
+
+    hint->ph_srtt      = srtt;
+    hint->ph_rttvar    = lsquic_rtt_stats_get_rttvar(&conn->fc_pub.rtt_stats);
+    hint->ph_cwnd      = lsquic_send_ctl_get_cwnd(&conn->fc_send_ctl);
+    hint->ph_version   = lconn->cn_version;
+    hint->ph_pack_size = lconn->cn_pack_size;
+    return 0;
+}
+
+
+static void
+full_conn_ci_handshake_rejected (lsquic_conn_t *lconn)
+{
+    struct full_conn *conn = (struct full_conn *) lconn;
+    LSQ_DEBUG("handshake rejected, resend 0-RTT packets, if any");
+    lsquic_send_ctl_expire_zero_rtt(&conn->fc_send_ctl);
+}
+
+
+static void
+full_conn_ci_cert_verified (lsquic_conn_t *lconn, int ok)
+{
+    struct full_conn *conn = (struct full_conn *) lconn;
+    lsquic_stream_t *stream;
+
+    stream = find_stream_by_id(conn, LSQUIC_STREAM_HANDSHAKE);
+    if ((conn->fc_flags & (FC_CLOSING|FC_IMMEDIATE_CLOSE_FLAGS)) || !stream)
+    {
+        LSQ_DEBUG("certificate chain %s, but connection is closing: ignore",
+                                            ok ? "verified" : "rejected");
+        return;
+    }
+
+    LSQ_DEBUG("certificate chain %s", ok ? "verified" : "rejected");
+    lsquic_client_hsk_cert_verified(&conn->fc_hsk_ctx.client, stream, ok);
+}
+
+
 static void
 full_conn_ci_handshake_failed (lsquic_conn_t *lconn)
 {
@@ -3454,13 +3603,17 @@ static const struct headers_stream_callbacks headers_callbacks =
 static const struct headers_stream_callbacks *headers_callbacks_ptr = &headers_callbacks;
 
 static const struct conn_iface full_conn_iface = {
+    .ci_cert_verified        =  full_conn_ci_cert_verified,
     .ci_destroy              =  full_conn_ci_destroy,
+    .ci_get_path_hint        =  full_conn_ci_get_path_hint,
     .ci_handshake_failed     =  full_conn_ci_handshake_failed,
     .ci_handshake_ok         =  full_conn_ci_handshake_ok,
+    .ci_handshake_rejected   =  full_conn_ci_handshake_rejected,
     .ci_is_tickable          =  full_conn_ci_is_tickable,
     .ci_next_packet_to_send  =  full_conn_ci_next_packet_to_send,
     .ci_next_tick_time       =  full_conn_ci_next_tick_time,
     .ci_packet_in            =  full_conn_ci_packet_in,
+    .ci_packno_to_decrypt    =  full_conn_ci_packno_to_decrypt,
     .ci_packet_not_sent      =  full_conn_ci_packet_not_sent,
     .ci_packet_sent          =  full_conn_ci_packet_sent,
     .ci_tick                 =  full_conn_ci_tick,
@@ -5,13 +5,16 @@
 struct lsquic_conn;
 struct lsquic_stream_if;
 struct lsquic_engine_public;
+struct path_hint;
 
+/* `hint' may be NULL */
 struct lsquic_conn *
 full_conn_client_new (struct lsquic_engine_public *,
                const struct lsquic_stream_if *,
                void *stream_if_ctx,
                unsigned flags /* Only FC_SERVER and FC_HTTP */,
-               const char *hostname, unsigned short max_packet_size);
+               const char *hostname, unsigned short max_packet_size,
+               const struct path_hint *hint);
 
 void
 full_conn_client_call_on_new (struct lsquic_conn *);
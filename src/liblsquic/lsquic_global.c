@@ -24,3 +24,14 @@ lsquic_global_cleanup (void)
 {
     lsquic_enc_session_gquic_1.esf_global_cleanup();
 }
+
+
+#ifndef WIN32
+int
+lsquic_global_set_session_cache_file (const char *path, unsigned n_entries)
+{
+    if (n_entries == 0)
+        n_entries = LSQUIC_DF_SESSION_CACHE_ENTRIES;
+    return lsquic_enc_session_gquic_1.esf_set_cache_file(path, n_entries);
+}
+#endif
@@ -6,7 +6,10 @@
 #include <string.h>
 #include <sys/queue.h>
 #ifndef WIN32
+#include <pthread.h>
 #include <sys/socket.h>
+#else
+#include <vc_compat.h>
 #endif
 
 #include <openssl/ssl.h>
@@ -14,6 +17,7 @@
 #include <openssl/stack.h>
 #include <openssl/x509.h>
 #include <openssl/rand.h>
+#include <openssl/sha.h>
 #include <openssl/nid.h>
 #include <zlib.h>
 
@@ -29,8 +33,13 @@
 #include "lsquic_mm.h"
 #include "lsquic_engine_public.h"
 #include "lsquic_hash.h"
+#include "lsquic_xxhash.h"
 #include "lsquic_buf.h"
 #include "lsquic_qtags.h"
+#ifndef WIN32
+#include "lsquic_scache.h"
+#include "lsquic_kxs_pool.h"
+#endif
 
 #include "fiu-local.h"
 
@@ -116,6 +125,10 @@ struct lsquic_enc_session
     uint8_t have_key; /* 0, no 1, I, 2, D, 3, F */
     uint8_t peer_have_final_key;
     uint8_t server_start_use_final_key; 
+    /* Smallest number of packet decrypted using final key.  Only valid if
+     * peer_have_final_key is set.
+     */
+    uint64_t peer_final_key_packno;
 
     lsquic_cid_t cid;
     unsigned char priv_key[32];
@@ -123,8 +136,8 @@ struct lsquic_enc_session
     EVP_AEAD_CTX *dec_ctx_i;
     
     /* Have to save the initial key for diversification need */
-    unsigned char enc_key_i[aes128_key_len];
-    unsigned char dec_key_i[aes128_key_len];
+    unsigned char enc_key_i[max_key_len];
+    unsigned char dec_key_i[max_key_len];
     unsigned char enc_key_nonce_i[aes128_iv_len];
     unsigned char dec_key_nonce_i[aes128_iv_len];
 
@@ -137,6 +150,9 @@ struct lsquic_enc_session
     lsquic_session_cache_info_t *info;
     SSL_CTX *  ssl_ctx;
     const struct lsquic_engine_public *enpub;
+    cert_hash_item_t  * cert_item; /* reference to cached server certs */
+    /* Set while the user verifies the certificate chain in `cert_item' */
+    struct lsquic_cert *cert_chain;
     struct lsquic_str * cert_ptr; /* pointer to the leaf cert of the server, not real copy */
     struct lsquic_str   chlo; /* real copy of CHLO message */
     struct lsquic_str   sstk;
@@ -149,20 +165,104 @@ struct lsquic_enc_session
 };
 
 
+/* The caches below are shared by all engines in the process, which may run
+ * in different threads.  Each cache is split into stripes, each with its own
+ * lock, hash, and LRU list.  The number of elements in a stripe is bounded:
+ * when it fills up, the least recently used element is evicted.
+ *
+ * Cached objects are never handed out: session info is copied out of (and
+ * into) the cache, while cert items are reference-counted.  The reference
+ * count of a cert item is protected by the lock of the stripe it lives in.
+ */
+#define HS_CACHE_N_STRIPES      16
+#define HS_CACHE_MAX_SESSIONS   4096
+#define HS_CACHE_MAX_CERTS      1024
+#define HS_CACHE_MAX_PUBKEYS    1024
+/* How often expired session info entries are removed, in seconds */
+#define HS_CACHE_SWEEP_INTERVAL 60
+
+#ifndef WIN32
+typedef pthread_mutex_t hs_lock_t;
+#define hs_lock_init(lock) pthread_mutex_init(lock, NULL)
+#define hs_lock_destroy(lock) pthread_mutex_destroy(lock)
+#define hs_lock(lock) pthread_mutex_lock(lock)
+#define hs_unlock(lock) pthread_mutex_unlock(lock)
+#else
+typedef SRWLOCK hs_lock_t;
+#define hs_lock_init(lock) InitializeSRWLock(lock)
+#define hs_lock_destroy(lock) do { } while (0)
+#define hs_lock(lock) AcquireSRWLockExclusive(lock)
+#define hs_unlock(lock) ReleaseSRWLockExclusive(lock)
+#endif
+
+struct hs_cache_elem
+{
+    TAILQ_ENTRY(hs_cache_elem)  hce_next_lru;
+    struct lsquic_hash_elem    *hce_hash_el;
+    void                       *hce_data;
+    unsigned                    hce_key_sz;
+    char                        hce_key[0];
+};
+
+TAILQ_HEAD(hs_cache_lru, hs_cache_elem);
+
+struct hs_cache_stripe
+{
+    hs_lock_t                   hcs_lock;
+    struct lsquic_hash         *hcs_hash;
+    struct hs_cache_lru         hcs_lru;    /* Most recently used first */
+    unsigned                    hcs_count;
+};
+
+struct hs_cache
+{
+    /* Called with stripe lock held when the cache drops an element */
+    void                      (*hc_drop_data)(void *);
+    unsigned                    hc_max_per_stripe;
+    struct hs_cache_stripe      hc_stripes[HS_CACHE_N_STRIPES];
+};
+
+
 /***
  * client side, it will store the domain/certs as cache cert
  */
-static struct lsquic_hash *s_cached_client_certs;
+static struct hs_cache *s_cached_client_certs;
 
 /**
  * client side will save the session_info for next time 0rtt
  */
-static struct lsquic_hash *s_cached_client_session_infos;
+static struct hs_cache *s_cached_client_session_infos;
+
+/**
+ * client side, public keys of server leaf certificates keyed by the
+ * certificate's SHA-256 hash, so that the certificate is parsed only once.
+ */
+static struct hs_cache *s_cached_server_pubkeys;
+
+struct cached_pubkey
+{
+    EVP_PKEY   *cpk_pkey;   /* NULL if the certificate is invalid */
+};
+
+static hs_lock_t s_sweep_lock;
+static time_t s_next_sweep;
+
+#ifndef WIN32
+/**
+ * client side, optional persistent copy of the session info and certs,
+ * which survives process restarts and can be shared between processes.
+ */
+static struct scache *s_persistent_cache;
+/* Taken for reading while the persistent cache is used and for writing
+ * while it is replaced.
+ */
+static pthread_rwlock_t s_persistent_lock = PTHREAD_RWLOCK_INITIALIZER;
+#endif
 
 /* save to hash table */
-static lsquic_session_cache_info_t *retrieve_session_info_entry(const char *key);
-static void remove_expire_session_info_entry();
-static void remove_session_info_entry(struct lsquic_str *key);
+static int retrieve_session_info_entry(const char *key,
+                                        lsquic_session_cache_info_t *info);
+static void remove_expire_session_info_entry (void);
 
 static void free_info (lsquic_session_cache_info_t *);
 
@@ -170,11 +270,14 @@ static void free_info (lsquic_session_cache_info_t *);
 /* client */
 static cert_hash_item_t *make_cert_hash_item(struct lsquic_str *domain, struct lsquic_str **certs, int count);
 static int c_insert_certs(cert_hash_item_t *item);
+static void c_release_certs (cert_hash_item_t *item);
 static void c_free_cert_hash_item (cert_hash_item_t *item);
 
 static int get_tag_val_u32 (unsigned char *v, int len, uint32_t *val);
 static int init_hs_hash_tables(int flags);
 static uint32_t get_tag_value_i32(unsigned char *, int);
+static uint32_t select_aead(const lsquic_enc_session_t *,
+                                                const unsigned char *, int);
 static uint64_t get_tag_value_i64(unsigned char *, int);
 
 static int determine_keys(lsquic_enc_session_t *enc_session);
@@ -199,39 +302,222 @@ static int
 lsquic_handshake_init(int flags)
 {
     crypto_init();
+    if (0 != lsquic_crt_init())
+        return -1;
     return init_hs_hash_tables(flags);
 }
 
 
+static struct hs_cache *
+hs_cache_new (unsigned max_elems, void (*drop_data)(void *))
+{
+    struct hs_cache *cache;
+    unsigned n;
+
+    cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        return NULL;
+
+    cache->hc_drop_data = drop_data;
+    cache->hc_max_per_stripe = (max_elems + HS_CACHE_N_STRIPES - 1)
+                                                        / HS_CACHE_N_STRIPES;
+    for (n = 0; n < HS_CACHE_N_STRIPES; ++n)
+    {
+        cache->hc_stripes[n].hcs_hash = lsquic_hash_create();
+        if (!cache->hc_stripes[n].hcs_hash)
+            goto err;
+        hs_lock_init(&cache->hc_stripes[n].hcs_lock);
+        TAILQ_INIT(&cache->hc_stripes[n].hcs_lru);
+    }
+
+    return cache;
+
+  err:
+    while (n-- > 0)
+    {
+        hs_lock_destroy(&cache->hc_stripes[n].hcs_lock);
+        lsquic_hash_destroy(cache->hc_stripes[n].hcs_hash);
+    }
+    free(cache);
+    return NULL;
+}
+
+
 static void
-cleanup_hs_hash_tables (void)
+hs_cache_destroy (struct hs_cache *cache)
 {
-    struct lsquic_hash_elem *el;
+    struct hs_cache_stripe *stripe;
+    struct hs_cache_elem *el;
 
-    if (s_cached_client_session_infos)
+    for (stripe = cache->hc_stripes;
+                stripe < cache->hc_stripes + HS_CACHE_N_STRIPES; ++stripe)
     {
-        for (el = lsquic_hash_first(s_cached_client_session_infos); el;
-                        el = lsquic_hash_next(s_cached_client_session_infos))
+        while ((el = TAILQ_FIRST(&stripe->hcs_lru)))
         {
-            lsquic_session_cache_info_t *entry = lsquic_hashelem_getdata(el);
-            free_info(entry);
+            TAILQ_REMOVE(&stripe->hcs_lru, el, hce_next_lru);
+            cache->hc_drop_data(el->hce_data);
+            free(el);
         }
-        lsquic_hash_destroy(s_cached_client_session_infos);
-        s_cached_client_session_infos = NULL;
+        lsquic_hash_destroy(stripe->hcs_hash);
+        hs_lock_destroy(&stripe->hcs_lock);
     }
+    free(cache);
+}
 
-    if (s_cached_client_certs)
+
+static struct hs_cache_stripe *
+hs_cache_get_stripe (struct hs_cache *cache, const void *key,
+                                                            unsigned key_sz)
+{
+    uint64_t hash;
+
+    hash = XXH64(key, key_sz, (uintptr_t) cache);
+    return &cache->hc_stripes[ hash % HS_CACHE_N_STRIPES ];
+}
+
+
+/* Stripe must be locked */
+static void
+hs_cache_remove_elem (struct hs_cache *cache, struct hs_cache_stripe *stripe,
+                                                    struct hs_cache_elem *el)
+{
+    lsquic_hash_erase(stripe->hcs_hash, el->hce_hash_el);
+    TAILQ_REMOVE(&stripe->hcs_lru, el, hce_next_lru);
+    --stripe->hcs_count;
+    cache->hc_drop_data(el->hce_data);
+    free(el);
+}
+
+
+/* If the element is found, `get_data' is called with the stripe lock held
+ * and 0 is returned.  Otherwise, -1 is returned.
+ */
+static int
+hs_cache_get (struct hs_cache *cache, const void *key, unsigned key_sz,
+                        void (*get_data)(void *data, void *ctx), void *ctx)
+{
+    struct hs_cache_stripe *stripe;
+    struct lsquic_hash_elem *hash_el;
+    struct hs_cache_elem *el;
+
+    stripe = hs_cache_get_stripe(cache, key, key_sz);
+    hs_lock(&stripe->hcs_lock);
+    hash_el = lsquic_hash_find(stripe->hcs_hash, key, key_sz);
+    if (hash_el)
     {
-        for (el = lsquic_hash_first(s_cached_client_certs); el;
-                                el = lsquic_hash_next(s_cached_client_certs))
+        el = lsquic_hashelem_getdata(hash_el);
+        if (el != TAILQ_FIRST(&stripe->hcs_lru))
         {
-            cert_hash_item_t *item = lsquic_hashelem_getdata(el);
-            c_free_cert_hash_item(item);
+            TAILQ_REMOVE(&stripe->hcs_lru, el, hce_next_lru);
+            TAILQ_INSERT_HEAD(&stripe->hcs_lru, el, hce_next_lru);
         }
-        lsquic_hash_destroy(s_cached_client_certs);
+        get_data(el->hce_data, ctx);
+    }
+    hs_unlock(&stripe->hcs_lock);
+
+    return hash_el ? 0 : -1;
+}
+
+
+/* Insert data into the cache, replacing existing element with the same key
+ * if necessary.  On success, the cache takes ownership of `data'.
+ */
+static int
+hs_cache_put (struct hs_cache *cache, const void *key, unsigned key_sz,
+                                                                void *data)
+{
+    struct hs_cache_stripe *stripe;
+    struct lsquic_hash_elem *hash_el;
+    struct hs_cache_elem *el;
+
+    el = malloc(sizeof(*el) + key_sz);
+    if (!el)
+        return -1;
+    el->hce_data = data;
+    el->hce_key_sz = key_sz;
+    memcpy(el->hce_key, key, key_sz);
+
+    stripe = hs_cache_get_stripe(cache, key, key_sz);
+    hs_lock(&stripe->hcs_lock);
+
+    hash_el = lsquic_hash_find(stripe->hcs_hash, key, key_sz);
+    if (hash_el)
+        hs_cache_remove_elem(cache, stripe, lsquic_hashelem_getdata(hash_el));
+
+    el->hce_hash_el = lsquic_hash_insert(stripe->hcs_hash, el->hce_key,
+                                                        el->hce_key_sz, el);
+    if (!el->hce_hash_el)
+    {
+        hs_unlock(&stripe->hcs_lock);
+        free(el);
+        return -1;
+    }
+    TAILQ_INSERT_HEAD(&stripe->hcs_lru, el, hce_next_lru);
+    ++stripe->hcs_count;
+
+    while (stripe->hcs_count > cache->hc_max_per_stripe)
+        hs_cache_remove_elem(cache, stripe,
+                                TAILQ_LAST(&stripe->hcs_lru, hs_cache_lru));
+
+    hs_unlock(&stripe->hcs_lock);
+    return 0;
+}
+
+
+/* Remove all elements for which `is_stale' returns true */
+static void
+hs_cache_remove_if (struct hs_cache *cache,
+                        int (*is_stale)(const void *data, void *ctx), void *ctx)
+{
+    struct hs_cache_stripe *stripe;
+    struct hs_cache_elem *el, *next;
+
+    for (stripe = cache->hc_stripes;
+                stripe < cache->hc_stripes + HS_CACHE_N_STRIPES; ++stripe)
+    {
+        hs_lock(&stripe->hcs_lock);
+        for (el = TAILQ_FIRST(&stripe->hcs_lru); el; el = next)
+        {
+            next = TAILQ_NEXT(el, hce_next_lru);
+            if (is_stale(el->hce_data, ctx))
+                hs_cache_remove_elem(cache, stripe, el);
+        }
+        hs_unlock(&stripe->hcs_lock);
+    }
+}
+
+
+static void
+cleanup_hs_hash_tables (void)
+{
+#ifndef WIN32
+    pthread_rwlock_wrlock(&s_persistent_lock);
+    if (s_persistent_cache)
+    {
+        scache_close(s_persistent_cache);
+        s_persistent_cache = NULL;
+    }
+    pthread_rwlock_unlock(&s_persistent_lock);
+#endif
+
+    if (s_cached_client_session_infos)
+    {
+        hs_cache_destroy(s_cached_client_session_infos);
+        s_cached_client_session_infos = NULL;
+    }
+
+    if (s_cached_client_certs)
+    {
+        hs_cache_destroy(s_cached_client_certs);
         s_cached_client_certs = NULL;
     }
 
+    if (s_cached_server_pubkeys)
+    {
+        hs_cache_destroy(s_cached_server_pubkeys);
+        s_cached_server_pubkeys = NULL;
+    }
+
 }
 
 
@@ -243,39 +529,112 @@ lsquic_handshake_cleanup (void)
 }
 
 
+static void
+drop_info (void *info)
+{
+    free_info(info);
+}
+
+
+/* Called with stripe lock held */
+static void
+c_drop_cert_hash_item (void *data)
+{
+    cert_hash_item_t *const item = data;
+
+    if (0 == --item->refcnt)
+        c_free_cert_hash_item(item);
+}
+
+
+static void
+drop_pubkey (void *data)
+{
+    struct cached_pubkey *const cached = data;
+
+    if (cached->cpk_pkey)
+        EVP_PKEY_free(cached->cpk_pkey);
+    free(cached);
+}
+
+
 /* return -1 for fail, 0 OK*/
 static int init_hs_hash_tables(int flags)
 {
     if (flags & LSQUIC_GLOBAL_CLIENT)
     {
-        s_cached_client_session_infos = lsquic_hash_create();
+        s_cached_client_session_infos = hs_cache_new(HS_CACHE_MAX_SESSIONS,
+                                                                drop_info);
         if (!s_cached_client_session_infos)
             return -1;
 
-        s_cached_client_certs = lsquic_hash_create();
+        s_cached_client_certs = hs_cache_new(HS_CACHE_MAX_CERTS,
+                                                    c_drop_cert_hash_item);
         if (!s_cached_client_certs)
             return -1;
+
+        s_cached_server_pubkeys = hs_cache_new(HS_CACHE_MAX_PUBKEYS,
+                                                                drop_pubkey);
+        if (!s_cached_server_pubkeys)
+            return -1;
+
+        hs_lock_init(&s_sweep_lock);
     }
 
     return 0;
 }
 
 
+static void
+c_ref_certs (void *data, void *ctx)
+{
+    cert_hash_item_t *const item = data;
+
+    ++item->refcnt;
+    *(cert_hash_item_t **) ctx = item;
+}
+
+
 /* client */
-cert_hash_item_t *
+/* Returns a reference to the cached item, which must be released using
+ * c_release_certs().
+ */
+static cert_hash_item_t *
 c_find_certs (const lsquic_str_t *domain)
 {
-    struct lsquic_hash_elem *el;
+    cert_hash_item_t *item;
 
     if (!s_cached_client_certs)
         return NULL;
 
-    el = lsquic_hash_find(s_cached_client_certs, lsquic_str_cstr(domain),
-                                                    lsquic_str_len(domain));
-    if (el == NULL)
+    if (0 == hs_cache_get(s_cached_client_certs, lsquic_str_cstr(domain),
+                                lsquic_str_len(domain), c_ref_certs, &item))
+        return item;
+    else
         return NULL;
+}
+
+
+/* client */
+static void
+c_release_certs (cert_hash_item_t *item)
+{
+    struct hs_cache_stripe *stripe;
+    unsigned refcnt;
 
-    return lsquic_hashelem_getdata(el);
+    if (s_cached_client_certs)
+    {
+        stripe = hs_cache_get_stripe(s_cached_client_certs,
+                    lsquic_str_cstr(item->domain), lsquic_str_len(item->domain));
+        hs_lock(&stripe->hcs_lock);
+        refcnt = --item->refcnt;
+        hs_unlock(&stripe->hcs_lock);
+    }
+    else
+        refcnt = --item->refcnt;
+
+    if (0 == refcnt)
+        c_free_cert_hash_item(item);
 }
 
 
@@ -292,6 +651,7 @@ make_cert_hash_item (lsquic_str_t *domain, lsquic_str_t **certs, int count)
     item->hashs = lsquic_str_new(NULL, 0);
     lsquic_str_copy(item->domain, domain);
     item->count = count;
+    item->refcnt = 1;
     for(i=0; i<count; ++i)
     {
         lsquic_str_copy(&item->crts[i], certs[i]);
@@ -320,26 +680,55 @@ c_free_cert_hash_item (cert_hash_item_t *item)
 
 
 /* client */
+/* The cache takes its own reference to the item */
 static int
 c_insert_certs (cert_hash_item_t *item)
 {
-    if (lsquic_hash_insert(s_cached_client_certs,
-            lsquic_str_cstr(item->domain),
-                lsquic_str_len(item->domain), item) == NULL)
+    if (!s_cached_client_certs)
         return -1;
-    else
+
+    ++item->refcnt;
+    if (0 == hs_cache_put(s_cached_client_certs, lsquic_str_cstr(item->domain),
+                                        lsquic_str_len(item->domain), item))
         return 0;
+    else
+    {
+        --item->refcnt;
+        return -1;
+    }
+}
+
+
+static void
+copy_info (lsquic_session_cache_info_t *dst,
+                                        const lsquic_session_cache_info_t *src)
+{
+    memcpy(dst, src, sizeof(*dst));
+    lsquic_str_copy(&dst->sstk, &src->sstk);
+    lsquic_str_copy(&dst->scfg, &src->scfg);
+    lsquic_str_blank(&dst->sni_key);
 }
 
 
+/* A copy of the entry is placed into the cache */
 static int save_session_info_entry(lsquic_str_t *key, lsquic_session_cache_info_t *entry)
 {
-    lsquic_str_setto(&entry->sni_key, lsquic_str_cstr(key), lsquic_str_len(key));
-    if (lsquic_hash_insert(s_cached_client_session_infos,
-            lsquic_str_cstr(&entry->sni_key),
-                lsquic_str_len(&entry->sni_key), entry) == NULL)
+    lsquic_session_cache_info_t *copy;
+
+    if (!s_cached_client_session_infos)
+        return -1;
+
+    copy = malloc(sizeof(*copy));
+    if (!copy)
+        return -1;
+
+    copy_info(copy, entry);
+    lsquic_str_setto(&copy->sni_key, lsquic_str_cstr(key), lsquic_str_len(key));
+    if (0 != hs_cache_put(s_cached_client_session_infos,
+            lsquic_str_cstr(&copy->sni_key),
+                lsquic_str_len(&copy->sni_key), copy))
     {
-        lsquic_str_d(&entry->sni_key);
+        free_info(copy);
         return -1;
     }
     else
@@ -347,67 +736,341 @@ static int save_session_info_entry(lsquic_str_t *key, lsquic_session_cache_info_
 }
 
 
-/* If entry updated and need to remove cached entry */
 static void
-remove_session_info_entry (lsquic_str_t *key)
+copy_out_info (void *data, void *ctx)
+{
+    copy_info(ctx, data);
+}
+
+
+#ifndef WIN32
+/* Persistent cache entry consists of the fixed part below followed by
+ * STK, SCFG, and the certificates, each preceded by its 32-bit length.
+ */
+struct persist_info
+{
+    unsigned char   sscid[SCID_LENGTH];
+    unsigned char   spubs[32];
+    uint32_t        ver;
+    uint32_t        aead;
+    uint32_t        kexs;
+    uint32_t        pdmd;
+    uint64_t        orbt;
+    uint64_t        expy;
+    uint32_t        n_certs;
+};
+
+#define MAX_PERSIST_CERTS 16
+
+
+static unsigned char *
+persist_str (unsigned char *p, const unsigned char *end, const char *str,
+                                                                uint32_t len)
+{
+    if (!p || (size_t) (end - p) < sizeof(len) + len)
+        return NULL;
+    memcpy(p, &len, sizeof(len));
+    p += sizeof(len);
+    memcpy(p, str, len);
+    return p + len;
+}
+
+
+static const unsigned char *
+restore_str (const unsigned char *p, const unsigned char *end,
+                                                            lsquic_str_t *str)
+{
+    uint32_t len;
+
+    if (!p || (size_t) (end - p) < sizeof(len))
+        return NULL;
+    memcpy(&len, p, sizeof(len));
+    p += sizeof(len);
+    if ((size_t) (end - p) < len)
+        return NULL;
+    lsquic_str_set(str, (char *) p, len);
+    return p + len;
+}
+
+
+/* Return number of bytes written or -1 if the entry does not fit */
+static int
+persist_session (const lsquic_session_cache_info_t *info,
+        const cert_hash_item_t *certs, unsigned char *buf, size_t bufsz)
+{
+    unsigned char *p = buf, *const end = buf + bufsz;
+    struct persist_info pi;
+    int i;
+
+    if (bufsz < sizeof(pi))
+        return -1;
+
+    /* The record is shared with other processes: do not leak padding */
+    memset(&pi, 0, sizeof(pi));
+    memcpy(pi.sscid, info->sscid, sizeof(pi.sscid));
+    memcpy(pi.spubs, info->spubs, sizeof(pi.spubs));
+    pi.ver     = info->ver;
+    pi.aead    = info->aead;
+    pi.kexs    = info->kexs;
+    pi.pdmd    = info->pdmd;
+    pi.orbt    = info->orbt;
+    pi.expy    = info->expy;
+    pi.n_certs = certs && certs->count <= MAX_PERSIST_CERTS ? certs->count : 0;
+    memcpy(p, &pi, sizeof(pi));
+    p += sizeof(pi);
+
+    p = persist_str(p, end, lsquic_str_cstr(&info->sstk),
+                                            lsquic_str_len(&info->sstk));
+    p = persist_str(p, end, lsquic_str_cstr(&info->scfg),
+                                            lsquic_str_len(&info->scfg));
+    for (i = 0; i < (int) pi.n_certs; ++i)
+        p = persist_str(p, end, lsquic_str_cstr(&certs->crts[i]),
+                                            lsquic_str_len(&certs->crts[i]));
+
+    return p ? (int) (p - buf) : -1;
+}
+
+
+static void
+save_persistent_entry (const lsquic_str_t *key,
+        const lsquic_session_cache_info_t *info, const cert_hash_item_t *certs)
 {
-    lsquic_session_cache_info_t *entry;
-    struct lsquic_hash_elem *el;
-    el = lsquic_hash_find(s_cached_client_session_infos,
-                                lsquic_str_cstr(key), lsquic_str_len(key));
-    if (el)
+    unsigned char *buf;
+    int len;
+
+    pthread_rwlock_rdlock(&s_persistent_lock);
+    if (!s_persistent_cache)
+        goto end;
+
+    buf = malloc(SCACHE_MAX_ENTRY_SZ);
+    if (!buf)
+        goto end;
+
+    len = persist_session(info, certs, buf,
+                                SCACHE_MAX_ENTRY_SZ - lsquic_str_len(key));
+    if (len < 0 || 0 != scache_put(s_persistent_cache, lsquic_str_cstr(key),
+                                lsquic_str_len(key), buf, len, info->expy))
+        LSQ_INFO("could not save %s session info to persistent cache",
+                                                        lsquic_str_cstr(key));
+    free(buf);
+
+  end:
+    pthread_rwlock_unlock(&s_persistent_lock);
+}
+
+
+/* Load entry from the persistent cache into both in-memory caches.  Return
+ * 0 if the entry was found, -1 otherwise.
+ */
+static int
+load_persistent_entry (const char *key)
+{
+    const unsigned char *p, *end;
+    unsigned char *buf;
+    lsquic_session_cache_info_t info;
+    lsquic_str_t crts[MAX_PERSIST_CERTS], *crt_ptrs[MAX_PERSIST_CERTS];
+    lsquic_str_t key_str;
+    cert_hash_item_t *item;
+    struct persist_info pi;
+    unsigned i;
+    int len, s;
+
+    buf = malloc(SCACHE_MAX_ENTRY_SZ);
+    if (!buf)
+        return -1;
+
+    pthread_rwlock_rdlock(&s_persistent_lock);
+    if (s_persistent_cache)
+        len = scache_get(s_persistent_cache, key, strlen(key), buf,
+                                        SCACHE_MAX_ENTRY_SZ, time(NULL));
+    else
+        len = -1;
+    pthread_rwlock_unlock(&s_persistent_lock);
+    if (len < (int) sizeof(pi))
+    {
+        free(buf);
+        return -1;
+    }
+
+    memcpy(&pi, buf, sizeof(pi));
+    memset(&info, 0, sizeof(info));
+    memcpy(info.sscid, pi.sscid, sizeof(info.sscid));
+    memcpy(info.spubs, pi.spubs, sizeof(info.spubs));
+    info.ver       = pi.ver;
+    info.aead      = pi.aead;
+    info.kexs      = pi.kexs;
+    info.pdmd      = pi.pdmd;
+    info.orbt      = pi.orbt;
+    info.expy      = pi.expy;
+    info.scfg_flag = 2;
+    p = buf + sizeof(pi);
+    end = buf + len;
+    p = restore_str(p, end, &info.sstk);
+    p = restore_str(p, end, &info.scfg);
+    if (pi.n_certs > MAX_PERSIST_CERTS)
+        p = NULL;
+    for (i = 0; i < pi.n_certs; ++i)
+    {
+        p = restore_str(p, end, &crts[i]);
+        crt_ptrs[i] = &crts[i];
+    }
+    if (!p)
+    {
+        LSQ_WARN("corrupt persistent cache entry for %s", key);
+        free(buf);
+        return -1;
+    }
+
+    lsquic_str_set(&key_str, (char *) key, strlen(key));
+    s = save_session_info_entry(&key_str, &info);
+    if (0 == s && pi.n_certs > 0)
     {
-        entry = lsquic_hashelem_getdata(el);
-        lsquic_str_d(&entry->sni_key);
-        lsquic_hash_erase(s_cached_client_session_infos, el);
+        item = make_cert_hash_item(&key_str, crt_ptrs, pi.n_certs);
+        (void) c_insert_certs(item);
+        c_release_certs(item);
     }
+
+    LSQ_DEBUG("loaded session info for %s from persistent cache", key);
+    free(buf);
+    return s;
+}
+#endif
+
+
+/* client */
+/* Copies cached entry into `info'.  Returns 0 if found, -1 otherwise. */
+static int
+retrieve_session_info_entry (const char *key,
+                                        lsquic_session_cache_info_t *info)
+{
+    if (!s_cached_client_session_infos)
+        return -1;
+
+    if (!key)
+        return -1;
+
+    if (0 != hs_cache_get(s_cached_client_session_infos, key, strlen(key),
+                                                        copy_out_info, info))
+    {
+#ifndef WIN32
+        if (!(0 == load_persistent_entry(key)
+                && 0 == hs_cache_get(s_cached_client_session_infos, key,
+                                        strlen(key), copy_out_info, info)))
+#endif
+            return -1;
+    }
+
+    if ((uint64_t) time(NULL) > info->expy)
+    {
+        LSQ_DEBUG("cached session info for %s has expired", key);
+        lsquic_str_d(&info->sstk);
+        lsquic_str_d(&info->scfg);
+        memset(info, 0, sizeof(*info));
+        return -1;
+    }
+
+    LSQ_DEBUG("[QUIC]retrieve_session_info_entry find cached session info "
+                                                                "for %s", key);
+    return 0;
+}
+
+
+/* Session info is good until the server config expires (EXPY) or for
+ * STTL seconds, whichever comes first.
+ */
+static uint64_t
+calc_session_expiry (const lsquic_enc_session_t *enc_session)
+{
+    uint64_t expiry;
+
+    expiry = enc_session->info->expy ? enc_session->info->expy : UINT64_MAX;
+    if (enc_session->hs_ctx.sttl
+            && (uint64_t) time(NULL) + enc_session->hs_ctx.sttl < expiry)
+        expiry = (uint64_t) time(NULL) + enc_session->hs_ctx.sttl;
+
+    return expiry;
+}
+
+
+static int
+is_info_expired (const void *data, void *ctx)
+{
+    const lsquic_session_cache_info_t *const entry = data;
+    const time_t *const tm = ctx;
+
+    return (uint64_t) *tm > entry->expy;
+}
+
+
+static void
+remove_expire_session_info_entry (void)
+{
+    time_t tm = time(NULL);
+
+    if (s_cached_client_session_infos)
+        hs_cache_remove_if(s_cached_client_session_infos, is_info_expired,
+                                                                        &tm);
+#ifndef WIN32
+    pthread_rwlock_rdlock(&s_persistent_lock);
+    if (s_persistent_cache)
+        (void) scache_expire(s_persistent_cache, tm);
+    pthread_rwlock_unlock(&s_persistent_lock);
+#endif
 }
 
 
-/* client */
-static lsquic_session_cache_info_t *
-retrieve_session_info_entry (const char *key)
+/* Remove expired entries at most once every HS_CACHE_SWEEP_INTERVAL
+ * seconds.
+ */
+static void
+maybe_remove_expire_session_info_entries (void)
 {
-    lsquic_session_cache_info_t *entry;
-    struct lsquic_hash_elem *el;
-
-    if (!s_cached_client_session_infos)
-        return NULL;
-
-    if (!key)
-        return NULL;
+    time_t now = time(NULL);
+    int sweep;
 
-    el = lsquic_hash_find(s_cached_client_session_infos, key, strlen(key));
-    if (el == NULL)
-        return NULL;
+    hs_lock(&s_sweep_lock);
+    sweep = now >= s_next_sweep;
+    if (sweep)
+        s_next_sweep = now + HS_CACHE_SWEEP_INTERVAL;
+    hs_unlock(&s_sweep_lock);
 
-    entry = lsquic_hashelem_getdata(el);
-    LSQ_DEBUG("[QUIC]retrieve_session_info_entry find cached session info %p.\n", entry);
-    return entry;
+    if (sweep)
+        remove_expire_session_info_entry();
 }
 
 
-/* call it in timer() */
-#if __GNUC__
-__attribute__((unused))
-#endif
-static void
-remove_expire_session_info_entry (void)
+#ifndef WIN32
+static int
+lsquic_handshake_set_cache_file (const char *path, unsigned n_entries)
 {
-    time_t tm = time(NULL);
-    struct lsquic_hash_elem *el;
+    struct scache *cache, *old_cache;
 
-    for (el = lsquic_hash_first(s_cached_client_session_infos); el;
-                        el = lsquic_hash_next(s_cached_client_session_infos))
+    if (!s_cached_client_session_infos)
     {
-        lsquic_session_cache_info_t *entry = lsquic_hashelem_getdata(el);
-        if ((uint64_t)tm > entry->expy)
-        {
-            free_info(entry);
-            lsquic_hash_erase(s_cached_client_session_infos, el);
-        }
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (path)
+    {
+        cache = scache_open(path, n_entries);
+        if (!cache)
+            return -1;
     }
+    else
+        cache = NULL;
+
+    /* Engines in other threads may be using the old cache */
+    pthread_rwlock_wrlock(&s_persistent_lock);
+    old_cache = s_persistent_cache;
+    s_persistent_cache = cache;
+    pthread_rwlock_unlock(&s_persistent_lock);
+
+    if (old_cache)
+        scache_close(old_cache);
+    return 0;
 }
+#endif
 
 
 static lsquic_enc_session_t *
@@ -427,18 +1090,16 @@ lsquic_enc_session_create_client (const char *domain, lsquic_cid_t cid,
     if (!enc_session)
         return NULL;
 
-    info = retrieve_session_info_entry(domain);
-    if (info)
-        memcpy(enc_session->hs_ctx.pubs, info->spubs, 32);
-    else
+    info = calloc(1, sizeof(*info));
+    if (!info)
     {
-        info = calloc(1, sizeof(*info));
-        if (!info)
-        {
-            free(enc_session);
-            return NULL;
-        }
+        free(enc_session);
+        return NULL;
     }
+    if (s_cached_client_session_infos)
+        maybe_remove_expire_session_info_entries();
+    if (0 == retrieve_session_info_entry(domain, info))
+        memcpy(enc_session->hs_ctx.pubs, info->spubs, 32);
 
     enc_session->enpub = enpub;
     enc_session->cid   = cid;
@@ -467,6 +1128,11 @@ lsquic_enc_session_destroy (lsquic_enc_session_t *enc_session)
     lsquic_str_d(&enc_session->chlo);
     lsquic_str_d(&enc_session->sstk);
     lsquic_str_d(&enc_session->ssno);
+    if (enc_session->info)
+        free_info(enc_session->info);
+    if (enc_session->cert_item)
+        c_release_certs(enc_session->cert_item);
+    free(enc_session->cert_chain);
     if (enc_session->dec_ctx_i)
     {
         EVP_AEAD_CTX_cleanup(enc_session->dec_ctx_i);
@@ -516,6 +1182,16 @@ lsquic_enc_session_is_hsk_done (lsquic_enc_session_t *enc_session)
 }
 
 
+/* Initial keys are derived when CHLO is generated using cached (or
+ * just received) server config and certificates.
+ */
+static int
+lsquic_enc_session_is_zero_rtt_enabled (const lsquic_enc_session_t *enc_session)
+{
+    return enc_session->have_key > 0;
+}
+
+
 static void
 process_copt (lsquic_enc_session_t *enc_session, const uint32_t *const opts,
                 unsigned n_opts)
@@ -643,8 +1319,6 @@ static int parse_hs_data (lsquic_enc_session_t *enc_session, uint32_t tag,
         break;
 
     case QTAG_STK:
-        if (lsquic_str_len(&enc_session->info->sstk) > 0)
-            remove_session_info_entry(&enc_session->info->sstk);
         lsquic_str_setto(&enc_session->info->sstk, val, len);
         ESHIST_APPEND(enc_session, ESHE_SET_STK);
         break;
@@ -657,7 +1331,12 @@ static int parse_hs_data (lsquic_enc_session_t *enc_session, uint32_t tag,
         break;
 
     case QTAG_AEAD:
-        enc_session->info->aead = get_tag_value_i32(val, len);
+        enc_session->info->aead = select_aead(enc_session, val, len);
+        if (!enc_session->info->aead)
+        {
+            LSQ_INFO("server does not support any of our AEADs");
+            return -1;
+        }
         break;
 
     case QTAG_KEXS:
@@ -773,6 +1452,57 @@ static uint32_t get_tag_value_i32(unsigned char *val, int len)
 }
 
 
+/* Our preferred AEAD: CC20 if the CPU has no AES instructions and the user
+ * asked for it, es_aead otherwise.
+ */
+static uint32_t
+preferred_aead (const lsquic_enc_session_t *enc_session)
+{
+    const struct lsquic_engine_settings *const settings =
+                                        &enc_session->enpub->enp_settings;
+
+    if (settings->es_prefer_chacha && !crypto_have_aes_hw())
+        return QTAG_CC20;
+    else
+        return settings->es_aead;
+}
+
+
+/* Pick an AEAD from the list the server supports.  Returns zero if none
+ * of the AEADs in the list is supported.
+ */
+static uint32_t
+select_aead (const lsquic_enc_session_t *enc_session,
+                                        const unsigned char *val, int len)
+{
+    const uint32_t preferred = preferred_aead(enc_session);
+    uint32_t tag, selected;
+    int i;
+
+    selected = 0;
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        memcpy(&tag, val + i, 4);
+        if (tag == preferred)
+            return tag;
+        if (!selected && (tag == QTAG_AESG || tag == QTAG_CC20))
+            selected = tag;
+    }
+
+    return selected;
+}
+
+
+static unsigned
+aead_key_len (uint32_t aead)
+{
+    if (aead == QTAG_CC20)
+        return cc20_key_len;
+    else
+        return aes128_key_len;
+}
+
+
 static uint64_t get_tag_value_i64(unsigned char *val, int len)
 {
     uint64_t v;
@@ -920,10 +1650,10 @@ lsquic_enc_session_gen_chlo (lsquic_enc_session_t *enc_session,
     const lsquic_str_t *const ccs = get_common_certs_hash();
     const struct lsquic_engine_settings *const settings =
                                         &enc_session->enpub->enp_settings;
-    cert_hash_item_t *const cached_certs_item =
-                                    c_find_certs(&enc_session->hs_ctx.sni);
+    cert_hash_item_t *cached_certs_item;
     unsigned char pub_key[32];
     size_t ua_len;
+    uint32_t aead;
     uint32_t opts[1];  /* Only NSTP is supported for now */
     unsigned n_opts, msg_len, n_tags, pad_size;
     struct message_writer mw;
@@ -932,6 +1662,17 @@ lsquic_enc_session_gen_chlo (lsquic_enc_session_t *enc_session,
     if (*len < MIN_CHLO_SIZE)
         return -1;
 
+    if (!enc_session->cert_item)
+        enc_session->cert_item = c_find_certs(&enc_session->hs_ctx.sni);
+    cached_certs_item = enc_session->cert_item;
+
+    /* Once we have the server config, use the AEAD selected from it */
+    if (lsquic_str_len(&enc_session->info->scfg) > 0 && enc_session->info->aead)
+        aead = enc_session->info->aead;
+    else
+        aead = preferred_aead(enc_session);
+    enc_session->hs_ctx.aead = aead;
+
     n_opts = 0;
     if (settings->es_support_nstp)
         opts[ n_opts++ ] = QTAG_NSTP;
@@ -988,8 +1729,15 @@ lsquic_enc_session_gen_chlo (lsquic_enc_session_t *enc_session,
                                             ++n_tags;           /* PUBS */
             MSG_LEN_ADD(msg_len, sizeof(enc_session->hs_ctx.nonc));
                                             ++n_tags;           /* NONC */
-            rand_bytes(enc_session->priv_key, 32);
-            c255_get_pub_key(enc_session->priv_key, pub_key);
+#ifndef WIN32
+            if (!(enc_session->enpub->enp_kxs_pool
+                    && 0 == lsquic_kxs_pool_get(enc_session->enpub->enp_kxs_pool,
+                                            enc_session->priv_key, pub_key)))
+#endif
+            {
+                rand_bytes(enc_session->priv_key, 32);
+                c255_get_pub_key(enc_session->priv_key, pub_key);
+            }
             gen_nonce_c(enc_session->hs_ctx.nonc, enc_session->info->orbt);
         }
     }
@@ -1028,7 +1776,7 @@ lsquic_enc_session_gen_chlo (lsquic_enc_session_t *enc_session,
     if (lsquic_str_len(&enc_session->info->scfg) > 0 && enc_session->cert_ptr)
         MW_WRITE_BUFFER(&mw, QTAG_NONC, enc_session->hs_ctx.nonc,
                                         sizeof(enc_session->hs_ctx.nonc));
-    MW_WRITE_UINT32(&mw, QTAG_AEAD, settings->es_aead);
+    MW_WRITE_UINT32(&mw, QTAG_AEAD, aead);
     if (ua_len)
         MW_WRITE_BUFFER(&mw, QTAG_UAID, settings->es_ua, ua_len);
     if (lsquic_str_len(&enc_session->info->scfg) > 0)
@@ -1075,6 +1823,71 @@ lsquic_enc_session_gen_chlo (lsquic_enc_session_t *enc_session,
 }
 
 
+/* Called with stripe lock held */
+static void
+c_ref_pubkey (void *data, void *ctx)
+{
+    struct cached_pubkey *const cached = data;
+
+    if (cached->cpk_pkey)
+        EVP_PKEY_up_ref(cached->cpk_pkey);
+    *(struct cached_pubkey *) ctx = *cached;
+}
+
+
+/* Return public key of the certificate, which the caller must release
+ * using EVP_PKEY_free(), or NULL if the certificate is invalid.  The
+ * result is cached.
+ */
+static EVP_PKEY *
+get_cert_pubkey (const lsquic_str_t *crt)
+{
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    struct cached_pubkey found, *cached;
+    X509 *cert;
+    EVP_PKEY *pub_key;
+
+    if (s_cached_server_pubkeys)
+    {
+        sha256((const uint8_t *) lsquic_str_cstr(crt), lsquic_str_len(crt),
+                                                                        hash);
+        if (0 == hs_cache_get(s_cached_server_pubkeys, hash, sizeof(hash),
+                                                        c_ref_pubkey, &found))
+        {
+            LSQ_DEBUG("found cached public key");
+            return found.cpk_pkey;
+        }
+    }
+
+    cert = bio_to_crt(lsquic_str_cstr(crt), lsquic_str_len(crt), 0);
+    if (cert)
+    {
+        pub_key = X509_get_pubkey(cert);
+        X509_free(cert);
+    }
+    else
+        pub_key = NULL;
+    if (!pub_key)
+        LSQ_INFO("cannot get public key from server certificate");
+
+    if (s_cached_server_pubkeys)
+    {
+        cached = malloc(sizeof(*cached));
+        if (cached)
+        {
+            cached->cpk_pkey = pub_key;
+            if (pub_key)
+                EVP_PKEY_up_ref(pub_key);
+            if (0 != hs_cache_put(s_cached_server_pubkeys, hash,
+                                                    sizeof(hash), cached))
+                drop_pubkey(cached);
+        }
+    }
+
+    return pub_key;
+}
+
+
 static int handle_chlo_reply_verify_prof(lsquic_enc_session_t *enc_session,
                                          lsquic_str_t **out_certs,
                                          size_t *out_certs_count,
@@ -1087,15 +1900,14 @@ static int handle_chlo_reply_verify_prof(lsquic_enc_session_t *enc_session,
                                     in + lsquic_str_len(&enc_session->hs_ctx.crt);
     EVP_PKEY *pub_key;
     int ret;
-    X509 *cert;
     ret = decompress_certs(in, in_end,cached_certs, cached_certs_count,
                            out_certs, out_certs_count);
     if (ret)
         return ret;
 
-    cert = bio_to_crt((const char *)lsquic_str_cstr(out_certs[0]),
-                      lsquic_str_len(out_certs[0]), 0);
-    pub_key = X509_get_pubkey(cert);
+    pub_key = get_cert_pubkey(out_certs[0]);
+    if (!pub_key)
+        return -1;
     ret = verify_prof((const uint8_t *)lsquic_str_cstr(&enc_session->chlo),
                       (size_t)lsquic_str_len(&enc_session->chlo),
                       &enc_session->info->scfg,
@@ -1103,15 +1915,15 @@ static int handle_chlo_reply_verify_prof(lsquic_enc_session_t *enc_session,
                       (const uint8_t *)lsquic_str_cstr(&enc_session->hs_ctx.prof),
                       lsquic_str_len(&enc_session->hs_ctx.prof));
     EVP_PKEY_free(pub_key);
-    X509_free(cert);
     return ret;
 }
 
 
-void setup_aead_ctx(EVP_AEAD_CTX **ctx, unsigned char key[], int key_len,
-                    unsigned char *key_copy)
+void setup_aead_ctx(EVP_AEAD_CTX **ctx, uint32_t aead, unsigned char key[],
+                    int key_len, unsigned char *key_copy)
 {
-    const EVP_AEAD *aead_ = EVP_aead_aes_128_gcm();
+    const EVP_AEAD *aead_ = aead == QTAG_CC20 ? EVP_aead_chacha20_poly1305()
+                                              : EVP_aead_aes_128_gcm();
     const int auth_tag_size = 12;
     if (*ctx)
     {
@@ -1133,22 +1945,24 @@ determine_diversification_key (lsquic_enc_session_t *enc_session,
 {
     EVP_AEAD_CTX **ctx_s_key;
     unsigned char *key_i, *iv;
-    uint8_t ikm[aes128_key_len + aes128_iv_len];
+    const uint32_t aead = enc_session->hs_ctx.aead;
+    const unsigned key_len = aead_key_len(aead);
+    uint8_t ikm[max_key_len + aes128_iv_len];
 
     ctx_s_key = &enc_session->dec_ctx_i;
     key_i = enc_session->dec_key_i;
     iv = enc_session->dec_key_nonce_i;
-    memcpy(ikm, key_i, aes128_key_len);
-    memcpy(ikm + aes128_key_len, iv, aes128_iv_len);
-    export_key_material(ikm, aes128_key_len + aes128_iv_len,
+    memcpy(ikm, key_i, key_len);
+    memcpy(ikm + key_len, iv, aes128_iv_len);
+    export_key_material(ikm, key_len + aes128_iv_len,
                         diversification_nonce, DNONC_LENGTH,
                         (const unsigned char *) "QUIC key diversification", 24,
-                        0, NULL, aes128_key_len, key_i, 0, NULL,
+                        0, NULL, key_len, key_i, 0, NULL,
                         aes128_iv_len, iv, NULL);
 
-    setup_aead_ctx(ctx_s_key, key_i, aes128_key_len, NULL);
+    setup_aead_ctx(ctx_s_key, aead, key_i, key_len, NULL);
     LSQ_DEBUG("determine_diversification_keys diversification_key: %s\n",
-              get_bin_str(key_i, aes128_key_len, 512));
+              get_bin_str(key_i, key_len, 512));
     LSQ_DEBUG("determine_diversification_keys diversification_key nonce: %s\n",
               get_bin_str(iv, aes128_iv_len, 512));
     return 0;
@@ -1163,8 +1977,10 @@ static int determine_keys(lsquic_enc_session_t *enc_session)
     struct lsquic_buf *nonce_c = lsquic_buf_create(100);
     struct lsquic_buf *hkdf_input = lsquic_buf_create(0);
 
-    unsigned char c_key[aes128_key_len];
-    unsigned char s_key[aes128_key_len];
+    const uint32_t aead = enc_session->hs_ctx.aead;
+    const unsigned key_len = aead_key_len(aead);
+    unsigned char c_key[max_key_len];
+    unsigned char s_key[max_key_len];
     unsigned char *c_key_bin = NULL;
     unsigned char *s_key_bin = NULL;
 
@@ -1236,23 +2052,23 @@ static int determine_keys(lsquic_enc_session_t *enc_session)
                         (unsigned char *)lsquic_buf_begin(nonce_c), lsquic_buf_size(nonce_c),
                         (unsigned char *)lsquic_buf_begin(hkdf_input),
                         lsquic_buf_size(hkdf_input),
-                        aes128_key_len, c_key,
-                        aes128_key_len, s_key,
+                        key_len, c_key,
+                        key_len, s_key,
                         aes128_iv_len, c_iv,
                         aes128_iv_len, s_iv,
                         sub_key);
 
-    setup_aead_ctx(ctx_c_key, c_key, aes128_key_len, c_key_bin);
-    setup_aead_ctx(ctx_s_key, s_key, aes128_key_len, s_key_bin);
+    setup_aead_ctx(ctx_c_key, aead, c_key, key_len, c_key_bin);
+    setup_aead_ctx(ctx_s_key, aead, s_key, key_len, s_key_bin);
 
 
     lsquic_buf_destroy(nonce_c);
     lsquic_buf_destroy(hkdf_input);
 
     LSQ_DEBUG("***export_key_material '%c' c_key: %s", key_flag,
-              get_bin_str(c_key, aes128_key_len, 512));
+              get_bin_str(c_key, key_len, 512));
     LSQ_DEBUG("***export_key_material '%c' s_key: %s", key_flag,
-              get_bin_str(s_key, aes128_key_len, 512));
+              get_bin_str(s_key, key_len, 512));
     LSQ_DEBUG("***export_key_material '%c' c_iv: %s", key_flag,
               get_bin_str(c_iv, aes128_iv_len, 512));
     LSQ_DEBUG("***export_key_material '%c' s_iv: %s", key_flag,
@@ -1292,12 +2108,69 @@ he2str (enum handshake_error he)
     case HS_SHLO:           return "HS_SHLO";
     case HS_1RTT:           return "HS_1RTT";
     case HS_2RTT:           return "HS_2RTT";
+    case HS_CERT_PENDING:   return "HS_CERT_PENDING";
     default:
         assert(0);          return "<unknown enum value>";
     }
 }
 
 
+static int
+start_cert_verification (lsquic_enc_session_t *enc_session)
+{
+    const cert_hash_item_t *const item = enc_session->cert_item;
+    int i;
+
+    assert(!enc_session->cert_chain);
+    enc_session->cert_chain = malloc(sizeof(enc_session->cert_chain[0])
+                                                            * item->count);
+    if (!enc_session->cert_chain)
+        return -1;
+
+    for (i = 0; i < item->count; ++i)
+    {
+        enc_session->cert_chain[i].buf =
+                    (const unsigned char *) lsquic_str_cstr(&item->crts[i]);
+        enc_session->cert_chain[i].len = lsquic_str_len(&item->crts[i]);
+    }
+
+    LSQ_DEBUG("certificate chain of %d certificate%.*s is to be verified",
+                                        item->count, item->count != 1, "s");
+    return 0;
+}
+
+
+static int
+lsquic_enc_session_get_cert_chain (const lsquic_enc_session_t *enc_session,
+                    const struct lsquic_cert **chain, unsigned *n_certs)
+{
+    if (!enc_session->cert_chain)
+        return -1;
+
+    *chain = enc_session->cert_chain;
+    *n_certs = enc_session->cert_item->count;
+    return 0;
+}
+
+
+static int
+lsquic_enc_session_cert_verified (lsquic_enc_session_t *enc_session, int ok)
+{
+    if (!enc_session->cert_chain)
+        return -1;
+
+    free(enc_session->cert_chain);
+    enc_session->cert_chain = NULL;
+    EV_LOG_CONN_EVENT(enc_session->cid, "certificate chain %s",
+                                            ok ? "verified" : "rejected");
+    if (!ok)
+        return -1;
+
+    (void) c_insert_certs(enc_session->cert_item);
+    return 0;
+}
+
+
 /* NOT packet, just the frames-data */
 /* return rtt number:
  *      0 OK
@@ -1312,12 +2185,16 @@ lsquic_enc_session_handle_chlo_reply (lsquic_enc_session_t *enc_session,
     int ret;
     lsquic_session_cache_info_t *info = enc_session->info;
     hs_ctx_t * hs_ctx = &enc_session->hs_ctx;
-    cert_hash_item_t *cached_certs_item = c_find_certs(&hs_ctx->sni);
+    cert_hash_item_t *cached_certs_item;
 
     /* FIXME get the number first */
     lsquic_str_t **out_certs = NULL;
     size_t out_certs_count = 0, i;
 
+    if (!enc_session->cert_item)
+        enc_session->cert_item = c_find_certs(&hs_ctx->sni);
+    cached_certs_item = enc_session->cert_item;
+
     ret = parse_hs(enc_session, data, len, &head_tag);
     if (ret)
         goto end;
@@ -1376,11 +2253,18 @@ lsquic_enc_session_handle_chlo_reply (lsquic_enc_session_t *enc_session,
                         else
                         {
                             if (cached_certs_item)
-                                c_free_cert_hash_item(cached_certs_item);
+                                c_release_certs(cached_certs_item);
 
                             cached_certs_item = make_cert_hash_item(&hs_ctx->sni,
                                                                     out_certs, out_certs_count);
-                            c_insert_certs(cached_certs_item);
+                            enc_session->cert_item = cached_certs_item;
+                            /* If the user verifies the chain, only cache
+                             * it once it has been verified.
+                             */
+                            if (enc_session->enpub->enp_verify_cert)
+                                ret = start_cert_verification(enc_session);
+                            else
+                                (void) c_insert_certs(cached_certs_item);
                         }
                         enc_session->cert_ptr = &cached_certs_item->crts[0];
                     }
@@ -1396,10 +2280,20 @@ lsquic_enc_session_handle_chlo_reply (lsquic_enc_session_t *enc_session,
         }
     }
 
+    if (enc_session->cert_chain)
+    {
+        ret = HS_CERT_PENDING;
+        goto end;
+    }
+
     if (enc_session->hsk_state == HSK_COMPLETED)
     {
-        if (!lsquic_str_buf(&info->sni_key))
-            save_session_info_entry(&enc_session->hs_ctx.sni, info);
+        info->expy = calc_session_expiry(enc_session);
+        save_session_info_entry(&enc_session->hs_ctx.sni, info);
+#ifndef WIN32
+        save_persistent_entry(&enc_session->hs_ctx.sni, info,
+                                                    enc_session->cert_item);
+#endif
         ret = determine_keys(enc_session
                                            ); /* FIXME: check ret */
         enc_session->have_key = 3;
@@ -1458,7 +2352,8 @@ verify_packet_hash (const lsquic_enc_session_t *enc_session,
         if (max_out_len < *header_len + *out_len)
             return -1;
 
-        memcpy(buf_out, buf, *header_len + *out_len);
+        if (buf_out != buf)
+            memcpy(buf_out, buf, *header_len + *out_len);
         return 0;
     }
     else
@@ -1466,6 +2361,47 @@ verify_packet_hash (const lsquic_enc_session_t *enc_session,
 }
 
 
+/* Select decryption levels to try, most likely first, and return their
+ * number.  The peer switches to the final key at some packet number.
+ * Packets with lower numbers are sealed using the initial key.  Packets
+ * with higher numbers use the final key, except for retransmitted SHLOs --
+ * which we already have, since we have the final key -- and they are not
+ * worth another decryption attempt.  Thus, only packets that arrive out
+ * of order during the key transition may need two attempts.
+ */
+static unsigned
+select_dec_levels (const lsquic_enc_session_t *enc_session,
+                            uint64_t pack_num, enum enc_level levels[2])
+{
+    if (enc_session->have_key != 3)
+    {
+        levels[0] = ENC_LEV_INIT;
+        return 1;
+    }
+    else if (!enc_session->peer_have_final_key)
+    {
+        levels[0] = ENC_LEV_FORW;
+        levels[1] = ENC_LEV_INIT;
+        return 2;
+    }
+    else if (pack_num >= enc_session->peer_final_key_packno)
+    {
+        levels[0] = ENC_LEV_FORW;
+        return 1;
+    }
+    else
+    {
+        levels[0] = ENC_LEV_INIT;
+        levels[1] = ENC_LEV_FORW;
+        return 2;
+    }
+}
+
+
+/* If `buf_out' is the same as `buf', the packet is decrypted in place.
+ * A failed decryption wipes the output, so in this case the ciphertext
+ * is saved if there is a second key to try.
+ */
 static enum enc_level
 decrypt_packet (lsquic_enc_session_t *enc_session, uint8_t path_id,
                 uint64_t pack_num, unsigned char *buf, size_t *header_len,
@@ -1476,27 +2412,40 @@ decrypt_packet (lsquic_enc_session_t *enc_session, uint8_t path_id,
     /* Comment: 12 = sizeof(dec_key_iv] 4 + sizeof(pack_num) 8 */
     uint8_t nonce[12];
     uint64_t path_id_packet_number;
-    EVP_AEAD_CTX *key = NULL;
-    int try_times = 0;
-    enum enc_level enc_level;
+    EVP_AEAD_CTX *key;
+    enum enc_level enc_level, levels[2];
+    unsigned n, n_levels;
+    unsigned char saved[QUIC_MAX_PACKET_SZ];
 
+    n_levels = select_dec_levels(enc_session, pack_num, levels);
     path_id_packet_number = combine_path_id_pack_num(path_id, pack_num);
-    memcpy(buf_out, buf, *header_len);
-    do
+    if (buf_out != buf)
+        memcpy(buf_out, buf, *header_len);
+    else if (n_levels > 1)
+    {
+        if (data_len > sizeof(saved))
+            return (enum enc_level) -1;
+        memcpy(saved, buf + *header_len, data_len);
+    }
+
+    ret = -1;
+    enc_level = ENC_LEV_INIT;
+    for (n = 0; n < n_levels && ret != 0; ++n)
     {
-        if (enc_session->have_key == 3 && try_times == 0)
+        if (n > 0 && buf_out == buf)
+            memcpy(buf + *header_len, saved, data_len);
+        enc_level = levels[n];
+        if (enc_level == ENC_LEV_FORW)
         {
             key = enc_session->dec_ctx_f;
             memcpy(nonce, enc_session->dec_key_nonce_f, 4);
             LSQ_DEBUG("decrypt_packet using 'F' key...");
-            enc_level = ENC_LEV_FORW;
         }
         else
         {
             key = enc_session->dec_ctx_i;
             memcpy(nonce, enc_session->dec_key_nonce_i, 4);
             LSQ_DEBUG("decrypt_packet using 'I' key...");
-            enc_level = ENC_LEV_INIT;
         }
         memcpy(nonce + 4, &path_id_packet_number,
                sizeof(path_id_packet_number));
@@ -1507,26 +2456,21 @@ decrypt_packet (lsquic_enc_session_t *enc_session, uint8_t path_id,
                            nonce, 12,
                            buf + *header_len, data_len,
                            buf_out + *header_len, out_len);
+    }
 
-        if (ret != 0)
-            ++try_times;
-        else
+    if (ret == 0 && enc_level == ENC_LEV_FORW)
+    {
+        if (enc_session->peer_have_final_key == 0)
         {
-            if (enc_session->peer_have_final_key == 0 &&
-                enc_session->have_key == 3 &&
-                try_times == 0)
-            {
-                LSQ_DEBUG("!!!decrypt_packet find peer have final key.");
-                enc_session->peer_have_final_key = 1;
-                EV_LOG_CONN_EVENT(enc_session->cid, "settled on private key "
-                    "'%c' after %d tries (packet number %"PRIu64")",
-                    key == enc_session->dec_ctx_f ? 'F' : 'I',
-                    try_times, pack_num);
-            }
-            break;
+            LSQ_DEBUG("!!!decrypt_packet find peer have final key.");
+            enc_session->peer_have_final_key = 1;
+            enc_session->peer_final_key_packno = pack_num;
+            EV_LOG_CONN_EVENT(enc_session->cid, "settled on private key "
+                "'F' after %u tries (packet number %"PRIu64")", n, pack_num);
         }
+        else if (pack_num < enc_session->peer_final_key_packno)
+            enc_session->peer_final_key_packno = pack_num;
     }
-    while (try_times < 2);
 
     LSQ_DEBUG("***decrypt_packet %s.", (ret == 0 ? "succeed" : "failed"));
     return ret == 0 ? enc_level : (enum enc_level) -1;
@@ -1569,6 +2513,62 @@ lsquic_enc_session_decrypt (lsquic_enc_session_t *enc_session,
 }
 
 
+/* Select key and fill in the nonce for packet number `pack_num'.  Returns
+ * NULL if the packet is not encrypted, but hashed.
+ *
+ * This function and the sealing functions below do not log, as they are
+ * called by esf_encrypt_batch(), which may run on crypto threads.
+ */
+static EVP_AEAD_CTX *
+select_enc_key (lsquic_enc_session_t *enc_session, uint8_t path_id,
+                            uint64_t pack_num, int is_hello, uint8_t nonce[12])
+{
+    int is_chlo = (is_hello && ((IS_SERVER(enc_session)) == 0));
+    int is_shlo = (is_hello && (IS_SERVER(enc_session)));
+    uint64_t path_id_packet_number;
+    EVP_AEAD_CTX *key;
+
+    if (!enc_session || enc_session->have_key == 0 || is_chlo)
+        return NULL;
+
+    if (enc_session->have_key != 3 || is_shlo ||
+        ((IS_SERVER(enc_session)) &&
+         enc_session->server_start_use_final_key == 0))
+    {
+        key = enc_session->enc_ctx_i;
+        memcpy(nonce, enc_session->enc_key_nonce_i, 4);
+        if (is_shlo && enc_session->have_key == 3)
+        {
+            enc_session->server_start_use_final_key = 1;
+        }
+    }
+    else
+    {
+        key = enc_session->enc_ctx_f;
+        memcpy(nonce, enc_session->enc_key_nonce_f, 4);
+    }
+    path_id_packet_number = combine_path_id_pack_num(path_id, pack_num);
+    memcpy(nonce + 4, &path_id_packet_number,
+           sizeof(path_id_packet_number));
+    return key;
+}
+
+
+/* Same as aes_aead_enc(), minus logging */
+static int
+seal_packet (EVP_AEAD_CTX *key, const unsigned char *header,
+             size_t header_len, const uint8_t nonce[12],
+             const unsigned char *data, size_t data_len,
+             unsigned char *out, size_t max_out_len, size_t *out_len)
+{
+    if (EVP_AEAD_CTX_seal(key, out, out_len, max_out_len, nonce, 12, data,
+                                            data_len, header, header_len))
+        return 0;
+    else
+        return -1;
+}
+
+
 static int
 lsquic_enc_session_encrypt (lsquic_enc_session_t *enc_session,
                enum lsquic_version version,
@@ -1581,20 +2581,13 @@ lsquic_enc_session_encrypt (lsquic_enc_session_t *enc_session,
     uint8_t md[HS_PKT_HASH_LENGTH];
     uint128 hash;
     int ret;
-    int is_chlo = (is_hello && ((IS_SERVER(enc_session)) == 0));
-    int is_shlo = (is_hello && (IS_SERVER(enc_session)));
 
     /* Comment: 12 = sizeof(dec_key_iv] 4 + sizeof(pack_num) 8 */
     uint8_t nonce[12];
-    uint64_t path_id_packet_number;
     EVP_AEAD_CTX *key;
 
-    if (enc_session)
-        LSQ_DEBUG("%s: hsk_state: %d", __func__, enc_session->hsk_state);
-    else
-        LSQ_DEBUG("%s: enc_session is not set", __func__);
-
-    if (!enc_session || enc_session->have_key == 0 || is_chlo)
+    key = select_enc_key(enc_session, path_id, pack_num, is_hello, nonce);
+    if (!key)
     {
         *out_len = header_len + data_len + HS_PKT_HASH_LENGTH;
         if (max_out_len < *out_len)
@@ -1611,42 +2604,113 @@ lsquic_enc_session_encrypt (lsquic_enc_session_t *enc_session,
         }
 
         serialize_fnv128_short(hash, md);
-        memcpy(buf_out, header, header_len);
+        if (buf_out != header)
+            memcpy(buf_out, header, header_len);
         memcpy(buf_out + header_len, md, HS_PKT_HASH_LENGTH);
         memcpy(buf_out + header_len + HS_PKT_HASH_LENGTH, data, data_len);
         return 0;
     }
     else
     {
-        if (enc_session->have_key != 3 || is_shlo ||
-            ((IS_SERVER(enc_session)) &&
-             enc_session->server_start_use_final_key == 0))
-        {
-            LSQ_DEBUG("lsquic_enc_session_encrypt using 'I' key...");
-            key = enc_session->enc_ctx_i;
-            memcpy(nonce, enc_session->enc_key_nonce_i, 4);
-            if (is_shlo && enc_session->have_key == 3)
-            {
-                enc_session->server_start_use_final_key = 1;
-            }
-        }
+        if (buf_out != header)
+            memcpy(buf_out, header, header_len);
+        ret = seal_packet(key, header, header_len, nonce, data, data_len,
+                        buf_out + header_len, max_out_len - header_len,
+                        out_len);
+        *out_len += header_len;
+        return ret;
+    }
+}
+
+
+/* The header occupies the first `header_len' bytes of `buf' and is followed
+ * by `data_len' bytes of payload.  The payload is sealed in place and the
+ * authentication tag is placed after it.
+ */
+static int
+lsquic_enc_session_encrypt_in_place (lsquic_enc_session_t *enc_session,
+               uint8_t path_id, uint64_t pack_num,
+               unsigned char *buf, size_t header_len, size_t data_len,
+               size_t max_out_len, size_t *out_len, int is_hello)
+{
+    uint8_t nonce[12];
+    EVP_AEAD_CTX *key;
+    int ret;
+
+    /* The hash of unencrypted packets precedes the payload.  We do not
+     * bother shifting the payload: there are only a few such packets.
+     */
+    key = select_enc_key(enc_session, path_id, pack_num, is_hello, nonce);
+    if (!key)
+        return 1;
+
+    ret = seal_packet(key, buf, header_len, nonce, buf + header_len,
+                        data_len, buf + header_len, max_out_len - header_len,
+                        out_len);
+    *out_len += header_len;
+    return ret;
+}
+
+
+/* This implementation seals packets one by one.  The engine collects a
+ * batch of packets before calling it, so that crypto is not interleaved
+ * with packet scheduling.
+ */
+static void
+lsquic_enc_session_encrypt_batch (struct enc_op *ops, unsigned n_ops)
+{
+    struct enc_op *op;
+
+    for (op = ops; op < ops + n_ops; ++op)
+        if (op->eo_in_place)
+            op->eo_status = lsquic_enc_session_encrypt_in_place(
+                op->eo_enc_session, 0, op->eo_packno, op->eo_buf,
+                op->eo_header_len, op->eo_data_len, op->eo_buf_sz,
+                &op->eo_out_len, op->eo_is_hello);
         else
-        {
-            LSQ_DEBUG("lsquic_enc_session_encrypt using 'F' key...");
-            key = enc_session->enc_ctx_f;
-            memcpy(nonce, enc_session->enc_key_nonce_f, 4);
-        }
-        path_id_packet_number = combine_path_id_pack_num(path_id, pack_num);
-        memcpy(nonce + 4, &path_id_packet_number,
-               sizeof(path_id_packet_number));
+            op->eo_status = lsquic_enc_session_encrypt(op->eo_enc_session,
+                op->eo_version, 0, op->eo_packno, op->eo_header,
+                op->eo_header_len, op->eo_data, op->eo_data_len, op->eo_buf,
+                op->eo_buf_sz, &op->eo_out_len, op->eo_is_hello);
+}
 
-        memcpy(buf_out, header, header_len);
-        *out_len = max_out_len - header_len;
 
-        ret = aes_aead_enc(key, header, header_len, nonce, 12, data,
-                           data_len, buf_out + header_len, out_len);
-        *out_len += header_len;
-        return ret;
+/* Only the steady state -- both sides use the forward-secure key -- is
+ * handled here.  The packet number is only checked against
+ * peer_final_key_packno, which is not modified: packets with lower
+ * numbers go through decrypt_packet().
+ */
+static void
+lsquic_enc_session_decrypt_batch (struct dec_op *ops, unsigned n_ops)
+{
+    const lsquic_enc_session_t *enc_session;
+    struct dec_op *op;
+    uint64_t path_id_packet_number;
+    uint8_t nonce[12];
+
+    for (op = ops; op < ops + n_ops; ++op)
+    {
+        op->do_enc_level = (enum enc_level) -1;
+        enc_session = op->do_enc_session;
+        if (!(enc_session && enc_session->have_key == 3
+                && enc_session->peer_have_final_key
+                && op->do_packno >= enc_session->peer_final_key_packno
+                && op->do_out_sz >= op->do_header_len + op->do_data_len))
+            continue;
+        path_id_packet_number = combine_path_id_pack_num(0, op->do_packno);
+        memcpy(nonce, enc_session->dec_key_nonce_f, 4);
+        memcpy(nonce + 4, &path_id_packet_number,
+                                            sizeof(path_id_packet_number));
+        memcpy(op->do_out, op->do_buf, op->do_header_len);
+        if (EVP_AEAD_CTX_open(enc_session->dec_ctx_f,
+                op->do_out + op->do_header_len, &op->do_out_len,
+                op->do_out_sz - op->do_header_len, nonce, 12,
+                op->do_buf + op->do_header_len, op->do_data_len,
+                op->do_buf, op->do_header_len))
+        {
+            op->do_out_len += op->do_header_len;
+            op->do_enc_level = ENC_LEV_FORW;
+        }
     }
 }
 
@@ -1802,18 +2866,27 @@ struct enc_session_funcs lsquic_enc_session_gquic_1 =
 {
     .esf_global_init    = lsquic_handshake_init,
     .esf_global_cleanup = lsquic_handshake_cleanup,
+#ifndef WIN32
+    .esf_set_cache_file = lsquic_handshake_set_cache_file,
+#endif
 #if LSQUIC_KEEP_ENC_SESS_HISTORY
     .esf_get_hist       = lsquic_get_enc_hist,
 #endif
     .esf_destroy = lsquic_enc_session_destroy,
     .esf_is_hsk_done = lsquic_enc_session_is_hsk_done,
+    .esf_is_zero_rtt_enabled = lsquic_enc_session_is_zero_rtt_enabled,
     .esf_encrypt = lsquic_enc_session_encrypt,
+    .esf_encrypt_in_place = lsquic_enc_session_encrypt_in_place,
+    .esf_encrypt_batch = lsquic_enc_session_encrypt_batch,
     .esf_decrypt = lsquic_enc_session_decrypt,
+    .esf_decrypt_batch = lsquic_enc_session_decrypt_batch,
     .esf_get_peer_setting = lsquic_enc_session_get_peer_setting,
     .esf_get_peer_option = lsquic_enc_session_get_peer_option,
     .esf_create_client = lsquic_enc_session_create_client,
     .esf_generate_cid = lsquic_generate_cid,
     .esf_gen_chlo = lsquic_enc_session_gen_chlo,
     .esf_handle_chlo_reply = lsquic_enc_session_handle_chlo_reply,
+    .esf_get_cert_chain = lsquic_enc_session_get_cert_chain,
+    .esf_cert_verified = lsquic_enc_session_cert_verified,
     .esf_mem_used = lsquic_enc_session_mem_used,
 };
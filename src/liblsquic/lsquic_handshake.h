@@ -4,6 +4,7 @@
 
 struct lsquic_engine_public;
 struct lsquic_enc_session;
+struct lsquic_cert;
 
 typedef struct lsquic_enc_session lsquic_enc_session_t;
 
@@ -13,6 +14,8 @@ typedef struct lsquic_enc_session lsquic_enc_session_t;
 #define DNONC_LENGTH 32
 #define aes128_key_len 16
 #define aes128_iv_len 4
+#define cc20_key_len 32
+#define max_key_len cc20_key_len
 
 enum handshake_error            /* TODO: rename this enum */
 {
@@ -23,6 +26,7 @@ enum handshake_error            /* TODO: rename this enum */
     HS_SHLO = 0,
     HS_1RTT = 1,
     HS_2RTT = 2,
+    HS_CERT_PENDING = 3,    /* User is verifying the certificate chain */
 };
 
 enum enc_level
@@ -59,6 +63,42 @@ typedef struct lsquic_session_cache_info_st
 #   endif
 #endif
 
+/* One packet to be encrypted using esf_encrypt_batch() */
+struct enc_op
+{
+    lsquic_enc_session_t   *eo_enc_session;
+    uint64_t                eo_packno;
+    /* If `eo_in_place' is set, `eo_header' points to `eo_buf', which
+     * holds the header followed by the payload (`eo_data').  Otherwise,
+     * the packet is written to `eo_buf', as esf_encrypt() would do it.
+     */
+    const unsigned char    *eo_header;
+    const unsigned char    *eo_data;
+    unsigned char          *eo_buf;
+    size_t                  eo_header_len;
+    size_t                  eo_data_len;
+    size_t                  eo_buf_sz;
+    size_t                  eo_out_len;     /* Output: packet size */
+    enum lsquic_version     eo_version;
+    int                     eo_status;      /* Output: see esf_encrypt_batch */
+    unsigned char           eo_is_hello;
+    unsigned char           eo_in_place;
+};
+
+/* One packet to be decrypted using esf_decrypt_batch() */
+struct dec_op
+{
+    lsquic_enc_session_t   *do_enc_session;
+    uint64_t                do_packno;
+    const unsigned char    *do_buf;         /* Header followed by payload */
+    unsigned char          *do_out;         /* Header followed by plaintext */
+    size_t                  do_header_len;
+    size_t                  do_data_len;
+    size_t                  do_out_sz;
+    size_t                  do_out_len;     /* Output: packet size */
+    enum enc_level          do_enc_level;   /* Output: -1 on failure */
+};
+
 #if LSQUIC_KEEP_ENC_SESS_HISTORY
 #define ESHIST_BITS 7
 #define ESHIST_MASK ((1 << ESHIST_BITS) - 1)
@@ -73,6 +113,13 @@ struct enc_session_funcs
     /* Global cleanup: call once per implementation */
     void (*esf_global_cleanup) (void);
 
+#ifndef WIN32
+    /* Client side: use persistent session cache file.  NULL `path' stops
+     * using it.
+     */
+    int (*esf_set_cache_file) (const char *path, unsigned n_entries);
+#endif
+
 #if LSQUIC_KEEP_ENC_SESS_HISTORY
     /* Grab encryption session history */
     void (*esf_get_hist) (const lsquic_enc_session_t *,
@@ -85,6 +132,11 @@ struct enc_session_funcs
     /* Return true if handshake has been completed */
     int (*esf_is_hsk_done)(lsquic_enc_session_t *enc_session);
 
+    /* Return true if initial keys are available before the handshake has
+     * been completed; that is, the client can send 0-RTT data.
+     */
+    int (*esf_is_zero_rtt_enabled) (const lsquic_enc_session_t *);
+
     /* Encrypt buffer */
     int (*esf_encrypt)(lsquic_enc_session_t *enc_session, enum lsquic_version,
                uint8_t path_id, uint64_t pack_num,
@@ -93,10 +145,33 @@ struct enc_session_funcs
                unsigned char *buf_out, size_t max_out_len, size_t *out_len,
                int is_hello);
 
+    /* Encrypt packet in place.  The header occupies the first `header_len'
+     * bytes of `buf' and is followed by `data_len' bytes of payload; there
+     * must be room for the authentication tag after the payload.  Returns
+     * 0 on success, -1 on failure, and 1 if the packet cannot be encrypted
+     * in place, in which case esf_encrypt() should be used instead.
+     */
+    int (*esf_encrypt_in_place)(lsquic_enc_session_t *enc_session,
+               uint8_t path_id, uint64_t pack_num,
+               unsigned char *buf, size_t header_len, size_t data_len,
+               size_t max_out_len, size_t *out_len, int is_hello);
+
+    /* Encrypt several packets.  This is what the engine uses: an
+     * implementation may seal several packets at once.  `eo_status' of
+     * each op is set to the value esf_encrypt() or esf_encrypt_in_place()
+     * would return.  If the engine uses crypto threads, this function may
+     * be called for the same enc session from several threads at once.
+     * It does not log.
+     */
+    void (*esf_encrypt_batch)(struct enc_op *, unsigned n_ops);
+
     /** Decrypt buffer
      *
      * If decryption is successful, decryption level is returned.  Otherwise,
      * the return value is -1.
+     *
+     * `buf_out' may be the same as `buf', in which case the packet is
+     * decrypted in place.
      */
     enum enc_level (*esf_decrypt)(lsquic_enc_session_t *enc_session,
                    enum lsquic_version,
@@ -105,6 +180,15 @@ struct enc_session_funcs
                    unsigned char *diversification_nonce,
                    unsigned char *buf_out, size_t max_out_len, size_t *out_len);
 
+    /* Decrypt several packets using the forward-secure key.  This only
+     * works once the handshake has settled: if a packet would require any
+     * other key, or decryption fails, `do_enc_level' is set to -1 and the
+     * packet is left for esf_decrypt().  The enc session is not modified
+     * and `do_buf' is left intact.  Like esf_encrypt_batch(), this function
+     * may be called from several threads at once and does not log.
+     */
+    void (*esf_decrypt_batch)(struct dec_op *, unsigned n_ops);
+
     /* Get value of setting specified by `tag' */
     int (*esf_get_peer_setting) (const lsquic_enc_session_t *, uint32_t tag,
                                                                 uint32_t *val);
@@ -126,10 +210,28 @@ struct enc_session_funcs
     (*esf_gen_chlo) (lsquic_enc_session_t *, enum lsquic_version,
                                                 uint8_t *buf, size_t *len);
 
+    /* Returns HS_CERT_PENDING if the server sent a new certificate chain
+     * and the user is to verify it.  In that case, the handshake does not
+     * proceed until esf_cert_verified() is called.
+     */
     int
     (*esf_handle_chlo_reply) (lsquic_enc_session_t *,
                                                 const uint8_t *data, int len);
 
+    /* Get certificate chain pending verification, leaf first.  The chain
+     * is valid until esf_cert_verified() is called.  Returns -1 if no
+     * verification is pending.
+     */
+    int
+    (*esf_get_cert_chain) (const lsquic_enc_session_t *,
+                            const struct lsquic_cert **chain, unsigned *n_certs);
+
+    /* Pass result of certificate chain verification.  Returns 0 if the
+     * handshake may proceed and -1 otherwise.
+     */
+    int
+    (*esf_cert_verified) (lsquic_enc_session_t *, int ok);
+
     size_t
     (*esf_mem_used)(lsquic_enc_session_t *);
 };
@@ -151,6 +253,7 @@ typedef struct cert_hash_item_st
     struct lsquic_str*   crts;
     struct lsquic_str*   hashs;
     int         count;
+    unsigned    refcnt;
 } cert_hash_item_t;
 
 #endif
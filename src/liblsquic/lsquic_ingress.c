@@ -0,0 +1,285 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_ingress.c -- Queue of incoming packets filled by other threads
+ *
+ * This is a bounded multi-producer, single-consumer ring.  Each slot has a
+ * sequence number that tells whose turn it is to use the slot: a producer
+ * claims slot at position `pos' when its sequence number is `pos' by
+ * advancing the head atomically; after copying the packet, it sets the
+ * sequence number to `pos + 1', which tells the consumer that the slot is
+ * ready.  The consumer releases the slot by setting its sequence number to
+ * `pos + n_slots', which is the position the slot has on the next turn of
+ * the ring.
+ *
+ * The consumer is woken up using a pipe.  Only the first producer to put
+ * a packet after the consumer drained the queue writes to the pipe.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "lsquic.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_ingress.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_INGRESS
+#include "lsquic_logger.h"
+
+
+/* Number of packets passed to the engine in one call */
+#define INGRESS_BATCH 32
+
+/* Fields written by producers and by the consumer are kept on separate
+ * cache lines.
+ */
+#define CACHE_LINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+
+#define LOAD_ACQ(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+
+struct ingress_slot
+{
+    unsigned                    is_seq;         /* Accessed atomically */
+    unsigned short              is_sz;
+    unsigned char               is_has_local_sa;
+    struct sockaddr_storage     is_local_sa;
+    struct sockaddr_storage     is_peer_sa;
+    void                       *is_peer_ctx;
+    struct timespec             is_received;
+    unsigned char               is_buf[QUIC_MAX_PACKET_SZ];
+} CACHE_ALIGNED;
+
+
+struct ingress
+{
+    /* Set at creation */
+    struct ingress_slot        *ig_slots;
+    unsigned                    ig_mask;
+    int                         ig_pipe[2];
+    /* Producers; accessed atomically */
+    unsigned                    ig_head CACHE_ALIGNED;
+    unsigned                    ig_notified;    /* Pipe written to */
+    /* Consumer */
+    unsigned                    ig_tail CACHE_ALIGNED;
+};
+
+
+static void *
+alloc_aligned (size_t size)
+{
+    void *ptr;
+
+    if (0 == posix_memalign(&ptr, CACHE_LINE, size))
+        return ptr;
+    else
+        return NULL;
+}
+
+
+static int
+set_nonblocking (int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (-1 == flags)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+struct ingress *
+lsquic_ingress_new (unsigned n_slots)
+{
+    struct ingress *ing;
+    unsigned size, i;
+
+    assert(n_slots > 0);
+    for (size = 1; size < n_slots; size <<= 1)
+        ;
+
+    ing = alloc_aligned(sizeof(*ing));
+    if (!ing)
+        return NULL;
+    memset(ing, 0, sizeof(*ing));
+
+    ing->ig_slots = alloc_aligned(sizeof(ing->ig_slots[0]) * size);
+    if (!ing->ig_slots)
+    {
+        free(ing);
+        return NULL;
+    }
+
+    if (0 != pipe(ing->ig_pipe))
+    {
+        LSQ_WARN("cannot create pipe: %s", strerror(errno));
+        free(ing->ig_slots);
+        free(ing);
+        return NULL;
+    }
+    if (0 != set_nonblocking(ing->ig_pipe[0])
+                                || 0 != set_nonblocking(ing->ig_pipe[1]))
+    {
+        LSQ_WARN("cannot make pipe non-blocking: %s", strerror(errno));
+        lsquic_ingress_destroy(ing);
+        return NULL;
+    }
+
+    for (i = 0; i < size; ++i)
+        ing->ig_slots[i].is_seq = i;
+    ing->ig_mask = size - 1;
+
+    LSQ_DEBUG("created ingress queue of %u slots", size);
+    return ing;
+}
+
+
+void
+lsquic_ingress_destroy (struct ingress *ing)
+{
+    close(ing->ig_pipe[0]);
+    close(ing->ig_pipe[1]);
+    free(ing->ig_slots);
+    free(ing);
+}
+
+
+static socklen_t
+sockaddr_len (const struct sockaddr *sa)
+{
+    if (sa->sa_family == AF_INET6)
+        return sizeof(struct sockaddr_in6);
+    else
+        return sizeof(struct sockaddr_in);
+}
+
+
+int
+lsquic_ingress_put (struct ingress *ing, const unsigned char *buf, size_t sz,
+                    const struct sockaddr *local_sa,
+                    const struct sockaddr *peer_sa, void *peer_ctx,
+                    const struct timespec *received)
+{
+    struct ingress_slot *slot;
+    unsigned pos;
+    int diff;
+    const char c = 0;
+
+    if (sz > QUIC_MAX_PACKET_SZ)
+        return -1;
+
+    pos = LOAD_ACQ(&ing->ig_head);
+    for (;;)
+    {
+        slot = &ing->ig_slots[ pos & ing->ig_mask ];
+        diff = (int) (LOAD_ACQ(&slot->is_seq) - pos);
+        if (diff == 0)
+        {
+            if (__sync_bool_compare_and_swap(&ing->ig_head, pos, pos + 1))
+                break;
+        }
+        else if (diff < 0)
+            return -1;      /* Full: consumer has not released the slot */
+        pos = LOAD_ACQ(&ing->ig_head);
+    }
+
+    memcpy(slot->is_buf, buf, sz);
+    slot->is_sz = sz;
+    if (local_sa)
+    {
+        memcpy(&slot->is_local_sa, local_sa, sockaddr_len(local_sa));
+        slot->is_has_local_sa = 1;
+    }
+    else
+        slot->is_has_local_sa = 0;
+    memcpy(&slot->is_peer_sa, peer_sa, sockaddr_len(peer_sa));
+    slot->is_peer_ctx = peer_ctx;
+    if (received)
+        slot->is_received = *received;
+    else
+        (void) clock_gettime(CLOCK_REALTIME, &slot->is_received);
+
+    STORE_REL(&slot->is_seq, pos + 1);
+
+    if (__sync_bool_compare_and_swap(&ing->ig_notified, 0, 1))
+        /* If the pipe is full, the consumer is going to wake up anyway */
+        if (write(ing->ig_pipe[1], &c, 1) < 0 && EAGAIN != errno)
+            LSQ_WARN("cannot write to pipe: %s", strerror(errno));
+
+    return 0;
+}
+
+
+int
+lsquic_ingress_fd (const struct ingress *ing)
+{
+    return ing->ig_pipe[0];
+}
+
+
+unsigned
+lsquic_ingress_drain (struct ingress *ing, ingress_packets_in_f packets_in,
+                                                                void *ctx)
+{
+    struct lsquic_in_spec specs[INGRESS_BATCH];
+    struct ingress_slot *slot;
+    unsigned n, i, total;
+    char buf[0x40];
+
+    while (read(ing->ig_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+    /* Packets put after this point cause another write to the pipe */
+    __atomic_store_n(&ing->ig_notified, 0, __ATOMIC_SEQ_CST);
+
+    total = 0;
+    do
+    {
+        for (n = 0; n < INGRESS_BATCH; ++n)
+        {
+            slot = &ing->ig_slots[ (ing->ig_tail + n) & ing->ig_mask ];
+            if (LOAD_ACQ(&slot->is_seq) != ing->ig_tail + n + 1)
+                break;
+        }
+        if (0 == n)
+            break;
+
+        for (i = 0; i < n; ++i)
+        {
+            slot = &ing->ig_slots[ (ing->ig_tail + i) & ing->ig_mask ];
+            specs[i].buf      = slot->is_buf;
+            specs[i].sz       = slot->is_sz;
+            specs[i].local_sa = slot->is_has_local_sa
+                                ? (struct sockaddr *) &slot->is_local_sa : NULL;
+            specs[i].peer_sa  = (struct sockaddr *) &slot->is_peer_sa;
+            specs[i].peer_ctx = slot->is_peer_ctx;
+            specs[i].segsz    = 0;
+            specs[i].received = &slot->is_received;
+        }
+        packets_in(ctx, specs, n);
+
+        for (i = 0; i < n; ++i)
+        {
+            slot = &ing->ig_slots[ (ing->ig_tail + i) & ing->ig_mask ];
+            STORE_REL(&slot->is_seq, ing->ig_tail + i + ing->ig_mask + 1);
+        }
+        ing->ig_tail += n;
+        total += n;
+    }
+    while (n == INGRESS_BATCH);
+
+    if (total)
+        LSQ_DEBUG("drained %u packet%.*s", total, total != 1, "s");
+    return total;
+}
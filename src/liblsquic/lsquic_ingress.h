@@ -0,0 +1,53 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_ingress.h -- Queue of incoming packets filled by other threads
+ *
+ * Receive threads put packets into the queue and the engine thread takes
+ * them out.  Putting a packet into the queue does not take a lock.
+ */
+
+#ifndef LSQUIC_INGRESS_H
+#define LSQUIC_INGRESS_H
+
+struct ingress;
+struct lsquic_in_spec;
+struct sockaddr;
+struct timespec;
+
+/* Number of slots is rounded up to a power of two.  Returns NULL on
+ * failure.
+ */
+struct ingress *
+lsquic_ingress_new (unsigned n_slots);
+
+void
+lsquic_ingress_destroy (struct ingress *);
+
+/* May be called from any thread.  The packet is copied.  If `received' is
+ * NULL, current wall-clock time is recorded.  Returns 0 on success and -1
+ * if the queue is full or the packet is too large.
+ */
+int
+lsquic_ingress_put (struct ingress *, const unsigned char *buf, size_t sz,
+                    const struct sockaddr *local_sa,
+                    const struct sockaddr *peer_sa, void *peer_ctx,
+                    const struct timespec *received);
+
+/* The descriptor becomes readable when a packet is put into the queue
+ * after the last call to lsquic_ingress_drain().
+ */
+int
+lsquic_ingress_fd (const struct ingress *);
+
+typedef void (*ingress_packets_in_f)(void *ctx,
+                        const struct lsquic_in_spec *, unsigned n_specs);
+
+/* Engine thread only.  Pass queued packets to `packets_in' in batches.
+ * The specs are only valid for the duration of the call.  Returns number
+ * of packets taken out of the queue.
+ */
+unsigned
+lsquic_ingress_drain (struct ingress *, ingress_packets_in_f packets_in,
+                                                                void *ctx);
+
+#endif
@@ -0,0 +1,164 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_kxs_pool.c -- Pool of pre-generated Curve25519 key shares
+ *
+ * Key shares are kept in a ring buffer.  The helper thread goes to sleep
+ * when the ring is full and is woken up when it is half empty.  Key shares
+ * are generated outside of the lock, so that taking a key share out of the
+ * pool never waits for scalar multiplication.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/curve25519.h>
+
+#include "lsquic_kxs_pool.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_KXS_POOL
+#include "lsquic_logger.h"
+
+
+struct key_share
+{
+    unsigned char   ks_priv[32];
+    unsigned char   ks_pub[32];
+};
+
+
+struct kxs_pool
+{
+    pthread_mutex_t             kp_lock;
+    pthread_cond_t              kp_cond;    /* Pool needs refill or stop */
+    pthread_t                   kp_thread;
+    /* The members below are protected by the lock */
+    unsigned                    kp_first;   /* Index of oldest key share */
+    unsigned                    kp_count;   /* Number of key shares */
+    int                         kp_stop;
+    int                         kp_sleeping;
+    /* Immutable after creation */
+    unsigned                    kp_size;
+    struct key_share            kp_shares[0];
+};
+
+
+static void *
+fill_thread (void *arg)
+{
+    struct kxs_pool *const pool = arg;
+    struct key_share share;
+    unsigned idx;
+
+    pthread_mutex_lock(&pool->kp_lock);
+    while (1)
+    {
+        while (!pool->kp_stop && pool->kp_count >= pool->kp_size)
+        {
+            pool->kp_sleeping = 1;
+            pthread_cond_wait(&pool->kp_cond, &pool->kp_lock);
+        }
+        pool->kp_sleeping = 0;
+        if (pool->kp_stop)
+            break;
+        pthread_mutex_unlock(&pool->kp_lock);
+
+        X25519_keypair(share.ks_pub, share.ks_priv);
+
+        pthread_mutex_lock(&pool->kp_lock);
+        assert(pool->kp_count < pool->kp_size);
+        idx = (pool->kp_first + pool->kp_count) % pool->kp_size;
+        pool->kp_shares[idx] = share;
+        ++pool->kp_count;
+    }
+    pthread_mutex_unlock(&pool->kp_lock);
+
+    OPENSSL_cleanse(&share, sizeof(share));
+    return NULL;
+}
+
+
+struct kxs_pool *
+lsquic_kxs_pool_new (unsigned n_shares)
+{
+    struct kxs_pool *pool;
+    int s;
+
+    if (n_shares == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(*pool) + n_shares * sizeof(pool->kp_shares[0]));
+    if (!pool)
+        return NULL;
+
+    pool->kp_size = n_shares;
+    pthread_mutex_init(&pool->kp_lock, NULL);
+    pthread_cond_init(&pool->kp_cond, NULL);
+
+    s = pthread_create(&pool->kp_thread, NULL, fill_thread, pool);
+    if (s != 0)
+    {
+        LSQ_WARN("cannot create thread: %s", strerror(s));
+        pthread_cond_destroy(&pool->kp_cond);
+        pthread_mutex_destroy(&pool->kp_lock);
+        free(pool);
+        return NULL;
+    }
+
+    LSQ_INFO("created key share pool of size %u", n_shares);
+    return pool;
+}
+
+
+void
+lsquic_kxs_pool_destroy (struct kxs_pool *pool)
+{
+    pthread_mutex_lock(&pool->kp_lock);
+    pool->kp_stop = 1;
+    pthread_cond_signal(&pool->kp_cond);
+    pthread_mutex_unlock(&pool->kp_lock);
+
+    pthread_join(pool->kp_thread, NULL);
+
+    pthread_cond_destroy(&pool->kp_cond);
+    pthread_mutex_destroy(&pool->kp_lock);
+    OPENSSL_cleanse(pool->kp_shares, pool->kp_size * sizeof(pool->kp_shares[0]));
+    free(pool);
+}
+
+
+int
+lsquic_kxs_pool_get (struct kxs_pool *pool, unsigned char priv_key[32],
+                                                    unsigned char pub_key[32])
+{
+    struct key_share *share;
+
+    pthread_mutex_lock(&pool->kp_lock);
+    if (pool->kp_count == 0)
+    {
+        pthread_mutex_unlock(&pool->kp_lock);
+        LSQ_DEBUG("pool is empty");
+        return -1;
+    }
+
+    share = &pool->kp_shares[pool->kp_first];
+    memcpy(priv_key, share->ks_priv, sizeof(share->ks_priv));
+    memcpy(pub_key, share->ks_pub, sizeof(share->ks_pub));
+    OPENSSL_cleanse(share, sizeof(*share));
+    pool->kp_first = (pool->kp_first + 1) % pool->kp_size;
+    --pool->kp_count;
+    if (pool->kp_sleeping && pool->kp_count <= pool->kp_size / 2)
+    {
+        pool->kp_sleeping = 0;
+        pthread_cond_signal(&pool->kp_cond);
+    }
+    pthread_mutex_unlock(&pool->kp_lock);
+
+    return 0;
+}
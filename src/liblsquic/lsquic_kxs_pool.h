@@ -0,0 +1,31 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_kxs_pool.h -- Pool of pre-generated Curve25519 key shares
+ *
+ * A helper thread keeps the pool full, so that new connections do not have
+ * to generate their key shares in the engine thread.
+ */
+
+#ifndef LSQUIC_KXS_POOL_H
+#define LSQUIC_KXS_POOL_H
+
+struct kxs_pool;
+
+/* Start helper thread that generates up to `n_shares' key shares.  Returns
+ * NULL on failure.
+ */
+struct kxs_pool *
+lsquic_kxs_pool_new (unsigned n_shares);
+
+void
+lsquic_kxs_pool_destroy (struct kxs_pool *);
+
+/* Take a key share out of the pool.  Returns 0 on success and -1 if the
+ * pool is empty, in which case the caller is to generate the key share
+ * itself.  Each key share is handed out once.
+ */
+int
+lsquic_kxs_pool_get (struct kxs_pool *, unsigned char priv_key[32],
+                                                unsigned char pub_key[32]);
+
+#endif
@@ -72,6 +72,12 @@ enum lsq_log_level lsq_log_levels[N_LSQUIC_LOGGER_MODULES] = {
     [LSQLM_DI]          = LSQ_LOG_WARN,
     [LSQLM_PACER]       = LSQ_LOG_WARN,
     [LSQLM_MIN_HEAP]    = LSQ_LOG_WARN,
+    [LSQLM_UDP_IO]      = LSQ_LOG_WARN,
+    [LSQLM_ENGINE_GROUP]= LSQ_LOG_WARN,
+    [LSQLM_SCACHE]      = LSQ_LOG_WARN,
+    [LSQLM_CRYPTO_POOL] = LSQ_LOG_WARN,
+    [LSQLM_KXS_POOL]    = LSQ_LOG_WARN,
+    [LSQLM_INGRESS]     = LSQ_LOG_WARN,
 };
 
 const char *const lsqlm_to_str[N_LSQUIC_LOGGER_MODULES] = {
@@ -100,6 +106,12 @@ const char *const lsqlm_to_str[N_LSQUIC_LOGGER_MODULES] = {
     [LSQLM_DI]          = "di",
     [LSQLM_PACER]       = "pacer",
     [LSQLM_MIN_HEAP]    = "min-heap",
+    [LSQLM_UDP_IO]      = "udp-io",
+    [LSQLM_ENGINE_GROUP]= "eng-group",
+    [LSQLM_SCACHE]      = "scache",
+    [LSQLM_CRYPTO_POOL] = "crypto-pool",
+    [LSQLM_KXS_POOL]    = "kxs-pool",
+    [LSQLM_INGRESS]     = "ingress",
 };
 
 const char *const lsq_loglevel2str[N_LSQUIC_LOG_LEVELS] = {
@@ -71,6 +71,12 @@ enum lsquic_logger_module {
     LSQLM_DI,
     LSQLM_PACER,
     LSQLM_MIN_HEAP,
+    LSQLM_UDP_IO,
+    LSQLM_ENGINE_GROUP,
+    LSQLM_SCACHE,
+    LSQLM_CRYPTO_POOL,
+    LSQLM_KXS_POOL,
+    LSQLM_INGRESS,
     N_LSQUIC_LOGGER_MODULES
 };
 
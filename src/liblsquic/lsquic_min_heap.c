@@ -10,65 +10,83 @@
 #define LSQUIC_LOGGER_MODULE LSQLM_MIN_HEAP
 #include "lsquic_logger.h"
 
-#define MHE_PARENT(i) ((i - 1) / 2)
-#define MHE_LCHILD(i) (2 * i + 1)
-#define MHE_RCHILD(i) (2 * i + 2)
+/* A 4-ary heap is shallower than a binary heap and the children of each
+ * node are adjacent in memory: sifting down touches fewer cache lines.
+ */
+#define MHE_ARITY 4
+#define MHE_PARENT(i) (((i) - 1) / MHE_ARITY)
+#define MHE_FCHILD(i) (MHE_ARITY * (i) + 1)
 
 
 static void
 heapify_min_heap (struct min_heap *heap, unsigned i)
 {
     struct min_heap_elem el;
-    unsigned smallest;
+    unsigned child, end, smallest;
 
     assert(i < heap->mh_nelem);
 
-    if (MHE_LCHILD(i) < heap->mh_nelem)
+    el = heap->mh_elems[ i ];
+    while ((child = MHE_FCHILD(i)) < heap->mh_nelem)
     {
-        if (heap->mh_elems[ MHE_LCHILD(i) ].mhe_val <
-                                    heap->mh_elems[ i ].mhe_val)
-            smallest = MHE_LCHILD(i);
-        else
-            smallest = i;
-        if (MHE_RCHILD(i) < heap->mh_nelem &&
-            heap->mh_elems[ MHE_RCHILD(i) ].mhe_val <
+        end = child + MHE_ARITY;
+        if (end > heap->mh_nelem)
+            end = heap->mh_nelem;
+        smallest = child;
+        for (++child; child < end; ++child)
+            if (heap->mh_elems[ child ].mhe_val <
                                     heap->mh_elems[ smallest ].mhe_val)
-            smallest = MHE_RCHILD(i);
-    }
-    else
-        smallest = i;
-
-    if (smallest != i)
-    {
-        el = heap->mh_elems[ smallest ];
-        heap->mh_elems[ smallest ] = heap->mh_elems[ i ];
-        heap->mh_elems[ i ] = el;
-        heapify_min_heap(heap, smallest);
+                smallest = child;
+        if (!(heap->mh_elems[ smallest ].mhe_val < el.mhe_val))
+            break;
+        heap->mh_elems[ i ] = heap->mh_elems[ smallest ];
+        i = smallest;
     }
+    heap->mh_elems[ i ] = el;
 }
 
 
 void
 lsquic_mh_insert (struct min_heap *heap, struct lsquic_conn *conn, uint64_t val)
 {
-    struct min_heap_elem el;
     unsigned i;
 
     assert(heap->mh_nelem < heap->mh_nalloc);
 
+    i = heap->mh_nelem++;
+    while (i > 0 && heap->mh_elems[ MHE_PARENT(i) ].mhe_val > val)
+    {
+        heap->mh_elems[ i ] = heap->mh_elems[ MHE_PARENT(i) ];
+        i = MHE_PARENT(i);
+    }
+    heap->mh_elems[ i ].mhe_conn = conn;
+    heap->mh_elems[ i ].mhe_val  = val;
+}
+
+
+void
+lsquic_mh_append (struct min_heap *heap, struct lsquic_conn *conn,
+                                                                uint64_t val)
+{
+    assert(heap->mh_nelem < heap->mh_nalloc);
+
     heap->mh_elems[ heap->mh_nelem ].mhe_conn = conn;
     heap->mh_elems[ heap->mh_nelem ].mhe_val  = val;
     ++heap->mh_nelem;
+}
 
-    i = heap->mh_nelem - 1;
-    while (i > 0 && heap->mh_elems[ MHE_PARENT(i) ].mhe_val >
-                                    heap->mh_elems[ i ].mhe_val)
-    {
-        el = heap->mh_elems[ MHE_PARENT(i) ];
-        heap->mh_elems[ MHE_PARENT(i) ] = heap->mh_elems[ i ];
-        heap->mh_elems[ i ] = el;
-        i = MHE_PARENT(i);
-    }
+
+/* Floyd's method: sift down each internal node, starting with the last one.
+ * This is O(n).
+ */
+void
+lsquic_mh_heapify (struct min_heap *heap)
+{
+    unsigned i;
+
+    if (heap->mh_nelem > 1)
+        for (i = MHE_PARENT(heap->mh_nelem - 1) + 1; i-- > 0; )
+            heapify_min_heap(heap, i);
 }
 
 
@@ -26,6 +26,17 @@ struct min_heap
 void
 lsquic_mh_insert (struct min_heap *, struct lsquic_conn *conn, uint64_t val);
 
+/* Add element to the end of the heap array without restoring the heap
+ * property.  This is for adding many elements at once: call
+ * lsquic_mh_heapify() after the last one, before the heap is popped.
+ */
+void
+lsquic_mh_append (struct min_heap *, struct lsquic_conn *conn, uint64_t val);
+
+/* Rebuild the heap in linear time */
+void
+lsquic_mh_heapify (struct min_heap *);
+
 struct lsquic_conn *
 lsquic_mh_pop (struct min_heap *);
 
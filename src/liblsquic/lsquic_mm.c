@@ -171,7 +171,7 @@ lsquic_mm_put_packet_out (struct lsquic_mm *mm,
     unsigned idx;
 
     assert(packet_out->po_data);
-    pob = (struct packet_out_buf *) packet_out->po_data;
+    pob = (struct packet_out_buf *) (packet_out->po_data - PO_HEADROOM);
     idx = packet_out_index(packet_out->po_n_alloc);
     SLIST_INSERT_HEAD(&mm->packet_out_bufs[idx], pob, next_pob);
     lsquic_malo_put(packet_out);
@@ -200,7 +200,7 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
         SLIST_REMOVE_HEAD(&mm->packet_out_bufs[idx], next_pob);
     else
     {
-        pob = malloc(packet_out_sizes[idx]);
+        pob = malloc(PO_HEADROOM + packet_out_sizes[idx] + PO_TAILROOM);
         if (!pob)
         {
             lsquic_malo_put(packet_out);
@@ -210,7 +210,7 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
 
     memset(packet_out, 0, sizeof(*packet_out));
     packet_out->po_n_alloc = size;
-    packet_out->po_data = (unsigned char *) pob;
+    packet_out->po_data = (unsigned char *) pob + PO_HEADROOM;
 
     return packet_out;
 }
@@ -309,7 +309,7 @@ lsquic_mm_mem_used (const struct lsquic_mm *mm)
 
     for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
         SLIST_FOREACH(pob, &mm->packet_out_bufs[i], next_pob)
-            size += packet_out_sizes[i];
+            size += PO_HEADROOM + packet_out_sizes[i] + PO_TAILROOM;
 
     SLIST_FOREACH(pb, &mm->payload_bufs, next_pb)
         size += 1370;
@@ -274,7 +274,7 @@ lsquic_packet_out_destroy (lsquic_packet_out_t *packet_out,
             lsquic_malo_put(srec_arr);
         }
     }
-    if (packet_out->po_flags & PO_ENCRYPTED)
+    if ((packet_out->po_flags & (PO_ENCRYPTED|PO_INPLACE)) == PO_ENCRYPTED)
         enpub->enp_pmi->pmi_release(enpub->enp_pmi_ctx,
                                                 packet_out->po_enc_data);
     if (packet_out->po_nonce)
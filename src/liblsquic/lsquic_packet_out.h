@@ -67,6 +67,7 @@ typedef struct lsquic_packet_out
 
     enum packet_out_flags {
         PO_HELLO    = (1 << 1),         /* Packet contains SHLO or CHLO data */
+        PO_INPLACE  = (1 << 2),         /* po_enc_data points into po_data buffer */
         PO_ENCRYPTED= (1 << 3),         /* po_enc_data has encrypted data */
         PO_SREC_ARR = (1 << 4),
 #define POBIT_SHIFT 5
@@ -95,6 +96,10 @@ typedef struct lsquic_packet_out
                                          * frames.
                                          */
     unsigned short     po_n_alloc;      /* Total number of bytes allocated in po_data */
+    /* There are PO_HEADROOM bytes before and PO_TAILROOM bytes after
+     * the po_n_alloc bytes of po_data: this lets us encrypt the packet
+     * in place.
+     */
     unsigned char     *po_data;
     lsquic_packno_t    po_ack2ed;       /* If packet has ACK frame, value of
                                          * largest acked in it.
@@ -111,7 +116,9 @@ typedef struct lsquic_packet_out
     }                  po_srecs;
 
     /* If PO_ENCRYPTED is set, this points to the buffer that holds encrypted
-     * data.
+     * data.  If PO_INPLACE is also set, this buffer is not allocated using
+     * pmi_allocate(); instead, it points to the header headroom before
+     * po_data.
      */
     unsigned char     *po_enc_data;
 
@@ -125,6 +132,10 @@ typedef struct lsquic_packet_out
  * in po_flags.  The cost is a bit of complexity.  This will save us four bytes.
  */
 
+/* Room for the largest header before po_data and for the hash after it */
+#define PO_HEADROOM ((QUIC_MAX_PUBHDR_SZ + 7) & ~7)
+#define PO_TAILROOM QUIC_PACKET_HASH_SZ
+
 #define lsquic_packet_out_avail(p) ((unsigned short) \
                                         ((p)->po_n_alloc - (p)->po_data_sz))
 
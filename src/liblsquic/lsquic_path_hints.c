@@ -0,0 +1,209 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_path_hints.c -- What the client learned about a destination
+ *
+ * Hints are kept in a hash keyed by peer address and port.  The number of
+ * hints is bounded; least recently used hint is evicted first.  The cache
+ * belongs to a single engine and is not locked.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#else
+#include <vc_compat.h>
+#include <ws2ipdef.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_hash.h"
+#include "lsquic_path_hints.h"
+
+
+/* Address family, port, and address */
+#define MAX_KEY_SZ (1 + 2 + 16)
+
+struct path_hint_elem
+{
+    TAILQ_ENTRY(path_hint_elem)     phe_next_lru;
+    struct lsquic_hash_elem        *phe_hash_el;
+    struct path_hint                phe_hint;
+    unsigned                        phe_key_sz;
+    unsigned char                   phe_key[MAX_KEY_SZ];
+};
+
+
+struct path_hints
+{
+    struct lsquic_hash                 *ph_hash;
+    TAILQ_HEAD(path_hint_lru, path_hint_elem)
+                                        ph_lru;     /* MRU first */
+    unsigned                            ph_count,
+                                        ph_max;
+};
+
+
+struct path_hints *
+lsquic_path_hints_new (unsigned max_hints)
+{
+    struct path_hints *hints;
+
+    assert(max_hints > 0);
+    hints = malloc(sizeof(*hints));
+    if (!hints)
+        return NULL;
+
+    hints->ph_hash = lsquic_hash_create();
+    if (!hints->ph_hash)
+    {
+        free(hints);
+        return NULL;
+    }
+
+    TAILQ_INIT(&hints->ph_lru);
+    hints->ph_count = 0;
+    hints->ph_max   = max_hints;
+    return hints;
+}
+
+
+void
+lsquic_path_hints_destroy (struct path_hints *hints)
+{
+    struct path_hint_elem *el, *next;
+
+    for (el = TAILQ_FIRST(&hints->ph_lru); el; el = next)
+    {
+        next = TAILQ_NEXT(el, phe_next_lru);
+        free(el);
+    }
+    lsquic_hash_destroy(hints->ph_hash);
+    free(hints);
+}
+
+
+/* Returns key size or zero if address family is not supported */
+static unsigned
+make_key (const struct sockaddr *sa, unsigned char key[MAX_KEY_SZ])
+{
+    const struct sockaddr_in *sa4;
+    const struct sockaddr_in6 *sa6;
+
+    switch (sa->sa_family)
+    {
+    case AF_INET:
+        sa4 = (const struct sockaddr_in *) sa;
+        key[0] = 4;
+        memcpy(key + 1, &sa4->sin_port, 2);
+        memcpy(key + 3, &sa4->sin_addr, 4);
+        return 1 + 2 + 4;
+    case AF_INET6:
+        sa6 = (const struct sockaddr_in6 *) sa;
+        key[0] = 6;
+        memcpy(key + 1, &sa6->sin6_port, 2);
+        memcpy(key + 3, &sa6->sin6_addr, 16);
+        return 1 + 2 + 16;
+    default:
+        return 0;
+    }
+}
+
+
+static struct path_hint_elem *
+find_elem (struct path_hints *hints, const struct sockaddr *sa)
+{
+    struct lsquic_hash_elem *el;
+    unsigned char key[MAX_KEY_SZ];
+    unsigned key_sz;
+
+    key_sz = make_key(sa, key);
+    if (0 == key_sz)
+        return NULL;
+
+    el = lsquic_hash_find(hints->ph_hash, key, key_sz);
+    if (el)
+        return lsquic_hashelem_getdata(el);
+    else
+        return NULL;
+}
+
+
+int
+lsquic_path_hints_get (struct path_hints *hints, const struct sockaddr *sa,
+                                                    struct path_hint *hint)
+{
+    struct path_hint_elem *el;
+
+    el = find_elem(hints, sa);
+    if (!el)
+        return -1;
+
+    TAILQ_REMOVE(&hints->ph_lru, el, phe_next_lru);
+    TAILQ_INSERT_HEAD(&hints->ph_lru, el, phe_next_lru);
+    *hint = el->phe_hint;
+    return 0;
+}
+
+
+static void
+remove_elem (struct path_hints *hints, struct path_hint_elem *el)
+{
+    lsquic_hash_erase(hints->ph_hash, el->phe_hash_el);
+    TAILQ_REMOVE(&hints->ph_lru, el, phe_next_lru);
+    --hints->ph_count;
+    free(el);
+}
+
+
+void
+lsquic_path_hints_put (struct path_hints *hints, const struct sockaddr *sa,
+                                                const struct path_hint *hint)
+{
+    struct path_hint_elem *el;
+
+    el = find_elem(hints, sa);
+    if (el)
+    {
+        TAILQ_REMOVE(&hints->ph_lru, el, phe_next_lru);
+        TAILQ_INSERT_HEAD(&hints->ph_lru, el, phe_next_lru);
+    }
+    else
+    {
+        el = malloc(sizeof(*el));
+        if (!el)
+            return;
+        el->phe_key_sz = make_key(sa, el->phe_key);
+        if (0 == el->phe_key_sz)
+        {
+            free(el);
+            return;
+        }
+        el->phe_hash_el = lsquic_hash_insert(hints->ph_hash, el->phe_key,
+                                                        el->phe_key_sz, el);
+        if (!el->phe_hash_el)
+        {
+            free(el);
+            return;
+        }
+        TAILQ_INSERT_HEAD(&hints->ph_lru, el, phe_next_lru);
+        ++hints->ph_count;
+        while (hints->ph_count > hints->ph_max)
+            remove_elem(hints, TAILQ_LAST(&hints->ph_lru, path_hint_lru));
+    }
+
+    el->phe_hint = *hint;
+    if (el->phe_hint.ph_cwnd > PATH_HINT_MAX_CWND)
+        el->phe_hint.ph_cwnd = PATH_HINT_MAX_CWND;
+}
+
+
+unsigned
+lsquic_path_hints_count (const struct path_hints *hints)
+{
+    return hints->ph_count;
+}
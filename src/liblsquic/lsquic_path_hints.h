@@ -0,0 +1,53 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_path_hints.h -- What the client learned about a destination
+ *
+ * When a client connection is destroyed, the engine records the version
+ * it negotiated, its RTT, congestion window, and packet size.  The next
+ * connection to the same peer address starts with these values instead
+ * of the defaults.
+ */
+
+#ifndef LSQUIC_PATH_HINTS_H
+#define LSQUIC_PATH_HINTS_H
+
+struct path_hints;
+struct sockaddr;
+
+struct path_hint
+{
+    lsquic_time_t           ph_srtt;
+    lsquic_time_t           ph_rttvar;
+    unsigned long           ph_cwnd;
+    enum lsquic_version     ph_version;
+    unsigned short          ph_pack_size;   /* Validated by handshake */
+};
+
+/* Congestion window from earlier connection is never seeded above this
+ * value.
+ */
+#define PATH_HINT_MAX_CWND (256 * 1460)
+
+/* Returns NULL on failure */
+struct path_hints *
+lsquic_path_hints_new (unsigned max_hints);
+
+void
+lsquic_path_hints_destroy (struct path_hints *);
+
+/* Returns 0 if hint for `peer_sa' is found, -1 otherwise */
+int
+lsquic_path_hints_get (struct path_hints *, const struct sockaddr *peer_sa,
+                                                        struct path_hint *);
+
+/* Replace hint for `peer_sa'.  The least recently used hint is evicted
+ * if there are too many hints.
+ */
+void
+lsquic_path_hints_put (struct path_hints *, const struct sockaddr *peer_sa,
+                                                    const struct path_hint *);
+
+unsigned
+lsquic_path_hints_count (const struct path_hints *);
+
+#endif
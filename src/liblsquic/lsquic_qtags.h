@@ -8,6 +8,7 @@
 #define QTAG_AEAD TAG('A', 'E', 'A', 'D')
 #define QTAG_AESG TAG('A', 'E', 'S', 'G')
 #define QTAG_C255 TAG('C', '2', '5', '5')
+#define QTAG_CC20 TAG('C', 'C', '2', '0')
 #define QTAG_CCRT TAG('C', 'C', 'R', 'T')
 #define QTAG_CCS  TAG('C', 'C', 'S',  0 )
 #define QTAG_CFCW TAG('C', 'F', 'C', 'W')
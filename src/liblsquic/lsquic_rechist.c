@@ -74,6 +74,31 @@ lsquic_rechist_received (lsquic_rechist_t *rechist, lsquic_packno_t packno,
 }
 
 
+int
+lsquic_rechist_would_accept (const lsquic_rechist_t *rechist,
+                                                    lsquic_packno_t packno)
+{
+    const struct packet_interval *pi;
+
+    if (packno < rechist->rh_cutoff)
+        /* Packet number zero is an error, not a duplicate: let the caller
+         * find out the usual way.
+         */
+        return 0 == packno;
+
+    /* Intervals are ordered from high to low */
+    TAILQ_FOREACH(pi, &rechist->rh_pints.pk_intervals, next_pi)
+    {
+        if (packno > pi->range.high)
+            return 1;
+        if (packno >= pi->range.low)
+            return 0;
+    }
+
+    return 1;
+}
+
+
 void
 lsquic_rechist_stop_wait (lsquic_rechist_t *rechist, lsquic_packno_t cutoff)
 {
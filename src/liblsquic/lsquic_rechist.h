@@ -42,6 +42,13 @@ enum received_st
 lsquic_rechist_received (lsquic_rechist_t *, lsquic_packno_t,
                          lsquic_time_t now);
 
+/* Returns false if lsquic_rechist_received() is certain to return
+ * REC_ST_DUP for this packet number.  Receive history is not modified.
+ * This is used to drop packets before decrypting them.
+ */
+int
+lsquic_rechist_would_accept (const lsquic_rechist_t *, lsquic_packno_t);
+
 void
 lsquic_rechist_stop_wait (lsquic_rechist_t *, lsquic_packno_t);
 
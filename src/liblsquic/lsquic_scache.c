@@ -0,0 +1,386 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_scache.c -- Persistent session cache
+ *
+ * The file consists of a header followed by fixed-size slots.  The slots
+ * are grouped into sets of SCACHE_N_WAYS; the key hash selects the set.
+ * A new entry goes into an empty or expired slot if there is one;
+ * otherwise, the least recently used entry in the set is replaced.
+ *
+ * Sets are protected by byte-range locks, which, unlike a mutex placed
+ * into the shared mapping, are released by the kernel if the process
+ * holding them dies.  Since these locks are per process, each lock is
+ * also paired with a mutex to serialize threads within the process.
+ * A slot's key size is written last: a slot left half-written by a dead
+ * process looks empty.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lsquic_xxhash.h"
+#include "lsquic_scache.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_SCACHE
+#include "lsquic_logger.h"
+
+#define SCACHE_MAGIC        "LSQSCAC1"
+#define SCACHE_HEADER_SZ    4096
+#define SCACHE_SLOT_SZ      (16 * 1024)
+#define SCACHE_N_WAYS       4
+#define SCACHE_N_LOCKS      64
+/* Lock byte used while the file is being opened and, possibly, created */
+#define SCACHE_INIT_LOCK    SCACHE_N_LOCKS
+
+struct scache_header
+{
+    char                sh_magic[8];
+    uint32_t            sh_slot_sz;
+    uint32_t            sh_n_sets;
+};
+
+struct scache_slot
+{
+    uint64_t            ss_expiry;
+    uint64_t            ss_last_used;
+    uint32_t            ss_key_sz;      /* Zero means slot is empty */
+    uint32_t            ss_data_sz;
+    unsigned char       ss_buf[0];      /* Key followed by data */
+};
+
+typedef char scache_max_entry_fits[
+    sizeof(struct scache_slot) + SCACHE_MAX_ENTRY_SZ <= SCACHE_SLOT_SZ ? 1 : -1];
+
+struct scache
+{
+    unsigned char      *sc_map;
+    size_t              sc_map_sz;
+    int                 sc_fd;
+    unsigned            sc_n_sets;
+    pthread_mutex_t     sc_locks[SCACHE_N_LOCKS];
+};
+
+
+static int
+file_lock (int fd, short type, off_t off)
+{
+    struct flock fl;
+    int s;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start  = off;
+    fl.l_len    = 1;
+    do
+        s = fcntl(fd, F_SETLKW, &fl);
+    while (s < 0 && EINTR == errno);
+    return s;
+}
+
+
+static size_t
+map_size (unsigned n_sets)
+{
+    return SCACHE_HEADER_SZ + (size_t) n_sets * SCACHE_N_WAYS * SCACHE_SLOT_SZ;
+}
+
+
+static int
+header_ok (const struct scache_header *header, size_t file_sz)
+{
+    return 0 == memcmp(header->sh_magic, SCACHE_MAGIC, sizeof(header->sh_magic))
+        && header->sh_slot_sz == SCACHE_SLOT_SZ
+        && header->sh_n_sets > 0
+        && map_size(header->sh_n_sets) == file_sz;
+}
+
+
+struct scache *
+scache_open (const char *path, unsigned n_entries)
+{
+    struct scache *cache;
+    struct scache_header header;
+    struct stat st;
+    ssize_t nread;
+    unsigned n_sets, i;
+    void *map;
+    int fd;
+
+    if (n_entries == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    fd = open(path, O_RDWR|O_CREAT, 0600);
+    if (fd < 0)
+    {
+        LSQ_WARN("cannot open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if (0 != file_lock(fd, F_WRLCK, SCACHE_INIT_LOCK))
+    {
+        LSQ_WARN("cannot lock %s: %s", path, strerror(errno));
+        goto err0;
+    }
+
+    if (0 != fstat(fd, &st))
+        goto err1;
+
+    nread = pread(fd, &header, sizeof(header), 0);
+    if (nread == (ssize_t) sizeof(header)
+                                && header_ok(&header, (size_t) st.st_size))
+    {
+        n_sets = header.sh_n_sets;
+        LSQ_DEBUG("opened existing cache %s with %u sets", path, n_sets);
+    }
+    else
+    {
+        /* New file or one we do not understand: (re)initialize.  The magic
+         * is written last, so that a partially initialized file is not
+         * mistaken for a valid one.
+         */
+        n_sets = (n_entries + SCACHE_N_WAYS - 1) / SCACHE_N_WAYS;
+        if (0 != ftruncate(fd, 0) || 0 != ftruncate(fd, map_size(n_sets)))
+        {
+            LSQ_WARN("cannot size %s: %s", path, strerror(errno));
+            goto err1;
+        }
+        memset(&header, 0, sizeof(header));
+        header.sh_slot_sz = SCACHE_SLOT_SZ;
+        header.sh_n_sets  = n_sets;
+        if ((ssize_t) sizeof(header) != pwrite(fd, &header, sizeof(header), 0))
+            goto err1;
+        if ((ssize_t) sizeof(header.sh_magic) != pwrite(fd, SCACHE_MAGIC,
+                                                sizeof(header.sh_magic), 0))
+            goto err1;
+        LSQ_INFO("created cache %s with %u sets", path, n_sets);
+    }
+
+    map = mmap(NULL, map_size(n_sets), PROT_READ|PROT_WRITE, MAP_SHARED,
+                                                                    fd, 0);
+    if (map == MAP_FAILED)
+    {
+        LSQ_WARN("cannot mmap %s: %s", path, strerror(errno));
+        goto err1;
+    }
+
+    cache = malloc(sizeof(*cache));
+    if (!cache)
+    {
+        munmap(map, map_size(n_sets));
+        goto err1;
+    }
+
+    cache->sc_map    = map;
+    cache->sc_map_sz = map_size(n_sets);
+    cache->sc_fd     = fd;
+    cache->sc_n_sets = n_sets;
+    for (i = 0; i < SCACHE_N_LOCKS; ++i)
+        pthread_mutex_init(&cache->sc_locks[i], NULL);
+
+    (void) file_lock(fd, F_UNLCK, SCACHE_INIT_LOCK);
+    return cache;
+
+  err1:
+    (void) file_lock(fd, F_UNLCK, SCACHE_INIT_LOCK);
+  err0:
+    close(fd);
+    return NULL;
+}
+
+
+void
+scache_close (struct scache *cache)
+{
+    unsigned i;
+
+    munmap(cache->sc_map, cache->sc_map_sz);
+    close(cache->sc_fd);
+    for (i = 0; i < SCACHE_N_LOCKS; ++i)
+        pthread_mutex_destroy(&cache->sc_locks[i]);
+    free(cache);
+}
+
+
+static int
+lock_set (struct scache *cache, unsigned set)
+{
+    const unsigned lock_idx = set % SCACHE_N_LOCKS;
+
+    pthread_mutex_lock(&cache->sc_locks[lock_idx]);
+    if (0 == file_lock(cache->sc_fd, F_WRLCK, lock_idx))
+        return 0;
+    else
+    {
+        LSQ_WARN("cannot lock set %u: %s", set, strerror(errno));
+        pthread_mutex_unlock(&cache->sc_locks[lock_idx]);
+        return -1;
+    }
+}
+
+
+static void
+unlock_set (struct scache *cache, unsigned set)
+{
+    const unsigned lock_idx = set % SCACHE_N_LOCKS;
+
+    (void) file_lock(cache->sc_fd, F_UNLCK, lock_idx);
+    pthread_mutex_unlock(&cache->sc_locks[lock_idx]);
+}
+
+
+static unsigned
+key_to_set (const struct scache *cache, const void *key, unsigned key_sz)
+{
+    /* The seed must be the same in all processes */
+    return XXH64(key, key_sz, 0) % cache->sc_n_sets;
+}
+
+
+static struct scache_slot *
+get_slot (struct scache *cache, unsigned set, unsigned way)
+{
+    return (struct scache_slot *) (cache->sc_map + SCACHE_HEADER_SZ
+                    + ((size_t) set * SCACHE_N_WAYS + way) * SCACHE_SLOT_SZ);
+}
+
+
+static struct scache_slot *
+find_slot (struct scache *cache, unsigned set, const void *key,
+                                                            unsigned key_sz)
+{
+    struct scache_slot *slot;
+    unsigned way;
+
+    for (way = 0; way < SCACHE_N_WAYS; ++way)
+    {
+        slot = get_slot(cache, set, way);
+        if (slot->ss_key_sz == key_sz
+                                && 0 == memcmp(slot->ss_buf, key, key_sz))
+            return slot;
+    }
+
+    return NULL;
+}
+
+
+int
+scache_put (struct scache *cache, const void *key, unsigned key_sz,
+                    const void *data, unsigned data_sz, uint64_t expiry)
+{
+    struct scache_slot *slot, *victim;
+    const uint64_t now = time(NULL);
+    unsigned set, way;
+
+    if (key_sz == 0 || key_sz + (uint64_t) data_sz > SCACHE_MAX_ENTRY_SZ)
+        return -1;
+
+    set = key_to_set(cache, key, key_sz);
+    if (0 != lock_set(cache, set))
+        return -1;
+
+    victim = find_slot(cache, set, key, key_sz);
+    if (!victim)
+        for (way = 0; way < SCACHE_N_WAYS; ++way)
+        {
+            slot = get_slot(cache, set, way);
+            if (slot->ss_key_sz == 0 || slot->ss_expiry < now)
+            {
+                victim = slot;
+                break;
+            }
+            if (!victim || slot->ss_last_used < victim->ss_last_used)
+                victim = slot;
+        }
+
+    victim->ss_key_sz = 0;
+    __sync_synchronize();
+    victim->ss_expiry    = expiry;
+    victim->ss_last_used = now;
+    victim->ss_data_sz   = data_sz;
+    memcpy(victim->ss_buf, key, key_sz);
+    memcpy(victim->ss_buf + key_sz, data, data_sz);
+    __sync_synchronize();
+    victim->ss_key_sz = key_sz;
+
+    unlock_set(cache, set);
+    return 0;
+}
+
+
+int
+scache_get (struct scache *cache, const void *key, unsigned key_sz,
+                    void *buf, unsigned buf_sz, uint64_t now)
+{
+    struct scache_slot *slot;
+    unsigned set;
+    int data_sz;
+
+    if (key_sz == 0)
+        return -1;
+
+    set = key_to_set(cache, key, key_sz);
+    if (0 != lock_set(cache, set))
+        return -1;
+
+    slot = find_slot(cache, set, key, key_sz);
+    if (slot && slot->ss_expiry < now)
+    {
+        slot->ss_key_sz = 0;
+        slot = NULL;
+    }
+    if (slot && slot->ss_data_sz <= buf_sz)
+    {
+        memcpy(buf, slot->ss_buf + key_sz, slot->ss_data_sz);
+        slot->ss_last_used = now;
+        data_sz = (int) slot->ss_data_sz;
+    }
+    else
+        data_sz = -1;
+
+    unlock_set(cache, set);
+    return data_sz;
+}
+
+
+unsigned
+scache_expire (struct scache *cache, uint64_t now)
+{
+    struct scache_slot *slot;
+    unsigned set, way, n_removed;
+
+    n_removed = 0;
+    for (set = 0; set < cache->sc_n_sets; ++set)
+    {
+        if (0 != lock_set(cache, set))
+            break;
+        for (way = 0; way < SCACHE_N_WAYS; ++way)
+        {
+            slot = get_slot(cache, set, way);
+            if (slot->ss_key_sz && slot->ss_expiry < now)
+            {
+                slot->ss_key_sz = 0;
+                ++n_removed;
+            }
+        }
+        unlock_set(cache, set);
+    }
+
+    LSQ_DEBUG("removed %u expired entr%s", n_removed,
+                                                n_removed == 1 ? "y" : "ies");
+    return n_removed;
+}
@@ -0,0 +1,46 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_scache.h -- Persistent session cache
+ *
+ * Memory-mapped file that maps keys (SNI) to opaque blobs.  The file can
+ * be shared by several processes.  Each entry has an expiry time, after
+ * which it is no longer returned.
+ */
+
+#ifndef LSQUIC_SCACHE_H
+#define LSQUIC_SCACHE_H
+
+struct scache;
+
+/* Maximum size of key and data together */
+#define SCACHE_MAX_ENTRY_SZ (16 * 1024 - 32)
+
+/* Open or create cache file.  If the file is created, it is sized to hold
+ * `n_entries' entries; otherwise, the existing size is used.
+ */
+struct scache *
+scache_open (const char *path, unsigned n_entries);
+
+void
+scache_close (struct scache *);
+
+/* Replace existing entry, if any.  `expiry' is Unix time in seconds.
+ * Return 0 on success, -1 if the entry does not fit or the cache could
+ * not be locked.
+ */
+int
+scache_put (struct scache *, const void *key, unsigned key_sz,
+                    const void *data, unsigned data_sz, uint64_t expiry);
+
+/* Copy data into `buf'.  Return data size or -1 if the entry was not found,
+ * has expired, or does not fit into `buf'.
+ */
+int
+scache_get (struct scache *, const void *key, unsigned key_sz,
+                    void *buf, unsigned buf_sz, uint64_t now);
+
+/* Remove entries that expire before `now'.  Return number removed. */
+unsigned
+scache_expire (struct scache *, uint64_t now);
+
+#endif
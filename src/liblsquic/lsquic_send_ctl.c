@@ -66,7 +66,7 @@ static void
 update_for_resending (lsquic_send_ctl_t *ctl, lsquic_packet_out_t *packet_out);
 
 
-enum expire_filter { EXFI_ALL, EXFI_HSK, EXFI_LAST, };
+enum expire_filter { EXFI_ALL, EXFI_HSK, EXFI_LAST, EXFI_ZERO_RTT, };
 
 
 static void
@@ -205,7 +205,7 @@ retx_alarm_rings (void *ctx, lsquic_time_t expiry, lsquic_time_t now)
         /* Do not register cubic loss during handshake */
         break;
     case RETX_MODE_LOSS:
-        send_ctl_detect_losses(ctl, lsquic_time_now());
+        send_ctl_detect_losses(ctl, lsquic_engine_now(ctl->sc_enpub));
         break;
     case RETX_MODE_TLP:
         ++ctl->sc_n_tlp;
@@ -303,7 +303,7 @@ set_retx_alarm (lsquic_send_ctl_t *ctl)
 
     assert(!TAILQ_EMPTY(&ctl->sc_unacked_packets));
 
-    now = lsquic_time_now();
+    now = lsquic_engine_now(ctl->sc_enpub);
 
     rm = get_retx_mode(ctl);
     switch (rm)
@@ -523,9 +523,10 @@ static void
 send_ctl_release_enc_data (struct lsquic_send_ctl *ctl,
                                         struct lsquic_packet_out *packet_out)
 {
-    ctl->sc_enpub->enp_pmi->pmi_release(ctl->sc_enpub->enp_pmi_ctx,
-                                            packet_out->po_enc_data);
-    packet_out->po_flags &= ~PO_ENCRYPTED;
+    if (!(packet_out->po_flags & PO_INPLACE))
+        ctl->sc_enpub->enp_pmi->pmi_release(ctl->sc_enpub->enp_pmi_ctx,
+                                                packet_out->po_enc_data);
+    packet_out->po_flags &= ~(PO_ENCRYPTED|PO_INPLACE);
     packet_out->po_enc_data = NULL;
 }
 
@@ -702,7 +703,7 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
         ctl->sc_flags &= ~SC_WAS_QUIET;
         LSQ_DEBUG("ACK comes after a period of quiescence");
         if (!now)
-            now = lsquic_time_now();
+            now = lsquic_engine_now(ctl->sc_enpub);
         lsquic_cubic_was_quiet(&ctl->sc_cubic, now);
     }
 
@@ -738,7 +739,7 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
                     is the "maximum burst" parameter */
                     < lsquic_cubic_get_cwnd(&ctl->sc_cubic);
             if (!now)
-                now = lsquic_time_now();
+                now = lsquic_engine_now(ctl->sc_enpub);
   after_checks:
             packet_sz = lsquic_packet_out_sent_sz(packet_out);
             ctl->sc_largest_acked_packno    = packet_out->po_packno;
@@ -944,6 +945,7 @@ send_ctl_expire (lsquic_send_ctl_t *ctl, enum expire_filter filter)
         [EXFI_ALL] = "all",
         [EXFI_HSK] = "handshake",
         [EXFI_LAST] = "last",
+        [EXFI_ZERO_RTT] = "0-RTT",
     };
 
     switch (filter)
@@ -963,6 +965,16 @@ send_ctl_expire (lsquic_send_ctl_t *ctl, enum expire_filter filter)
                 n_resubmitted += send_ctl_handle_lost_packet(ctl, packet_out);
         }
         break;
+    case EXFI_ZERO_RTT:
+        n_resubmitted = 0;
+        for (packet_out = TAILQ_FIRST(&ctl->sc_unacked_packets); packet_out;
+                                                            packet_out = next)
+        {
+            next = TAILQ_NEXT(packet_out, po_next);
+            if (!(packet_out->po_flags & PO_HELLO))
+                n_resubmitted += send_ctl_handle_lost_packet(ctl, packet_out);
+        }
+        break;
     case EXFI_LAST:
         packet_out = send_ctl_last_unacked_retx_packet(ctl);
         if (packet_out)
@@ -990,6 +1002,16 @@ lsquic_send_ctl_expire_all (lsquic_send_ctl_t *ctl)
 }
 
 
+void
+lsquic_send_ctl_expire_zero_rtt (lsquic_send_ctl_t *ctl)
+{
+    send_ctl_expire(ctl, EXFI_ZERO_RTT);
+    if (!send_ctl_first_unacked_retx_packet(ctl))
+        lsquic_alarmset_unset(ctl->sc_alset, AL_RETX);
+    lsquic_send_ctl_sanity_check(ctl);
+}
+
+
 #if LSQUIC_EXTRA_CHECKS
 void
 lsquic_send_ctl_sanity_check (const lsquic_send_ctl_t *ctl)
@@ -1002,7 +1024,7 @@ lsquic_send_ctl_sanity_check (const lsquic_send_ctl_t *ctl)
     if (lsquic_alarmset_is_set(ctl->sc_alset, AL_RETX))
     {
         assert(send_ctl_first_unacked_retx_packet(ctl));
-        assert(lsquic_time_now() < ctl->sc_alset->as_expiry[AL_RETX] + MAX_RTO_DELAY);
+        assert(lsquic_engine_now(ctl->sc_enpub) < ctl->sc_alset->as_expiry[AL_RETX] + MAX_RTO_DELAY);
     }
 
     count = 0, bytes = 0;
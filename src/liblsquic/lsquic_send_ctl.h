@@ -135,12 +135,24 @@ lsquic_send_ctl_next_packet_to_send (lsquic_send_ctl_t *);
 void
 lsquic_send_ctl_expire_all (lsquic_send_ctl_t *ctl);
 
+/* Schedule all unacked packets other than handshake packets for
+ * retransmission.  This is used when the server rejects our CHLO: it
+ * cannot decrypt packets sent using 0-RTT keys.
+ */
+void
+lsquic_send_ctl_expire_zero_rtt (lsquic_send_ctl_t *ctl);
+
 #define lsquic_send_ctl_n_in_flight(ctl) (+(ctl)->sc_n_in_flight)
 
 #define lsquic_send_ctl_n_scheduled(ctl) (+(ctl)->sc_n_scheduled)
 
 #define lsquic_send_ctl_largest_ack2ed(ctl) (+(ctl)->sc_largest_ack2ed)
 
+#define lsquic_send_ctl_get_cwnd(ctl) lsquic_cubic_get_cwnd(&(ctl)->sc_cubic)
+
+#define lsquic_send_ctl_seed_cwnd(ctl, cwnd) \
+            lsquic_cubic_seed_cwnd(&(ctl)->sc_cubic, cwnd)
+
 #if LSQUIC_EXTRA_CHECKS
 void
 lsquic_send_ctl_sanity_check (const lsquic_send_ctl_t *ctl);
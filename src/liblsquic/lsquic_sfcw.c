@@ -98,7 +98,7 @@ lsquic_sfcw_fc_offsets_changed (struct lsquic_sfcw *fc)
         return 0;
     }
 
-    now = lsquic_time_now();
+    now = lsquic_engine_now(fc->sf_conn_pub->enpub);
     since_last_update = now - fc->sf_last_updated;
     fc->sf_last_updated = now;
 
@@ -0,0 +1,672 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_udp_io.c -- Built-in UDP I/O
+ *
+ * Packets are read and written in batches using recvmmsg(2) and
+ * sendmmsg(2).  On platforms that do not have these system calls, we
+ * loop over recvmsg(2) and sendmsg(2).
+ */
+
+#if __GNUC__
+#define _GNU_SOURCE     /* For recvmmsg, sendmmsg, and struct in6_pktinfo */
+#endif
+#if defined(__APPLE__)
+#   define __APPLE_USE_RFC_3542 1
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <netinet/in.h>
+#if __linux__
+#include <netinet/udp.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_UDP_IO
+#include "lsquic_logger.h"
+
+#if __linux__
+#   define HAVE_MMSG 1
+#else
+#   define HAVE_MMSG 0
+#endif
+
+#if __linux__ || __APPLE__
+#   define PKTINFO_SZ sizeof(struct in_pktinfo)
+#else
+#   define PKTINFO_SZ sizeof(struct in_addr)
+#endif
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#if __linux__
+#   define NDROPPED_SZ CMSG_SPACE(sizeof(uint32_t))  /* SO_RXQ_OVFL */
+#else
+#   define NDROPPED_SZ 0
+#endif
+
+#if __linux__ && defined(SO_TIMESTAMPNS)
+#   define HAVE_RX_TS 1
+#   define RX_TS_SZ CMSG_SPACE(sizeof(struct timespec))
+#else
+#   define HAVE_RX_TS 0
+#   define RX_TS_SZ 0
+#endif
+
+#if __linux__ && defined(UDP_SEGMENT)
+#   define GSO_CTL_SZ CMSG_SPACE(sizeof(uint16_t))
+#else
+#   define GSO_CTL_SZ 0
+#endif
+
+/* The same control buffer is used for receiving and sending */
+#define CTL_SZ (CMSG_SPACE(MAX(PKTINFO_SZ, sizeof(struct in6_pktinfo))) \
+                                + MAX(NDROPPED_SZ + RX_TS_SZ, GSO_CTL_SZ))
+
+#if !HAVE_MMSG
+/* Some platforms declare struct mmsghdr without providing recvmmsg() and
+ * sendmmsg(): use our own name to avoid the clash.
+ */
+struct uio_mmsghdr
+{
+    struct msghdr   msg_hdr;
+    unsigned        msg_len;
+};
+#define mmsghdr uio_mmsghdr
+#endif
+
+
+struct lsquic_udp_io
+{
+    int                          uio_fd;
+    enum {
+        UIO_BLOCKED     = 1 << 0,
+        UIO_DROP_INIT   = 1 << 1,   /* uio_n_dropped is valid */
+    }                            uio_flags;
+    unsigned                     uio_batch_size;
+    uint32_t                     uio_n_dropped;
+    void                        *uio_peer_ctx;
+    struct sockaddr_storage      uio_local_sa;
+    /* Each of the arrays below has `uio_batch_size' elements */
+    struct mmsghdr              *uio_msgs;
+    struct iovec                *uio_iovs;
+    struct lsquic_in_spec       *uio_specs;
+    struct sockaddr_storage     *uio_peer_sas,
+                                *uio_local_sas;
+    struct timespec             *uio_rx_ts;         /* Kernel timestamps */
+    unsigned char               *uio_ctl_bufs;      /* CTL_SZ each */
+    unsigned char               *uio_packet_bufs;   /* QUIC_MAX_PACKET_SZ each */
+};
+
+
+static int
+enable_pktinfo (int fd, int family)
+{
+    int on = 1;
+
+    if (AF_INET == family)
+        return setsockopt(fd, IPPROTO_IP,
+#if __linux__ || __APPLE__
+                                          IP_PKTINFO,
+#else
+                                          IP_RECVDSTADDR,
+#endif
+                                                      &on, sizeof(on));
+    else
+        return setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on,
+                                                                sizeof(on));
+}
+
+
+struct lsquic_udp_io *
+lsquic_udp_io_new (int fd, unsigned batch_size, void *peer_ctx)
+{
+    struct lsquic_udp_io *io;
+    socklen_t socklen;
+#if __linux__
+    int on;
+#endif
+
+    if (0 == batch_size)
+        batch_size = LSQUIC_DF_UDP_IO_BATCH;
+
+    io = calloc(1, sizeof(*io));
+    if (!io)
+        return NULL;
+
+    socklen = sizeof(io->uio_local_sa);
+    if (0 != getsockname(fd, (struct sockaddr *) &io->uio_local_sa, &socklen))
+    {
+        LSQ_WARN("getsockname failed: %s", strerror(errno));
+        goto err;
+    }
+
+    if (!(AF_INET == io->uio_local_sa.ss_family
+                            || AF_INET6 == io->uio_local_sa.ss_family))
+    {
+        LSQ_WARN("unsupported address family %d",
+                                            io->uio_local_sa.ss_family);
+        errno = EAFNOSUPPORT;
+        goto err;
+    }
+
+    if (0 != enable_pktinfo(fd, io->uio_local_sa.ss_family))
+    {
+        LSQ_WARN("cannot enable packet info: %s", strerror(errno));
+        goto err;
+    }
+
+#if __linux__
+    on = 1;
+    if (0 != setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)))
+        LSQ_INFO("cannot set SO_RXQ_OVFL: %s", strerror(errno));
+#endif
+#if HAVE_RX_TS
+    /* Packets are stamped with the time they arrived.  This way, the time
+     * they spend in the socket buffer does not count toward RTT samples.
+     */
+    on = 1;
+    if (0 != setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)))
+        LSQ_INFO("cannot set SO_TIMESTAMPNS: %s", strerror(errno));
+#endif
+
+    io->uio_fd         = fd;
+    io->uio_batch_size = batch_size;
+    io->uio_peer_ctx   = peer_ctx ? peer_ctx : io;
+    io->uio_msgs       = malloc(batch_size * sizeof(io->uio_msgs[0]));
+    io->uio_iovs       = malloc(batch_size * sizeof(io->uio_iovs[0]));
+    io->uio_specs      = malloc(batch_size * sizeof(io->uio_specs[0]));
+    io->uio_peer_sas   = malloc(batch_size * sizeof(io->uio_peer_sas[0]));
+    io->uio_local_sas  = malloc(batch_size * sizeof(io->uio_local_sas[0]));
+    io->uio_rx_ts      = malloc(batch_size * sizeof(io->uio_rx_ts[0]));
+    io->uio_ctl_bufs   = malloc(batch_size * CTL_SZ);
+    io->uio_packet_bufs = malloc(batch_size * QUIC_MAX_PACKET_SZ);
+    if (!(io->uio_msgs && io->uio_iovs && io->uio_specs && io->uio_peer_sas
+            && io->uio_local_sas && io->uio_rx_ts && io->uio_ctl_bufs
+            && io->uio_packet_bufs))
+        goto err;
+
+    LSQ_DEBUG("created UDP I/O object for fd %d, batch size: %u", fd,
+                                                                batch_size);
+    return io;
+
+  err:
+    lsquic_udp_io_destroy(io);
+    return NULL;
+}
+
+
+void
+lsquic_udp_io_destroy (struct lsquic_udp_io *io)
+{
+    free(io->uio_msgs);
+    free(io->uio_iovs);
+    free(io->uio_specs);
+    free(io->uio_peer_sas);
+    free(io->uio_local_sas);
+    free(io->uio_rx_ts);
+    free(io->uio_ctl_bufs);
+    free(io->uio_packet_bufs);
+    free(io);
+}
+
+
+#if HAVE_MMSG
+#define recv_msgs(io, n) recvmmsg((io)->uio_fd, (io)->uio_msgs, n, 0, NULL)
+#define send_msgs(io, n) sendmmsg((io)->uio_fd, (io)->uio_msgs, n, 0)
+#else
+static int
+recv_msgs (struct lsquic_udp_io *io, unsigned n_msgs)
+{
+    ssize_t nread;
+    unsigned n;
+
+    for (n = 0; n < n_msgs; ++n)
+    {
+        nread = recvmsg(io->uio_fd, &io->uio_msgs[n].msg_hdr, 0);
+        if (nread < 0)
+            break;
+        io->uio_msgs[n].msg_len = (unsigned) nread;
+    }
+
+    return n > 0 ? (int) n : -1;
+}
+
+
+static int
+send_msgs (struct lsquic_udp_io *io, unsigned n_msgs)
+{
+    ssize_t nwritten;
+    unsigned n;
+
+    for (n = 0; n < n_msgs; ++n)
+    {
+        nwritten = sendmsg(io->uio_fd, &io->uio_msgs[n].msg_hdr, 0);
+        if (nwritten < 0)
+            break;
+        io->uio_msgs[n].msg_len = (unsigned) nwritten;
+    }
+
+    return n > 0 ? (int) n : -1;
+}
+
+
+#endif
+/* Replace IP address part of `storage' with that provided in ancillary
+ * messages in `msg'.  Returns true if receive timestamp was found and
+ * placed into `ts'.
+ */
+static int
+proc_ancillary (struct lsquic_udp_io *io, struct msghdr *msg,
+                struct sockaddr_storage *storage, struct timespec *ts)
+{
+    int have_ts = 0;
+    const struct in6_pktinfo *in6_pkt;
+    struct cmsghdr *cmsg;
+#if __linux__
+    uint32_t n_dropped;
+#endif
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (cmsg->cmsg_level == IPPROTO_IP &&
+            cmsg->cmsg_type  ==
+#if __linux__ || __APPLE__
+                                IP_PKTINFO
+#else
+                                IP_RECVDSTADDR
+#endif
+                                              )
+        {
+#if __linux__ || __APPLE__
+            const struct in_pktinfo *in_pkt;
+            in_pkt = (void *) CMSG_DATA(cmsg);
+            ((struct sockaddr_in *) storage)->sin_addr = in_pkt->ipi_addr;
+#else
+            memcpy(&((struct sockaddr_in *) storage)->sin_addr,
+                            CMSG_DATA(cmsg), sizeof(struct in_addr));
+#endif
+        }
+        else if (cmsg->cmsg_level == IPPROTO_IPV6 &&
+                 cmsg->cmsg_type  == IPV6_PKTINFO)
+        {
+            in6_pkt = (void *) CMSG_DATA(cmsg);
+            ((struct sockaddr_in6 *) storage)->sin6_addr =
+                                                    in6_pkt->ipi6_addr;
+        }
+#if __linux__
+        else if (cmsg->cmsg_level == SOL_SOCKET &&
+                 cmsg->cmsg_type  == SO_RXQ_OVFL)
+        {
+            memcpy(&n_dropped, CMSG_DATA(cmsg), sizeof(n_dropped));
+            if ((io->uio_flags & UIO_DROP_INIT)
+                                        && io->uio_n_dropped < n_dropped)
+                LSQ_INFO("dropped %u packets",
+                                        n_dropped - io->uio_n_dropped);
+            io->uio_n_dropped = n_dropped;
+            io->uio_flags |= UIO_DROP_INIT;
+        }
+#endif
+#if HAVE_RX_TS
+        else if (cmsg->cmsg_level == SOL_SOCKET &&
+                 cmsg->cmsg_type  == SO_TIMESTAMPNS)
+        {
+            memcpy(ts, CMSG_DATA(cmsg), sizeof(*ts));
+            have_ts = 1;
+        }
+#endif
+    }
+
+    return have_ts;
+}
+
+
+static void
+put_read_bufs (struct lsquic_udp_io *io, lsquic_engine_t *engine,
+                                                unsigned from, unsigned to)
+{
+    unsigned n;
+
+    for (n = from; n < to; ++n)
+        lsquic_engine_put_packet_in_buf(engine, io->uio_iovs[n].iov_base);
+}
+
+
+/* Packets are read straight into the engine's buffers, which the engine
+ * then takes over and decrypts in place.  If the engine cannot give us
+ * enough buffers, we read into our own.  Returns true if the buffers
+ * belong to the engine.
+ */
+static int
+prepare_read (struct lsquic_udp_io *io, lsquic_engine_t *engine)
+{
+    struct msghdr *msg;
+    unsigned n;
+    int own;
+
+    own = 1;
+    for (n = 0; n < io->uio_batch_size; ++n)
+    {
+        io->uio_iovs[n].iov_base = lsquic_engine_get_packet_in_buf(engine);
+        if (!io->uio_iovs[n].iov_base)
+        {
+            put_read_bufs(io, engine, 0, n);
+            own = 0;
+            break;
+        }
+    }
+
+    for (n = 0; n < io->uio_batch_size; ++n)
+    {
+        if (!own)
+            io->uio_iovs[n].iov_base = io->uio_packet_bufs
+                                                + n * QUIC_MAX_PACKET_SZ;
+        io->uio_iovs[n].iov_len  = QUIC_MAX_PACKET_SZ;
+        msg = &io->uio_msgs[n].msg_hdr;
+        msg->msg_name       = &io->uio_peer_sas[n];
+        msg->msg_namelen    = sizeof(io->uio_peer_sas[n]);
+        msg->msg_iov        = &io->uio_iovs[n];
+        msg->msg_iovlen     = 1;
+        msg->msg_control    = io->uio_ctl_bufs + n * CTL_SZ;
+        msg->msg_controllen = CTL_SZ;
+        msg->msg_flags      = 0;
+    }
+
+    return own;
+}
+
+
+int
+lsquic_udp_io_read (struct lsquic_udp_io *io, lsquic_engine_t *engine)
+{
+    struct msghdr *msg;
+    unsigned n, n_specs, n_read, n_batches;
+    int s, own;
+
+    n_read = 0;
+    n_batches = 0;
+
+    for (;;)
+    {
+        own = prepare_read(io, engine);
+        s = recv_msgs(io, io->uio_batch_size);
+        if (s < 0 && own)
+            put_read_bufs(io, engine, 0, io->uio_batch_size);
+        if (s < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            if (!(EAGAIN == errno || EWOULDBLOCK == errno))
+            {
+                LSQ_ERROR("recvmsg: %s", strerror(errno));
+                if (0 == n_read)
+                    return -1;
+            }
+            break;
+        }
+
+        n_specs = 0;
+        for (n = 0; n < (unsigned) s; ++n)
+        {
+            msg = &io->uio_msgs[n].msg_hdr;
+            if (msg->msg_flags & MSG_TRUNC)
+            {
+                LSQ_INFO("packet truncated: drop it");
+                if (own)
+                    put_read_bufs(io, engine, n, n + 1);
+                continue;
+            }
+            if (0 == io->uio_msgs[n].msg_len)
+            {
+                LSQ_DEBUG("empty datagram: drop it");
+                if (own)
+                    put_read_bufs(io, engine, n, n + 1);
+                continue;
+            }
+            io->uio_local_sas[n] = io->uio_local_sa;
+            if (proc_ancillary(io, msg, &io->uio_local_sas[n],
+                                                        &io->uio_rx_ts[n]))
+                io->uio_specs[n_specs].received = &io->uio_rx_ts[n];
+            else
+                io->uio_specs[n_specs].received = NULL;
+            io->uio_specs[n_specs].buf      = io->uio_iovs[n].iov_base;
+            io->uio_specs[n_specs].sz       = io->uio_msgs[n].msg_len;
+            io->uio_specs[n_specs].local_sa
+                                = (struct sockaddr *) &io->uio_local_sas[n];
+            io->uio_specs[n_specs].peer_sa
+                                = (struct sockaddr *) &io->uio_peer_sas[n];
+            io->uio_specs[n_specs].peer_ctx = io->uio_peer_ctx;
+            io->uio_specs[n_specs].segsz    = 0;
+            ++n_specs;
+        }
+
+        if (own)
+        {
+            put_read_bufs(io, engine, (unsigned) s, io->uio_batch_size);
+            (void) lsquic_engine_packets_in_owned(engine, io->uio_specs,
+                                                                    n_specs);
+        }
+        else
+            (void) lsquic_engine_packets_in(engine, io->uio_specs, n_specs);
+        n_read += (unsigned) s;
+        ++n_batches;
+        if ((unsigned) s < io->uio_batch_size)
+            break;
+    }
+
+    LSQ_DEBUG("read %u packet%.*s in %u batch%s", n_read, n_read != 1, "s",
+                                    n_batches, n_batches != 1 ? "es" : "");
+    return (int) n_read;
+}
+
+
+static void
+setup_control_msg (struct msghdr *msg, const struct lsquic_out_spec *spec,
+                                                        unsigned char *buf)
+{
+    struct cmsghdr *cmsg;
+    const struct sockaddr_in *local_sa;
+    const struct sockaddr_in6 *local_sa6;
+#if __linux__ || __APPLE__
+    struct in_pktinfo info;
+#endif
+    struct in6_pktinfo info6;
+    size_t len;
+#if __linux__ && defined(UDP_SEGMENT)
+    uint16_t segsz;
+#endif
+
+    /* Zero out the buffer: CMSG_NXTHDR() looks at the next header */
+    memset(buf, 0, CTL_SZ);
+    msg->msg_control    = buf;
+    msg->msg_controllen = CTL_SZ;
+    cmsg = CMSG_FIRSTHDR(msg);
+    len = 0;
+
+    /* The local address is only known once the peer has sent us something.
+     * Until then, the kernel picks the source address.
+     */
+    if (spec->local_sa->sa_family != spec->dest_sa->sa_family)
+        ;
+    else if (AF_INET == spec->dest_sa->sa_family)
+    {
+        local_sa = (const struct sockaddr_in *) spec->local_sa;
+#if __linux__ || __APPLE__
+        memset(&info, 0, sizeof(info));
+        info.ipi_spec_dst = local_sa->sin_addr;
+        cmsg->cmsg_level    = IPPROTO_IP;
+        cmsg->cmsg_type     = IP_PKTINFO;
+        cmsg->cmsg_len      = CMSG_LEN(sizeof(info));
+        memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+        len += CMSG_SPACE(sizeof(info));
+#else
+        cmsg->cmsg_level    = IPPROTO_IP;
+        cmsg->cmsg_type     = IP_SENDSRCADDR;
+        cmsg->cmsg_len      = CMSG_LEN(sizeof(local_sa->sin_addr));
+        memcpy(CMSG_DATA(cmsg), &local_sa->sin_addr,
+                                            sizeof(local_sa->sin_addr));
+        len += CMSG_SPACE(sizeof(local_sa->sin_addr));
+#endif
+        cmsg = CMSG_NXTHDR(msg, cmsg);
+    }
+    else
+    {
+        local_sa6 = (const struct sockaddr_in6 *) spec->local_sa;
+        memset(&info6, 0, sizeof(info6));
+        info6.ipi6_addr = local_sa6->sin6_addr;
+        cmsg->cmsg_level    = IPPROTO_IPV6;
+        cmsg->cmsg_type     = IPV6_PKTINFO;
+        cmsg->cmsg_len      = CMSG_LEN(sizeof(info6));
+        memcpy(CMSG_DATA(cmsg), &info6, sizeof(info6));
+        len += CMSG_SPACE(sizeof(info6));
+        cmsg = CMSG_NXTHDR(msg, cmsg);
+    }
+
+#if __linux__ && defined(UDP_SEGMENT)
+    if (spec->segsz)
+    {
+        assert(cmsg);
+        segsz = spec->segsz;
+        cmsg->cmsg_level    = SOL_UDP;
+        cmsg->cmsg_type     = UDP_SEGMENT;
+        cmsg->cmsg_len      = CMSG_LEN(sizeof(segsz));
+        memcpy(CMSG_DATA(cmsg), &segsz, sizeof(segsz));
+        len += CMSG_SPACE(sizeof(segsz));
+    }
+#endif
+
+    if (len)
+        msg->msg_controllen = len;
+    else
+    {
+        msg->msg_control    = NULL;
+        msg->msg_controllen = 0;
+    }
+}
+
+
+static void
+prepare_write (struct lsquic_udp_io *io, const struct lsquic_out_spec *specs,
+                                                                unsigned count)
+{
+    struct msghdr *msg;
+    unsigned n;
+
+    for (n = 0; n < count; ++n)
+    {
+        io->uio_iovs[n].iov_base = (void *) specs[n].buf;
+        io->uio_iovs[n].iov_len  = specs[n].sz;
+        msg = &io->uio_msgs[n].msg_hdr;
+        msg->msg_name       = (void *) specs[n].dest_sa;
+        msg->msg_namelen    = (AF_INET == specs[n].dest_sa->sa_family ?
+                                            sizeof(struct sockaddr_in) :
+                                            sizeof(struct sockaddr_in6));
+        msg->msg_iov        = &io->uio_iovs[n];
+        msg->msg_iovlen     = 1;
+        msg->msg_flags      = 0;
+        setup_control_msg(msg, &specs[n], io->uio_ctl_bufs + n * CTL_SZ);
+    }
+}
+
+
+int
+lsquic_udp_io_send (struct lsquic_udp_io *io,
+                    const struct lsquic_out_spec *specs, unsigned count)
+{
+    unsigned n_sent, n_to_send;
+    int s;
+
+    io->uio_flags &= ~UIO_BLOCKED;
+    n_sent = 0;
+    while (n_sent < count)
+    {
+        n_to_send = count - n_sent;
+        if (n_to_send > io->uio_batch_size)
+            n_to_send = io->uio_batch_size;
+        prepare_write(io, specs + n_sent, n_to_send);
+        s = send_msgs(io, n_to_send);
+        if (s > 0)
+            n_sent += (unsigned) s;
+        else if (EINTR == errno)
+            continue;
+        else if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno)
+        {
+            LSQ_DEBUG("socket would block after sending %u packet%.*s",
+                                                n_sent, n_sent != 1, "s");
+            io->uio_flags |= UIO_BLOCKED;
+            break;
+        }
+        else
+        {
+            /* Retrying is not going to help: count the packet as sent.  It
+             * will be retransmitted if it carries anything of value.
+             */
+            LSQ_INFO("sendmsg failed: %s; drop packet", strerror(errno));
+            ++n_sent;
+        }
+    }
+
+    if (n_sent > 0 || 0 == count)
+        return (int) n_sent;
+    else
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+}
+
+
+int
+lsquic_udp_io_packets_out (void *packets_out_ctx,
+                    const struct lsquic_out_spec *specs, unsigned count)
+{
+    struct lsquic_udp_io *io;
+    unsigned n_sent, n;
+    int s;
+
+    n_sent = 0;
+    while (n_sent < count)
+    {
+        /* Send consecutive specs that go out of the same socket together */
+        io = specs[n_sent].peer_ctx;
+        for (n = n_sent + 1; n < count && specs[n].peer_ctx == io; ++n)
+            ;
+        s = lsquic_udp_io_send(io, specs + n_sent, n - n_sent);
+        if (s < 0)
+            break;
+        n_sent += (unsigned) s;
+        if (n_sent < n)
+            break;
+    }
+
+    if (n_sent > 0 || 0 == count)
+        return (int) n_sent;
+    else
+        return -1;
+}
+
+
+int
+lsquic_udp_io_blocked (const struct lsquic_udp_io *io)
+{
+    return (io->uio_flags & UIO_BLOCKED) > 0;
+}
+
+
+void
+lsquic_udp_io_write_ready (struct lsquic_udp_io *io, lsquic_engine_t *engine)
+{
+    io->uio_flags &= ~UIO_BLOCKED;
+    lsquic_engine_send_unsent_packets(engine);
+}
@@ -72,6 +72,21 @@ lsquic_time_now (void)
 }
 
 
+lsquic_time_t
+lsquic_time_now_real (void)
+{
+#ifndef WIN32
+    struct timeval tv;
+    (void) gettimeofday(&tv, NULL);
+    return (lsquic_time_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#else
+    struct timespec ts;
+    (void) timespec_get(&ts, TIME_UTC);
+    return (lsquic_time_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+
 int
 lsquic_is_zero (const void *pbuf, size_t bufsz)
 {
@@ -13,6 +13,12 @@ extern "C" {
 lsquic_time_t
 lsquic_time_now (void);
 
+/* Wall-clock time in microseconds since the Epoch.  Only used to convert
+ * timestamps supplied by the user to lsquic_time_now() time.
+ */
+lsquic_time_t
+lsquic_time_now_real (void);
+
 void
 lsquic_init_timers (void);
 
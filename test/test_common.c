@@ -54,43 +54,27 @@
 #   define CHAR_CAST (char *)
 #endif
 
-#if __linux__
-#   define NDROPPED_SZ CMSG_SPACE(sizeof(uint32_t))  /* SO_RXQ_OVFL */
-#else
-#   define NDROPPED_SZ 0
-#endif
-
-#if __linux__ && defined(IP_RECVORIGDSTADDR)
-#   define DST_MSG_SZ sizeof(struct sockaddr_in)
-#elif WIN32
-#   define DST_MSG_SZ sizeof(struct sockaddr_in)
-#elif __linux__
-#   define DST_MSG_SZ sizeof(struct in_pktinfo)
-#else
-#   define DST_MSG_SZ sizeof(struct sockaddr_in)
-#endif
-
 #define MAX_PACKET_SZ 1370
 
-#define CTL_SZ (CMSG_SPACE(MAX(DST_MSG_SZ, \
-                                sizeof(struct in6_pktinfo))) + NDROPPED_SZ)
+#ifdef WIN32
+#define CTL_SZ (CMSG_SPACE(MAX(sizeof(struct sockaddr_in), \
+                                sizeof(struct in6_pktinfo))))
 
-/* There are `n_alloc' elements in `vecs', `local_addresses', and
+/* There are `n_alloc' elements in `vecs', `specs', `local_addresses', and
  * `peer_addresses' arrays.  `ctlmsg_data' is n_alloc * CTL_SZ.  Each packets
  * gets a single `vecs' element that points somewhere into `packet_data'.
  *
  * `n_alloc' is calculated at run-time based on the socket's receive buffer
  * size.
+ *
+ * On other platforms, lsquic_udp_io is used instead.
  */
 struct packets_in
 {
     unsigned char           *packet_data;
     unsigned char           *ctlmsg_data;
-#ifndef WIN32
-    struct iovec            *vecs;
-#else
     WSABUF                  *vecs;
-#endif
+    struct lsquic_in_spec   *specs;
     struct sockaddr_storage *local_addresses,
                             *peer_addresses;
     unsigned                 n_alloc;
@@ -98,7 +82,6 @@ struct packets_in
 };
 
 
-#if WIN32
 LPFN_WSARECVMSG pfnWSARecvMsg;
 GUID recvGuid = WSAID_WSARECVMSG;
 LPFN_WSASENDMSG pfnWSASendMsg;
@@ -145,9 +128,6 @@ static void getExtensionPtrs()
 }
 
 
-#endif
-
-
 static struct packets_in *
 allocate_packets_in (SOCKET_TYPE fd)
 {
@@ -173,6 +153,7 @@ allocate_packets_in (SOCKET_TYPE fd)
     packs_in->packet_data = malloc(recvsz);
     packs_in->ctlmsg_data = malloc(n_alloc * CTL_SZ);
     packs_in->vecs = malloc(n_alloc * sizeof(packs_in->vecs[0]));
+    packs_in->specs = malloc(n_alloc * sizeof(packs_in->specs[0]));
     packs_in->local_addresses = malloc(n_alloc * sizeof(packs_in->local_addresses[0]));
     packs_in->peer_addresses = malloc(n_alloc * sizeof(packs_in->peer_addresses[0]));
 
@@ -187,11 +168,14 @@ free_packets_in (struct packets_in *packs_in)
     free(packs_in->local_addresses);
     free(packs_in->ctlmsg_data);
     free(packs_in->vecs);
+    free(packs_in->specs);
     free(packs_in->packet_data);
     free(packs_in);
 }
 
 
+#endif
+
 void
 sport_destroy (struct service_port *sport)
 {
@@ -202,8 +186,13 @@ sport_destroy (struct service_port *sport)
     }
     if (sport->fd >= 0)
         (void) CLOSE_SOCKET(sport->fd);
+#ifndef WIN32
+    if (sport->sp_io)
+        lsquic_udp_io_destroy(sport->sp_io);
+#else
     if (sport->packs_in)
         free_packets_in(sport->packs_in);
+#endif
     free(sport);
 }
 
@@ -223,12 +212,12 @@ sport_new (const char *optarg, struct prog *prog)
     int port, e;
     const char *host;
     struct addrinfo hints, *res = NULL;
-#if __linux__
-    sport->n_dropped = 0;
-    sport->drop_init = 0;
-#endif
     sport->ev = NULL;
+#ifndef WIN32
+    sport->sp_io = NULL;
+#else
     sport->packs_in = NULL;
+#endif
     sport->fd = -1;
     char *const addr = strdup(optarg);
 #if __linux__
@@ -378,69 +367,32 @@ sport_new (const char *optarg, struct prog *prog)
 }
 
 
+#ifdef WIN32
 /* Replace IP address part of `sa' with that provided in ancillary messages
  * in `msg'.
  */
 static void
-proc_ancillary (
-#ifndef WIN32
-                struct msghdr
-#else
-                WSAMSG
-#endif
-                              *msg, struct sockaddr_storage *storage
-#if __linux__
-                , uint32_t *n_dropped
-#endif
-                )
+proc_ancillary (WSAMSG *msg, struct sockaddr_storage *storage)
 {
+    const struct in_pktinfo *in_pkt;
     const struct in6_pktinfo *in6_pkt;
     struct cmsghdr *cmsg;
 
     for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
     {
         if (cmsg->cmsg_level == IPPROTO_IP &&
-            cmsg->cmsg_type  ==
-#if __linux__ && defined(IP_RECVORIGDSTADDR)
-                                IP_ORIGDSTADDR
-#elif __linux__ || WIN32
-                                IP_PKTINFO
-#else
-                                IP_RECVDSTADDR
-#endif
-                                              )
+            cmsg->cmsg_type  == IP_PKTINFO)
         {
-#if __linux__ && defined(IP_RECVORIGDSTADDR)
-            memcpy(storage, CMSG_DATA(cmsg), sizeof(struct sockaddr_in));
-#elif WIN32
-            const struct in_pktinfo *in_pkt;
             in_pkt = (void *) WSA_CMSG_DATA(cmsg);
             ((struct sockaddr_in *) storage)->sin_addr = in_pkt->ipi_addr;
-#elif __linux__
-            const struct in_pktinfo *in_pkt;
-            in_pkt = (void *) CMSG_DATA(cmsg);
-            ((struct sockaddr_in *) storage)->sin_addr = in_pkt->ipi_addr;
-#else
-            memcpy(&((struct sockaddr_in *) storage)->sin_addr,
-                            CMSG_DATA(cmsg), sizeof(struct in_addr));
-#endif
         }
         else if (cmsg->cmsg_level == IPPROTO_IPV6 &&
                  cmsg->cmsg_type  == IPV6_PKTINFO)
         {
-#ifndef WIN32
-            in6_pkt = (void *) CMSG_DATA(cmsg);
-#else
             in6_pkt = (void *) WSA_CMSG_DATA(cmsg);
-#endif
             ((struct sockaddr_in6 *) storage)->sin6_addr =
                                                     in6_pkt->ipi6_addr;
         }
-#if __linux__
-        else if (cmsg->cmsg_level == SOL_SOCKET &&
-                 cmsg->cmsg_type  == SO_RXQ_OVFL)
-            memcpy(n_dropped, CMSG_DATA(cmsg), sizeof(*n_dropped));
-#endif
     }
 }
 
@@ -460,15 +412,8 @@ read_one_packet (struct read_iter *iter)
 {
     unsigned char *ctl_buf;
     struct packets_in *packs_in;
-#if __linux__
-    uint32_t n_dropped;
-#endif
-#ifndef WIN32
-    ssize_t nread;
-#else
     DWORD nread;
     int socket_ret;
-#endif
     struct sockaddr_storage *local_addr;
     struct service_port *sport;
 
@@ -482,32 +427,11 @@ read_one_packet (struct read_iter *iter)
         return ROP_NOROOM;
     }
 
-#ifndef WIN32
-    packs_in->vecs[iter->ri_idx].iov_base = packs_in->packet_data + iter->ri_off;
-    packs_in->vecs[iter->ri_idx].iov_len  = MAX_PACKET_SZ;
-#else
     packs_in->vecs[iter->ri_idx].buf = (char*)packs_in->packet_data + iter->ri_off;
     packs_in->vecs[iter->ri_idx].len = MAX_PACKET_SZ;
-#endif
 
     ctl_buf = packs_in->ctlmsg_data + iter->ri_idx * CTL_SZ;
 
-#ifndef WIN32
-    struct msghdr msg = {
-        .msg_name       = &packs_in->peer_addresses[iter->ri_idx],
-        .msg_namelen    = sizeof(packs_in->peer_addresses[iter->ri_idx]),
-        .msg_iov        = &packs_in->vecs[iter->ri_idx],
-        .msg_iovlen     = 1,
-        .msg_control    = ctl_buf,
-        .msg_controllen = CTL_SZ,
-    };
-    nread = recvmsg(sport->fd, &msg, 0);
-    if (-1 == nread) {
-        if (!(EAGAIN == errno || EWOULDBLOCK == errno))
-            LSQ_ERROR("recvmsg: %s", strerror(errno));
-        return ROP_ERROR;
-    }
-#else
     WSAMSG msg = {
         .name       = (LPSOCKADDR)&packs_in->peer_addresses[iter->ri_idx],
         .namelen    = sizeof(packs_in->peer_addresses[iter->ri_idx]),
@@ -521,34 +445,12 @@ read_one_packet (struct read_iter *iter)
             LSQ_ERROR("recvmsg: %d", WSAGetLastError());
 	return ROP_ERROR;
     }
-#endif
 
     local_addr = &packs_in->local_addresses[iter->ri_idx];
     memcpy(local_addr, &sport->sas, sizeof(*local_addr));
-#if __linux__
-    n_dropped = 0;
-#endif
-    proc_ancillary(&msg, local_addr
-#if __linux__
-        , &n_dropped
-#endif
-    );
-#if __linux__
-    if (sport->drop_init)
-    {
-        if (sport->n_dropped < n_dropped)
-            LSQ_INFO("dropped %u packets", n_dropped - sport->n_dropped);
-    }
-    else
-        sport->drop_init = 1;
-    sport->n_dropped = n_dropped;
-#endif
+    proc_ancillary(&msg, local_addr);
 
-#ifndef WIN32
-    packs_in->vecs[iter->ri_idx].iov_len = nread;
-#else
     packs_in->vecs[iter->ri_idx].len = nread;
-#endif
     iter->ri_off += nread;
     iter->ri_idx += 1;
 
@@ -556,11 +458,18 @@ read_one_packet (struct read_iter *iter)
 }
 
 
+#endif
 static void
 read_handler (evutil_socket_t fd, short flags, void *ctx)
 {
     struct service_port *sport = ctx;
     lsquic_engine_t *const engine = sport->engine;
+#ifndef WIN32
+    (void) lsquic_udp_io_read(sport->sp_io, engine);
+
+    if (!prog_is_stopped())
+        prog_process_conns(sport->sp_prog);
+#else
     struct packets_in *packs_in = sport->packs_in;
     struct read_iter iter;
     unsigned n, n_batches;
@@ -581,18 +490,18 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
         n_batches += iter.ri_idx > 0;
 
         for (n = 0; n < iter.ri_idx; ++n)
-            if (0 != lsquic_engine_packet_in(engine,
-#ifndef WIN32
-                        packs_in->vecs[n].iov_base,
-                        packs_in->vecs[n].iov_len,
-#else
-                        (const unsigned char *) packs_in->vecs[n].buf,
-                        packs_in->vecs[n].len,
-#endif
-                        (struct sockaddr *) &packs_in->local_addresses[n],
-                        (struct sockaddr *) &packs_in->peer_addresses[n],
-                        sport))
-                break;
+        {
+            packs_in->specs[n].buf  = (const unsigned char *) packs_in->vecs[n].buf;
+            packs_in->specs[n].sz   = packs_in->vecs[n].len;
+            packs_in->specs[n].local_sa
+                            = (struct sockaddr *) &packs_in->local_addresses[n];
+            packs_in->specs[n].peer_sa
+                            = (struct sockaddr *) &packs_in->peer_addresses[n];
+            packs_in->specs[n].peer_ctx = sport;
+            packs_in->specs[n].segsz    = 0;
+            packs_in->specs[n].received = NULL;
+        }
+        (void) lsquic_engine_packets_in(engine, packs_in->specs, iter.ri_idx);
     }
     while (ROP_NOROOM == rop);
 
@@ -603,6 +512,7 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
         prog_process_conns(sport->sp_prog);
 
     LSQ_DEBUG("read %u packet%.*s in %u batch%s", n, n != 1, "s", n_batches, n_batches != 1 ? "es" : "");
+#endif
 }
 
 
@@ -757,8 +667,13 @@ sport_init_client (struct service_port *sport, struct lsquic_engine *engine,
         return -1;
     }
 
+#ifndef WIN32
+    sport->sp_io = lsquic_udp_io_new(sockfd, 0, sport);
+    if (!sport->sp_io)
+#else
     sport->packs_in = allocate_packets_in(sockfd);
     if (!sport->packs_in)
+#endif
     {
         saved_errno = errno;
         CLOSE_SOCKET(sockfd);
@@ -781,57 +696,30 @@ sport_init_client (struct service_port *sport, struct lsquic_engine *engine,
 }
 
 
+#ifdef WIN32
 static void
-setup_control_msg (
-#ifndef WIN32
-                   struct msghdr
-#else
-                   WSAMSG
-#endif
-                                 *msg, const struct lsquic_out_spec *spec,
+setup_control_msg (WSAMSG *msg, const struct lsquic_out_spec *spec,
                                             unsigned char *buf, size_t bufsz)
 {
     struct cmsghdr *cmsg;
     struct sockaddr_in *local_sa;
     struct sockaddr_in6 *local_sa6;
-#if __linux__ || __APPLE__ || WIN32
     struct in_pktinfo info;
-#endif
     struct in6_pktinfo info6;
 
-#ifndef WIN32
-    msg->msg_control    = buf;
-    msg->msg_controllen = bufsz;
-#else
     msg->Control.buf    = (char*)buf;
     msg->Control.len = bufsz;
-#endif
     cmsg = CMSG_FIRSTHDR(msg);
 
     if (AF_INET == spec->dest_sa->sa_family)
     {
         local_sa = (struct sockaddr_in *) spec->local_sa;
-#if __linux__ || __APPLE__
-        memset(&info, 0, sizeof(info));
-        info.ipi_spec_dst = local_sa->sin_addr;
-        cmsg->cmsg_level    = IPPROTO_IP;
-        cmsg->cmsg_type     = IP_PKTINFO;
-        cmsg->cmsg_len      = CMSG_LEN(sizeof(info));
-        memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
-#elif WIN32
         memset(&info, 0, sizeof(info));
         info.ipi_addr = local_sa->sin_addr;
         cmsg->cmsg_level    = IPPROTO_IP;
         cmsg->cmsg_type     = IP_PKTINFO;
         cmsg->cmsg_len      = CMSG_LEN(sizeof(info));
         memcpy(WSA_CMSG_DATA(cmsg), &info, sizeof(info));
-#else
-        cmsg->cmsg_level    = IPPROTO_IP;
-        cmsg->cmsg_type     = IP_SENDSRCADDR;
-        cmsg->cmsg_len      = CMSG_LEN(sizeof(local_sa->sin_addr));
-        memcpy(CMSG_DATA(cmsg), &local_sa->sin_addr,
-                                            sizeof(local_sa->sin_addr));
-#endif
     }
     else
     {
@@ -841,18 +729,10 @@ setup_control_msg (
         cmsg->cmsg_level    = IPPROTO_IPV6;
         cmsg->cmsg_type     = IPV6_PKTINFO;
         cmsg->cmsg_len      = CMSG_LEN(sizeof(info6));
-#ifndef WIN32
-        memcpy(CMSG_DATA(cmsg), &info6, sizeof(info6));
-#else
         memcpy(WSA_CMSG_DATA(cmsg), &info6, sizeof(info6));
-#endif
     }
 
-#ifndef WIN32
-    msg->msg_controllen = cmsg->cmsg_len;
-#else
     msg->Control.len = cmsg->cmsg_len;
-#endif
 }
 
 
@@ -862,64 +742,23 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
     const struct service_port *sport;
     unsigned n;
     int s = 0;
-#ifndef WIN32
-    struct msghdr msg;
-#else
     DWORD bytes;
     WSAMSG msg;
-#endif
     union {
         /* cmsg(3) recommends union for proper alignment */
-#if __linux__ || WIN32
-#	define SIZE1 sizeof(struct in_pktinfo)
-#else
-#	define SIZE1 sizeof(struct in_addr)
-#endif
         unsigned char buf[
-            CMSG_SPACE(MAX(SIZE1, sizeof(struct in6_pktinfo)))];
+            CMSG_SPACE(MAX(sizeof(struct in_pktinfo),
+                                            sizeof(struct in6_pktinfo)))];
         struct cmsghdr cmsg;
     } ancil;
-#ifndef WIN32
-    struct iovec iov;
-#else
     WSABUF iov;
-#endif
 
     if (0 == count)
         return 0;
 
-#if LSQUIC_RANDOM_SEND_FAILURE
-    {
-        const char *freq_str = getenv("LSQUIC_RANDOM_SEND_FAILURE");
-        int freq;
-        if (freq_str)
-            freq = atoi(freq_str);
-        else
-            freq = 10;
-        if (rand() % freq == 0)
-        {
-            assert(count > 0);
-            sport = specs[0].peer_ctx;
-            LSQ_NOTICE("sending \"randomly\" fails");
-            goto random_send_failure;
-        }
-    }
-#endif
-
     for (n = 0; n < count; ++n)
     {
         sport = specs[n].peer_ctx;
-#ifndef WIN32
-        iov.iov_base = (void *) specs[n].buf;
-        iov.iov_len = specs[n].sz;
-        msg.msg_name       = (void *) specs[n].dest_sa;
-        msg.msg_namelen    = (AF_INET == specs[n].dest_sa->sa_family ?
-                                            sizeof(struct sockaddr_in) :
-                                            sizeof(struct sockaddr_in6)),
-        msg.msg_iov        = &iov;
-        msg.msg_iovlen     = 1;
-        msg.msg_flags      = 0;
-#else
         iov.buf = (void *) specs[n].buf;
         iov.len = specs[n].sz;
         msg.name           = (void *) specs[n].dest_sa;
@@ -929,31 +768,17 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
         msg.lpBuffers      = &iov;
         msg.dwBufferCount  = 1;
         msg.dwFlags        = 0;
-#endif
         if (sport->sp_flags & SPORT_SERVER)
             setup_control_msg(&msg, &specs[n], ancil.buf, sizeof(ancil.buf));
         else
         {
-#ifndef WIN32
-            msg.msg_control = NULL;
-            msg.msg_controllen = 0;
-#else
             msg.Control.buf = NULL;
             msg.Control.len = 0;
-#endif
         }
-#ifndef WIN32
-        s = sendmsg(sport->fd, &msg, 0);
-#else
         s = pfnWSASendMsg(sport->fd, &msg, 0, &bytes, NULL, NULL);
-#endif
         if (s < 0)
         {
-#ifndef WIN32
-            LSQ_INFO("sendto failed: %s", strerror(errno));
-#else
             LSQ_INFO("sendto failed: %s", WSAGetLastError());
-#endif
             break;
         }
     }
@@ -962,9 +787,6 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
         return n;
     else if (s < 0)
     {
-#if LSQUIC_RANDOM_SEND_FAILURE
-  random_send_failure:
-#endif
         prog_sport_cant_send(sport->sp_prog, sport->fd);
         return -1;
     }
@@ -973,11 +795,70 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 }
 
 
+#else
+/* Send packets using the socket's UDP I/O object.  Consecutive specs that
+ * go out of the same socket are passed to lsquic_udp_io_send() together.
+ */
+static int
+send_packets_udp_io (const struct lsquic_out_spec *specs, unsigned count)
+{
+    struct service_port *sport;
+    unsigned n_sent, n;
+    int s;
+
+    if (0 == count)
+        return 0;
+
+#if LSQUIC_RANDOM_SEND_FAILURE
+    {
+        const char *freq_str = getenv("LSQUIC_RANDOM_SEND_FAILURE");
+        int freq;
+        if (freq_str)
+            freq = atoi(freq_str);
+        else
+            freq = 10;
+        if (rand() % freq == 0)
+        {
+            sport = specs[0].peer_ctx;
+            LSQ_NOTICE("sending \"randomly\" fails");
+            prog_sport_cant_send(sport->sp_prog, sport->fd);
+            return -1;
+        }
+    }
+#endif
+
+    n_sent = 0;
+    do
+    {
+        sport = specs[n_sent].peer_ctx;
+        for (n = n_sent + 1; n < count && specs[n].peer_ctx == sport; ++n)
+            ;
+        s = lsquic_udp_io_send(sport->sp_io, specs + n_sent, n - n_sent);
+        if (s > 0)
+            n_sent += (unsigned) s;
+    }
+    while (n_sent == n && n_sent < count);
+
+    if (n_sent > 0)
+        return n_sent;
+    else
+    {
+        prog_sport_cant_send(sport->sp_prog, sport->fd);
+        return -1;
+    }
+}
+
+
+#endif
 int
 sport_packets_out (void *ctx, const struct lsquic_out_spec *specs,
                    unsigned count)
 {
+#ifndef WIN32
+        return send_packets_udp_io(specs, count);
+#else
         return send_packets_one_by_one(specs, count);
+#endif
 }
 
 
@@ -1079,6 +960,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_pace_packets = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "max_gso_segs", 12))
+        {
+            settings->es_max_gso_segs = atoi(val);
+            return 0;
+        }
         break;
     case 13:
         if (0 == strncmp(name, "support_tcid0", 13))
@@ -16,6 +16,7 @@ struct lsquic_out_spec;
 struct event_base;
 struct event;
 struct packets_in;
+struct lsquic_udp_io;
 struct lsquic_conn;
 struct prog;
 struct reader_ctx;
@@ -38,8 +39,6 @@ struct service_port {
     SOCKET                        fd;
 #endif
 #if __linux__
-    uint32_t                   n_dropped;
-    int                        drop_init;
     char                       if_name[IFNAMSIZ];
 #endif
     struct event              *ev;
@@ -47,7 +46,11 @@ struct service_port {
     void                      *conn_ctx;
     char                       host[80];
     struct sockaddr_storage    sas;
+#ifndef WIN32
+    struct lsquic_udp_io      *sp_io;
+#else
     struct packets_in         *packs_in;
+#endif
     enum sport_flags           sp_flags;
     int                        sp_sndbuf;   /* If SPORT_SET_SNDBUF is set */
     int                        sp_rcvbuf;   /* If SPORT_SET_RCVBUF is set */
@@ -1,6 +1,8 @@
 /* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
 
 #include "lsquic.h"
 #include "lsquic_types.h"
@@ -9,6 +11,10 @@
 #include "lsquic_conn.h"
 
 
+/* Queue under test: binary heap or timing wheel */
+static struct attq * (*create_attq) (void);
+
+
 static char curiosity[] =
     "Dogs say cats love too much, are irresponsible,"
     "are changeable, marry too many wives,"
@@ -75,7 +81,7 @@ test_attq_ordering (enum sort_action sa)
         break;
     }
 
-    q = attq_create();
+    q = create_attq();
 
     conns = calloc(sizeof(curiosity), sizeof(conns[0]));
     for (i = 0; i < sizeof(curiosity); ++i)
@@ -134,7 +140,7 @@ test_attq_removal_1 (void)
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = attq_create();
+    q = create_attq();
     conns = calloc(6, sizeof(conns[0]));
 
     attq_add(q, &conns[0], 1);
@@ -158,7 +164,7 @@ test_attq_removal_2 (void)
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = attq_create();
+    q = create_attq();
     conns = calloc(9, sizeof(conns[0]));
 
     attq_add(q, &conns[0], 1);
@@ -185,7 +191,7 @@ test_attq_removal_3 (void)
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = attq_create();
+    q = create_attq();
     conns = calloc(9, sizeof(conns[0]));
 
     attq_add(q, &conns[0], 1);
@@ -205,8 +211,212 @@ test_attq_removal_3 (void)
 }
 
 
-int
-main (void)
+/* Move connections around at realistic times and compare results with
+ * what they should be.
+ */
+static void
+test_attq_schedule (void)
+{
+    struct attq *q;
+    struct lsquic_conn *conns, *conn;
+    lsquic_time_t *times, now, cutoff, min;
+    const lsquic_time_t *t;
+    unsigned i, n, round, count;
+    const unsigned n_conns = 300;
+    int s;
+
+    q = create_attq();
+    conns = calloc(n_conns, sizeof(conns[0]));
+    times = calloc(n_conns, sizeof(times[0]));
+    srand(1);
+
+    now = 1000000000000ULL;
+    for (i = 0; i < n_conns; ++i)
+    {
+        switch (i % 4)
+        {
+        case 0:     /* Next tick */
+            times[i] = now + rand() % 1000;
+            break;
+        case 1:     /* Retransmission timer */
+            times[i] = now + rand() % 500000;
+            break;
+        case 2:     /* Idle timer */
+            times[i] = now + 30000000ULL + rand() % 1000000;
+            break;
+        default:    /* Farther than the wheel can see */
+            times[i] = now + 36000000000ULL + (lsquic_time_t) rand() * 1000;
+            break;
+        }
+        s = attq_add(q, &conns[i], times[i]);
+        assert(s == 0);
+    }
+
+    for (round = 0; round < 2000; ++round)
+    {
+        /* Timers are rearmed */
+        for (n = 0; n < 10; ++n)
+        {
+            i = rand() % n_conns;
+            if (!conns[i].cn_attq_elem)
+                continue;
+            times[i] = now + rand() % (1 + (rand() % 2 ? 2000 : 2000000));
+            attq_reschedule(q, &conns[i], times[i]);
+        }
+
+        min = ~0ULL;
+        for (i = 0; i < n_conns; ++i)
+            if (conns[i].cn_attq_elem && times[i] < min)
+                min = times[i];
+        t = attq_next_time(q);
+        assert(t);
+        assert(*t == min);
+
+        cutoff = now + rand() % 5000000;
+        count = 0;
+        for (i = 0; i < n_conns; ++i)
+            count += conns[i].cn_attq_elem && times[i] < cutoff;
+        /* The heap only counts the top levels that are all before cutoff */
+        if (create_attq == attq_create_wheel)
+            assert(count == attq_count_before(q, cutoff));
+        else
+            assert(count >= attq_count_before(q, cutoff));
+
+        now += rand() % 20000;
+        while ((conn = attq_pop(q, now)))
+        {
+            i = conn - conns;
+            assert(times[i] < now);
+            assert(!conn->cn_attq_elem);
+        }
+        for (i = 0; i < n_conns; ++i)
+            if (conns[i].cn_attq_elem)
+                assert(times[i] >= now);
+            else
+            {
+                /* Ticked connection schedules next tick */
+                times[i] = now + rand() % 100000;
+                s = attq_add(q, &conns[i], times[i]);
+                assert(s == 0);
+            }
+    }
+
+    /* Jump far ahead: everything is due */
+    now += 100000000000ULL;
+    for (n = 0; attq_pop(q, now); ++n)
+        ;
+    assert(n == n_conns);
+    assert(!attq_next_time(q));
+
+    free(times);
+    free(conns);
+    attq_destroy(q);
+}
+
+
+/* A connection on a higher level must be cascaded even if the first
+ * non-empty slot on a lower level comes after the cascade point.
+ */
+static void
+test_attq_cascade (void)
+{
+    struct attq *q;
+    struct lsquic_conn conns[3], *conn;
+    const lsquic_time_t *t;
+    unsigned count;
+
+    q = create_attq();
+    memset(conns, 0, sizeof(conns));
+
+    attq_add(q, &conns[0], 100 << 10);
+    attq_add(q, &conns[1], 4200 << 10);
+    attq_add(q, &conns[2], 4160 << 10);
+
+    conn = attq_pop(q, 101 << 10);
+    assert(conn == &conns[0]);
+    assert(!attq_pop(q, 101 << 10));
+
+    t = attq_next_time(q);
+    assert(t && *t == 4160 << 10);
+    count = attq_count_before(q, 4300 << 10);
+    if (create_attq == attq_create_wheel)
+        assert(2 == count);
+    else
+        assert(2 >= count);
+
+    count = 0;
+    while ((conn = attq_pop(q, 4300 << 10)))
+    {
+        assert(conn == &conns[1] || conn == &conns[2]);
+        ++count;
+    }
+    assert(2 == count);
+    assert(!attq_next_time(q));
+
+    attq_destroy(q);
+}
+
+
+/* Connections farther in the future than the wheel can see are added at
+ * different times.  The earliest of them must still be found.
+ */
+static void
+test_attq_far (void)
+{
+    struct attq *q;
+    struct lsquic_conn *conns, *conn;
+    lsquic_time_t *times, now, min;
+    const lsquic_time_t *t;
+    unsigned i, n;
+    const unsigned n_conns = 1000;
+
+    q = create_attq();
+    conns = calloc(n_conns, sizeof(conns[0]));
+    times = calloc(n_conns, sizeof(times[0]));
+
+    attq_add(q, &conns[0], 7099439043ULL);
+    attq_add(q, &conns[1], 85838893949ULL);
+    conn = attq_pop(q, 7489765073ULL);
+    assert(conn == &conns[0]);
+    attq_add(q, &conns[2], 58262727733ULL);
+    attq_add(q, &conns[3], 9007998046ULL);
+    conn = attq_pop(q, 9008004355ULL);
+    assert(conn == &conns[3]);
+    t = attq_next_time(q);
+    assert(t && *t == 58262727733ULL);
+    while (attq_pop(q, ~0ULL))
+        ;
+
+    srand(2);
+    now = 1000000000000ULL;
+    for (i = 0; i < n_conns; ++i)
+    {
+        now += (lsquic_time_t) (rand() % 1000) * 1000000;
+        times[i] = now + 20000000000ULL
+                                + (lsquic_time_t) (rand() % 100000) * 1000000;
+        attq_add(q, &conns[i], times[i]);
+        min = ~0ULL;
+        for (n = 0; n <= i; ++n)
+            if (conns[n].cn_attq_elem && times[n] < min)
+                min = times[n];
+        t = attq_next_time(q);
+        assert(t && *t == min);
+        while ((conn = attq_pop(q, now)))
+            assert(times[conn - conns] < now);
+    }
+
+    while ((conn = attq_pop(q, ~0ULL)))
+        assert(!conn->cn_attq_elem);
+    assert(!attq_next_time(q));
+
+    free(times);
+    free(conns);
+    attq_destroy(q);
+}
+
+
+static void
+run_tests (void)
 {
     test_attq_ordering(SORT_NONE);
     test_attq_ordering(SORT_ASC);
@@ -214,5 +424,18 @@ main (void)
     test_attq_removal_1();
     test_attq_removal_2();
     test_attq_removal_3();
+    test_attq_schedule();
+    test_attq_cascade();
+    test_attq_far();
+}
+
+
+int
+main (void)
+{
+    create_attq = attq_create;
+    run_tests();
+    create_attq = attq_create_wheel;
+    run_tests();
     return 0;
 }
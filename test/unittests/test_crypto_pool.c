@@ -0,0 +1,88 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic_crypto_pool.h"
+
+
+#define N_JOBS 1000
+
+struct job_ctx
+{
+    unsigned    n_jobs;
+    unsigned    counts[N_JOBS];
+};
+
+
+static void
+count_job (void *ctx, unsigned job_idx)
+{
+    struct job_ctx *const job_ctx = ctx;
+
+    assert(job_idx < job_ctx->n_jobs);
+    __sync_fetch_and_add(&job_ctx->counts[job_idx], 1);
+}
+
+
+/* Each job is performed exactly once, however many times the pool is run */
+static void
+test_run (unsigned n_threads)
+{
+    struct crypto_pool *pool;
+    struct job_ctx job_ctx;
+    unsigned n_jobs, i;
+
+    pool = lsquic_crypto_pool_new(n_threads);
+    assert(pool);
+
+    for (n_jobs = 0; n_jobs <= N_JOBS; n_jobs += 1 + n_jobs / 3)
+    {
+        memset(&job_ctx, 0, sizeof(job_ctx));
+        job_ctx.n_jobs = n_jobs;
+        lsquic_crypto_pool_run(pool, count_job, &job_ctx, n_jobs);
+        for (i = 0; i < N_JOBS; ++i)
+            assert(job_ctx.counts[i] == (i < n_jobs));
+    }
+
+    lsquic_crypto_pool_destroy(pool);
+}
+
+
+/* Workers that wake up late must not use job description of the previous
+ * run when the number of jobs shrinks.
+ */
+static void
+test_shrink (unsigned n_threads)
+{
+    struct crypto_pool *pool;
+    struct job_ctx job_ctx;
+    unsigned round, n_jobs, i;
+
+    pool = lsquic_crypto_pool_new(n_threads);
+    assert(pool);
+
+    for (round = 0; round < 20000; ++round)
+    {
+        n_jobs = round & 1 ? 2 : 64;
+        memset(&job_ctx, 0, sizeof(job_ctx));
+        job_ctx.n_jobs = n_jobs;
+        lsquic_crypto_pool_run(pool, count_job, &job_ctx, n_jobs);
+        for (i = 0; i < 64; ++i)
+            assert(job_ctx.counts[i] == (i < n_jobs));
+    }
+
+    lsquic_crypto_pool_destroy(pool);
+}
+
+
+int
+main (void)
+{
+    assert(NULL == lsquic_crypto_pool_new(0));
+    test_run(1);
+    test_run(3);
+    test_run(16);
+    test_shrink(8);
+    return 0;
+}
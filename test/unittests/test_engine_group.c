@@ -0,0 +1,120 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "lsquic.h"
+
+
+static unsigned n_closed;
+
+
+static lsquic_conn_ctx_t *
+on_new_conn (void *stream_if_ctx, lsquic_conn_t *conn)
+{
+    return NULL;
+}
+
+
+static void
+on_conn_closed (lsquic_conn_t *conn)
+{
+    __sync_fetch_and_add(&n_closed, 1);
+}
+
+
+static lsquic_stream_ctx_t *
+on_new_stream (void *stream_if_ctx, lsquic_stream_t *stream)
+{
+    return NULL;
+}
+
+
+static void
+on_stream_event (lsquic_stream_t *stream, lsquic_stream_ctx_t *h)
+{
+}
+
+
+static const struct lsquic_stream_if stream_if = {
+    .on_new_conn    = on_new_conn,
+    .on_conn_closed = on_conn_closed,
+    .on_new_stream  = on_new_stream,
+    .on_read        = on_stream_event,
+    .on_write       = on_stream_event,
+    .on_close       = on_stream_event,
+};
+
+
+/* Connections are made to a socket that never replies.  We check that they
+ * are spread across the engines, that they get created, and that they are
+ * closed when the group is destroyed.
+ */
+int
+main (void)
+{
+    struct lsquic_engine_api api;
+    struct lsquic_engine_group *group;
+    struct lsquic_engine_group_stats stats;
+    struct sockaddr_in sin;
+    socklen_t socklen;
+    unsigned n, n_waits;
+    int fd, s;
+
+    lsquic_global_init(LSQUIC_GLOBAL_CLIENT);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s = bind(fd, (struct sockaddr *) &sin, sizeof(sin));
+    assert(0 == s);
+    socklen = sizeof(sin);
+    s = getsockname(fd, (struct sockaddr *) &sin, &socklen);
+    assert(0 == s);
+
+    memset(&api, 0, sizeof(api));
+    api.ea_stream_if = &stream_if;
+
+    group = lsquic_engine_group_new(LSENG_SERVER, &api, AF_INET, 3, 0);
+    assert(!group);     /* Client mode only */
+    group = lsquic_engine_group_new(0, &api, AF_INET, 0, 0);
+    assert(!group);     /* Need at least one engine */
+
+    group = lsquic_engine_group_new(0, &api, AF_INET, 3, LSQUIC_EGF_PIN_CPUS);
+    assert(group);
+
+    for (n = 0; n < 6; ++n)
+    {
+        s = lsquic_engine_group_connect(group, (struct sockaddr *) &sin,
+                                                    NULL, "localhost", 0);
+        assert(s == (int) (n % 3));
+    }
+
+    for (n_waits = 0; n_waits < 500; ++n_waits)
+    {
+        lsquic_engine_group_get_stats(group, &stats);
+        if (6 == stats.n_conns_created && stats.n_packets_out >= 6)
+            break;
+        usleep(10000);
+    }
+
+    assert(3 == stats.n_engines);
+    assert(6 == stats.n_conns_created);
+    assert(6 == stats.n_conns);
+    assert(0 == stats.n_pending);
+    assert(stats.n_packets_out >= 6);
+
+    lsquic_engine_group_destroy(group);
+    assert(6 == n_closed);
+
+    close(fd);
+    lsquic_global_cleanup();
+    return 0;
+}
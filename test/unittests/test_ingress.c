@@ -0,0 +1,196 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <time.h>
+
+#include "lsquic.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_ingress.h"
+
+
+#define N_PRODUCERS 4
+#define N_PACKETS   20000
+
+
+struct producer
+{
+    struct ingress     *ingress;
+    struct sockaddr_in  peer_sa;
+    unsigned            idx;
+};
+
+
+struct consumer
+{
+    unsigned            next[N_PRODUCERS];  /* Next expected packet */
+    unsigned            n_packets;
+};
+
+
+/* Packet is producer index followed by packet number */
+static void *
+producer_thread (void *arg)
+{
+    struct producer *const prod = arg;
+    unsigned char buf[8];
+    unsigned n;
+
+    memcpy(buf, &prod->idx, 4);
+    for (n = 0; n < N_PACKETS; ++n)
+    {
+        memcpy(buf + 4, &n, 4);
+        while (0 != lsquic_ingress_put(prod->ingress, buf, sizeof(buf), NULL,
+                        (struct sockaddr *) &prod->peer_sa, prod, NULL))
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+
+static void
+packets_in (void *ctx, const struct lsquic_in_spec *specs, unsigned n_specs)
+{
+    struct consumer *const cons = ctx;
+    const struct producer *prod;
+    unsigned i, idx, n;
+
+    for (i = 0; i < n_specs; ++i)
+    {
+        assert(8 == specs[i].sz);
+        assert(!specs[i].local_sa);
+        assert(specs[i].received);
+        memcpy(&idx, specs[i].buf, 4);
+        memcpy(&n, specs[i].buf + 4, 4);
+        assert(idx < N_PRODUCERS);
+        prod = specs[i].peer_ctx;
+        assert(prod->idx == idx);
+        assert(0 == memcmp(specs[i].peer_sa, &prod->peer_sa,
+                                                    sizeof(prod->peer_sa)));
+        /* Packets from the same thread arrive in order */
+        assert(n == cons->next[idx]);
+        ++cons->next[idx];
+        ++cons->n_packets;
+    }
+}
+
+
+static void
+test_threads (unsigned n_slots)
+{
+    struct ingress *ingress;
+    struct producer prods[N_PRODUCERS];
+    pthread_t threads[N_PRODUCERS];
+    struct consumer cons;
+    struct pollfd pfd;
+    unsigned i;
+    int s;
+
+    ingress = lsquic_ingress_new(n_slots);
+    assert(ingress);
+    memset(&cons, 0, sizeof(cons));
+
+    for (i = 0; i < N_PRODUCERS; ++i)
+    {
+        memset(&prods[i], 0, sizeof(prods[i]));
+        prods[i].ingress = ingress;
+        prods[i].idx = i;
+        prods[i].peer_sa.sin_family = AF_INET;
+        prods[i].peer_sa.sin_port = htons(1000 + i);
+        s = pthread_create(&threads[i], NULL, producer_thread, &prods[i]);
+        assert(0 == s);
+    }
+
+    while (cons.n_packets < N_PRODUCERS * N_PACKETS)
+    {
+        pfd.fd = lsquic_ingress_fd(ingress);
+        pfd.events = POLLIN;
+        (void) poll(&pfd, 1, 10);
+        (void) lsquic_ingress_drain(ingress, packets_in, &cons);
+    }
+
+    for (i = 0; i < N_PRODUCERS; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        assert(N_PACKETS == cons.next[i]);
+    }
+    assert(0 == lsquic_ingress_drain(ingress, packets_in, &cons));
+
+    lsquic_ingress_destroy(ingress);
+}
+
+
+/* Queue rejects packets when it is full and accepts them again after it
+ * is drained; the descriptor signals new packets.
+ */
+static void
+test_full (void)
+{
+    struct ingress *ingress;
+    struct producer prod;
+    struct consumer cons;
+    struct pollfd pfd;
+    unsigned char buf[8], big[QUIC_MAX_PACKET_SZ + 1];
+    unsigned n;
+    int s;
+
+    ingress = lsquic_ingress_new(3);    /* Rounded up to 4 */
+    assert(ingress);
+    memset(&cons, 0, sizeof(cons));
+    memset(&prod, 0, sizeof(prod));
+    prod.peer_sa.sin_family = AF_INET;
+    pfd.fd = lsquic_ingress_fd(ingress);
+    pfd.events = POLLIN;
+
+    assert(0 == poll(&pfd, 1, 0));
+
+    memset(big, 0, sizeof(big));
+    s = lsquic_ingress_put(ingress, big, sizeof(big), NULL,
+                            (struct sockaddr *) &prod.peer_sa, &prod, NULL);
+    assert(-1 == s);
+
+    memset(buf, 0, 4);
+    for (n = 0; n < 4; ++n)
+    {
+        memcpy(buf + 4, &n, 4);
+        s = lsquic_ingress_put(ingress, buf, sizeof(buf), NULL,
+                            (struct sockaddr *) &prod.peer_sa, &prod, NULL);
+        assert(0 == s);
+    }
+    s = lsquic_ingress_put(ingress, buf, sizeof(buf), NULL,
+                            (struct sockaddr *) &prod.peer_sa, &prod, NULL);
+    assert(-1 == s);
+
+    assert(1 == poll(&pfd, 1, 0));
+    assert(4 == lsquic_ingress_drain(ingress, packets_in, &cons));
+    assert(0 == poll(&pfd, 1, 0));
+
+    n = 4;
+    memcpy(buf + 4, &n, 4);
+    s = lsquic_ingress_put(ingress, buf, sizeof(buf), NULL,
+                            (struct sockaddr *) &prod.peer_sa, &prod, NULL);
+    assert(0 == s);
+    assert(1 == poll(&pfd, 1, 0));
+    assert(1 == lsquic_ingress_drain(ingress, packets_in, &cons));
+    assert(5 == cons.n_packets);
+
+    lsquic_ingress_destroy(ingress);
+}
+
+
+int
+main (void)
+{
+    test_full();
+    test_threads(8);
+    test_threads(1024);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/curve25519.h>
+
+#include "lsquic_kxs_pool.h"
+
+
+#define N_SHARES 100
+
+
+/* Key shares are valid and each one is handed out once */
+static void
+test_get (unsigned pool_size)
+{
+    struct kxs_pool *pool;
+    unsigned char priv_keys[N_SHARES][32], pub_key[32], expected[32];
+    unsigned n, i;
+
+    pool = lsquic_kxs_pool_new(pool_size);
+    assert(pool);
+
+    for (n = 0; n < N_SHARES; ++n)
+    {
+        while (0 != lsquic_kxs_pool_get(pool, priv_keys[n], pub_key))
+            usleep(1000);
+        X25519_public_from_private(expected, priv_keys[n]);
+        assert(0 == memcmp(expected, pub_key, sizeof(pub_key)));
+        for (i = 0; i < n; ++i)
+            assert(0 != memcmp(priv_keys[i], priv_keys[n], 32));
+    }
+
+    lsquic_kxs_pool_destroy(pool);
+}
+
+
+int
+main (void)
+{
+    assert(NULL == lsquic_kxs_pool_new(0));
+    test_get(1);
+    test_get(7);
+    test_get(N_SHARES * 2);
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic_min_heap.h"
+
+
+#define MAX_ELEMS 1000
+
+/* Heap elements point to these; only their addresses are used */
+static char conns[MAX_ELEMS];
+
+
+static void
+verify_pop_order (struct min_heap *heap, const uint64_t *vals, unsigned n)
+{
+    struct lsquic_conn *conn;
+    uint64_t prev, val;
+    unsigned i, idx;
+
+    prev = 0;
+    for (i = 0; i < n; ++i)
+    {
+        conn = lsquic_mh_pop(heap);
+        assert(conn);
+        idx = (char *) conn - conns;
+        assert(idx < n);
+        val = vals[idx];
+        assert(val >= prev);
+        prev = val;
+    }
+    assert(!lsquic_mh_pop(heap));
+    assert(0 == lsquic_mh_count(heap));
+}
+
+
+static void
+test_insert (unsigned n)
+{
+    struct min_heap heap;
+    uint64_t vals[MAX_ELEMS];
+    unsigned i;
+
+    heap.mh_elems = malloc(sizeof(heap.mh_elems[0]) * MAX_ELEMS);
+    heap.mh_nalloc = MAX_ELEMS;
+    heap.mh_nelem = 0;
+
+    for (i = 0; i < n; ++i)
+    {
+        vals[i] = rand() % (n / 2 + 1);
+        lsquic_mh_insert(&heap, (struct lsquic_conn *) &conns[i], vals[i]);
+    }
+    assert(n == lsquic_mh_count(&heap));
+    verify_pop_order(&heap, vals, n);
+
+    free(heap.mh_elems);
+}
+
+
+/* Some elements are inserted, some appended; then the heap is rebuilt */
+static void
+test_heapify (unsigned n)
+{
+    struct min_heap heap;
+    uint64_t vals[MAX_ELEMS];
+    unsigned i;
+
+    heap.mh_elems = malloc(sizeof(heap.mh_elems[0]) * MAX_ELEMS);
+    heap.mh_nalloc = MAX_ELEMS;
+    heap.mh_nelem = 0;
+
+    for (i = 0; i < n; ++i)
+    {
+        vals[i] = rand() % (n / 2 + 1);
+        if (i < n / 3)
+            lsquic_mh_insert(&heap, (struct lsquic_conn *) &conns[i], vals[i]);
+        else
+            lsquic_mh_append(&heap, (struct lsquic_conn *) &conns[i], vals[i]);
+    }
+    lsquic_mh_heapify(&heap);
+    assert(n == lsquic_mh_count(&heap));
+    verify_pop_order(&heap, vals, n);
+
+    free(heap.mh_elems);
+}
+
+
+int
+main (void)
+{
+    static const unsigned counts[] = { 0, 1, 2, 4, 5, 6, 17, 100, MAX_ELEMS, };
+    unsigned i;
+
+    srand(1);
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+    {
+        test_insert(counts[i]);
+        test_heapify(counts[i]);
+    }
+
+    return 0;
+}
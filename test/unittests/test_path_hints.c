@@ -0,0 +1,138 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include "vc_compat.h"
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_path_hints.h"
+
+
+static void
+make_sa4 (struct sockaddr_in *sa, const char *addr, unsigned short port)
+{
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    sa->sin_port   = htons(port);
+    inet_pton(AF_INET, addr, &sa->sin_addr);
+}
+
+
+static void
+make_hint (struct path_hint *hint, lsquic_time_t srtt)
+{
+    memset(hint, 0, sizeof(*hint));
+    hint->ph_srtt      = srtt;
+    hint->ph_rttvar    = srtt / 2;
+    hint->ph_cwnd      = 64 * 1460;
+    hint->ph_version   = LSQVER_039;
+    hint->ph_pack_size = 1350;
+}
+
+
+static void
+test_get_put (void)
+{
+    struct path_hints *hints;
+    struct sockaddr_in sa1, sa2, sa3;
+    struct sockaddr_in6 sa6;
+    struct path_hint hint, out;
+
+    hints = lsquic_path_hints_new(10);
+    assert(hints);
+
+    make_sa4(&sa1, "10.0.0.1", 443);
+    make_sa4(&sa2, "10.0.0.1", 8443);   /* Different port */
+    make_sa4(&sa3, "10.0.0.2", 443);
+    memset(&sa6, 0, sizeof(sa6));
+    sa6.sin6_family = AF_INET6;
+    sa6.sin6_port   = htons(443);
+    inet_pton(AF_INET6, "::1", &sa6.sin6_addr);
+
+    assert(-1 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa1, &out));
+
+    make_hint(&hint, 10000);
+    lsquic_path_hints_put(hints, (struct sockaddr *) &sa1, &hint);
+    make_hint(&hint, 20000);
+    lsquic_path_hints_put(hints, (struct sockaddr *) &sa6, &hint);
+    assert(2 == lsquic_path_hints_count(hints));
+
+    assert(0 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa1, &out));
+    assert(10000 == out.ph_srtt);
+    assert(5000 == out.ph_rttvar);
+    assert(64 * 1460 == out.ph_cwnd);
+    assert(LSQVER_039 == out.ph_version);
+    assert(1350 == out.ph_pack_size);
+    assert(0 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa6, &out));
+    assert(20000 == out.ph_srtt);
+    assert(-1 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa2, &out));
+    assert(-1 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa3, &out));
+
+    /* Replace existing hint; large congestion window is capped */
+    make_hint(&hint, 30000);
+    hint.ph_cwnd = PATH_HINT_MAX_CWND * 2;
+    lsquic_path_hints_put(hints, (struct sockaddr *) &sa1, &hint);
+    assert(2 == lsquic_path_hints_count(hints));
+    assert(0 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa1, &out));
+    assert(30000 == out.ph_srtt);
+    assert(PATH_HINT_MAX_CWND == out.ph_cwnd);
+
+    lsquic_path_hints_destroy(hints);
+}
+
+
+/* Least recently used hint is evicted */
+static void
+test_lru (void)
+{
+    struct path_hints *hints;
+    struct sockaddr_in sa[4];
+    struct path_hint hint, out;
+    unsigned i;
+
+    hints = lsquic_path_hints_new(3);
+    assert(hints);
+
+    make_sa4(&sa[0], "10.0.0.1", 443);
+    make_sa4(&sa[1], "10.0.0.2", 443);
+    make_sa4(&sa[2], "10.0.0.3", 443);
+    make_sa4(&sa[3], "10.0.0.4", 443);
+
+    for (i = 0; i < 3; ++i)
+    {
+        make_hint(&hint, 1000 * (i + 1));
+        lsquic_path_hints_put(hints, (struct sockaddr *) &sa[i], &hint);
+    }
+
+    /* Use the oldest hint so that the second one becomes the LRU */
+    assert(0 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa[0], &out));
+
+    make_hint(&hint, 4000);
+    lsquic_path_hints_put(hints, (struct sockaddr *) &sa[3], &hint);
+    assert(3 == lsquic_path_hints_count(hints));
+
+    assert(0 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa[0], &out));
+    assert(1000 == out.ph_srtt);
+    assert(-1 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa[1], &out));
+    assert(0 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa[2], &out));
+    assert(0 == lsquic_path_hints_get(hints, (struct sockaddr *) &sa[3], &out));
+    assert(4000 == out.ph_srtt);
+
+    lsquic_path_hints_destroy(hints);
+}
+
+
+int
+main (void)
+{
+    test_get_put();
+    test_lru();
+    return 0;
+}
@@ -164,6 +164,51 @@ test5 (void)
 }
 
 
+static void
+test_would_accept (void)
+{
+    lsquic_rechist_t rechist;
+    char buf[100];
+
+    lsquic_rechist_init(&rechist, 0);
+
+    assert(lsquic_rechist_would_accept(&rechist, 0));  /* Error, not dup */
+    assert(lsquic_rechist_would_accept(&rechist, 1));
+
+    lsquic_rechist_received(&rechist, 1, 0);
+    lsquic_rechist_received(&rechist, 3, 0);
+    lsquic_rechist_received(&rechist, 4, 0);
+    lsquic_rechist_received(&rechist, 8, 0);
+    rechist2str(&rechist, buf, sizeof(buf));
+    assert(0 == strcmp(buf, "[8-8][4-3][1-1]"));
+
+    assert(!lsquic_rechist_would_accept(&rechist, 1));
+    assert(lsquic_rechist_would_accept(&rechist, 2));
+    assert(!lsquic_rechist_would_accept(&rechist, 3));
+    assert(!lsquic_rechist_would_accept(&rechist, 4));
+    assert(lsquic_rechist_would_accept(&rechist, 5));
+    assert(!lsquic_rechist_would_accept(&rechist, 8));
+    assert(lsquic_rechist_would_accept(&rechist, 9));
+
+    /* Receive history is not modified */
+    rechist2str(&rechist, buf, sizeof(buf));
+    assert(0 == strcmp(buf, "[8-8][4-3][1-1]"));
+
+    lsquic_rechist_stop_wait(&rechist, 6);
+    assert(!lsquic_rechist_would_accept(&rechist, 2));
+    assert(!lsquic_rechist_would_accept(&rechist, 5));
+    assert(lsquic_rechist_would_accept(&rechist, 6));
+    assert(!lsquic_rechist_would_accept(&rechist, 8));
+
+    /* Agrees with lsquic_rechist_received() */
+    assert(REC_ST_DUP == lsquic_rechist_received(&rechist, 5, 0));
+    assert(REC_ST_OK == lsquic_rechist_received(&rechist, 6, 0));
+    assert(!lsquic_rechist_would_accept(&rechist, 6));
+
+    lsquic_rechist_cleanup(&rechist);
+}
+
+
 int
 main (void)
 {
@@ -250,6 +295,7 @@ main (void)
     test4();
 
     test5();
+    test_would_accept();
 
     return 0;
 }
@@ -0,0 +1,176 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lsquic_scache.h"
+
+
+static char s_path[] = "/tmp/lsquic-test-scache-XXXXXX";
+
+
+static void
+put_str (struct scache *cache, const char *key, const char *data,
+                                                            uint64_t expiry)
+{
+    int s;
+
+    s = scache_put(cache, key, strlen(key), data, strlen(data) + 1, expiry);
+    assert(0 == s);
+}
+
+
+static const char *
+get_str (struct scache *cache, const char *key, uint64_t now)
+{
+    static char buf[0x100];
+    int s;
+
+    s = scache_get(cache, key, strlen(key), buf, sizeof(buf), now);
+    if (s < 0)
+        return NULL;
+    assert(s == (int) strlen(buf) + 1);
+    return buf;
+}
+
+
+static void
+test_basic (void)
+{
+    struct scache *cache;
+    const char *val;
+    char big[100];
+    int s;
+
+    cache = scache_open(s_path, 100);
+    assert(cache);
+
+    assert(NULL == get_str(cache, "example.com", 1000));
+    put_str(cache, "example.com", "one", 2000);
+    val = get_str(cache, "example.com", 1000);
+    assert(val && 0 == strcmp(val, "one"));
+
+    /* Replace: */
+    put_str(cache, "example.com", "two", 2000);
+    val = get_str(cache, "example.com", 1000);
+    assert(val && 0 == strcmp(val, "two"));
+
+    /* Buffer too small: */
+    s = scache_get(cache, "example.com", 11, big, 2, 1000);
+    assert(-1 == s);
+
+    /* Entry too large: */
+    s = scache_put(cache, "x", 1, big, SCACHE_MAX_ENTRY_SZ, 2000);
+    assert(-1 == s);
+
+    /* Expiry: */
+    put_str(cache, "expired.com", "old", 1500);
+    put_str(cache, "fresh.com", "new", 3000);
+    s = scache_expire(cache, 1700);
+    assert(1 == s);
+    assert(NULL == get_str(cache, "expired.com", 1000));
+    val = get_str(cache, "fresh.com", 1000);
+    assert(val && 0 == strcmp(val, "new"));
+    assert(NULL == get_str(cache, "example.com", 2001));
+
+    scache_close(cache);
+
+    /* Entries survive reopening: */
+    cache = scache_open(s_path, 100);
+    assert(cache);
+    val = get_str(cache, "fresh.com", 1000);
+    assert(val && 0 == strcmp(val, "new"));
+    scache_close(cache);
+}
+
+
+/* With four entries, there is a single set.  The least recently used entry
+ * is evicted first.
+ */
+static void
+test_lru (void)
+{
+    struct scache *cache;
+    const time_t now = time(NULL);
+    const uint64_t expiry = now + 1000;
+
+    unlink(s_path);
+    cache = scache_open(s_path, 4);
+    assert(cache);
+
+    put_str(cache, "a", "a", expiry);
+    put_str(cache, "b", "b", expiry);
+    put_str(cache, "c", "c", expiry);
+    put_str(cache, "d", "d", expiry);
+    /* Touch all but "b" so that it becomes the least recently used: */
+    assert(get_str(cache, "a", now + 1));
+    assert(get_str(cache, "c", now + 1));
+    assert(get_str(cache, "d", now + 1));
+    put_str(cache, "e", "e", expiry);
+
+    assert(NULL == get_str(cache, "b", now + 2));
+    assert(get_str(cache, "a", now + 2));
+    assert(get_str(cache, "c", now + 2));
+    assert(get_str(cache, "d", now + 2));
+    assert(get_str(cache, "e", now + 2));
+
+    scache_close(cache);
+}
+
+
+/* Entries written by one process are visible to another */
+static void
+test_shared (void)
+{
+    struct scache *cache;
+    const char *val;
+    pid_t pid;
+    int status;
+
+    unlink(s_path);
+    cache = scache_open(s_path, 100);
+    assert(cache);
+
+    pid = fork();
+    assert(pid >= 0);
+    if (0 == pid)
+    {
+        struct scache *child_cache = scache_open(s_path, 100);
+        if (!child_cache)
+            _exit(1);
+        put_str(child_cache, "child.com", "hello", 2000);
+        scache_close(child_cache);
+        _exit(0);
+    }
+
+    assert(pid == waitpid(pid, &status, 0));
+    assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+    val = get_str(cache, "child.com", 1000);
+    assert(val && 0 == strcmp(val, "hello"));
+
+    scache_close(cache);
+}
+
+
+int
+main (void)
+{
+    int fd;
+
+    fd = mkstemp(s_path);
+    assert(fd >= 0);
+    close(fd);
+
+    test_basic();
+    test_lru();
+    test_shared();
+
+    unlink(s_path);
+    return 0;
+}
@@ -14,6 +14,17 @@
 #include "lsquic_stream.h"
 #include "lsquic_conn_public.h"
 #include "lsquic_conn.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+
+
+/* Virtual clock: the test does not depend on how fast it runs */
+static uint64_t
+get_time (void *ctx)
+{
+    uint64_t *now = ctx;
+    return *now += 1000;
+}
 
 
 int
@@ -24,12 +35,18 @@ main (void)
     struct lsquic_sfcw fc;
     struct lsquic_conn lconn;
     struct lsquic_conn_public conn_pub;
-    uint64_t recv_off;
+    struct lsquic_engine_public enpub;
+    uint64_t recv_off, now;
     int s;
 
     memset(&lconn, 0, sizeof(lconn));
+    memset(&enpub, 0, sizeof(enpub));
+    now = 1000000;
+    enpub.enp_get_time = get_time;
+    enpub.enp_get_time_ctx = &now;
     memset(&conn_pub, 0, sizeof(conn_pub));
     conn_pub.lconn = &lconn;
+    conn_pub.enpub = &enpub;
     lsquic_sfcw_init(&fc, INIT_WINDOW_SIZE, NULL, &conn_pub, 123);
 
     recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
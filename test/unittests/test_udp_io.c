@@ -0,0 +1,115 @@
+/* Copyright (c) 2017 - 2018 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "lsquic.h"
+
+
+static int
+make_socket (struct sockaddr_in *sin)
+{
+    socklen_t socklen;
+    int fd, s;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s = bind(fd, (struct sockaddr *) sin, sizeof(*sin));
+    assert(0 == s);
+    socklen = sizeof(*sin);
+    s = getsockname(fd, (struct sockaddr *) sin, &socklen);
+    assert(0 == s);
+    s = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    assert(0 == s);
+    return fd;
+}
+
+
+static int
+packets_out (void *ctx, const struct lsquic_out_spec *specs, unsigned count)
+{
+    return count;
+}
+
+
+/* Send a few packets from one UDP I/O object to another.  The engine does
+ * not know about the connection and just drops the packets, but we can
+ * still check that they all got read.
+ */
+static void
+test_send_and_read (unsigned batch_size)
+{
+    struct lsquic_engine_settings settings;
+    struct lsquic_engine_api api;
+    lsquic_engine_t *engine;
+    struct sockaddr_in sin_a, sin_b;
+    struct lsquic_udp_io *io_a, *io_b;
+    struct lsquic_out_spec specs[10];
+    unsigned char bufs[10][100];
+    unsigned n;
+    int fd_a, fd_b, s;
+
+    lsquic_engine_init_settings(&settings, 0);
+    memset(&api, 0, sizeof(api));
+    api.ea_settings = &settings;
+    api.ea_packets_out = packets_out;
+    engine = lsquic_engine_new(0, &api);
+    assert(engine);
+
+    fd_a = make_socket(&sin_a);
+    fd_b = make_socket(&sin_b);
+    io_a = lsquic_udp_io_new(fd_a, batch_size, NULL);
+    assert(io_a);
+    io_b = lsquic_udp_io_new(fd_b, batch_size, NULL);
+    assert(io_b);
+
+    for (n = 0; n < sizeof(specs) / sizeof(specs[0]); ++n)
+    {
+        memset(bufs[n], n, sizeof(bufs[n]));
+        specs[n].buf      = bufs[n];
+        specs[n].sz       = sizeof(bufs[n]) - n;
+        specs[n].local_sa = (struct sockaddr *) &sin_a;
+        specs[n].dest_sa  = (struct sockaddr *) &sin_b;
+        specs[n].peer_ctx = io_a;
+        specs[n].segsz    = 0;
+    }
+
+    s = lsquic_udp_io_packets_out(NULL, specs, 10);
+    assert(10 == s);
+    assert(!lsquic_udp_io_blocked(io_a));
+
+    s = lsquic_udp_io_read(io_b, engine);
+    assert(10 == s);
+
+    /* Nothing left to read: */
+    s = lsquic_udp_io_read(io_b, engine);
+    assert(0 == s);
+
+    lsquic_udp_io_destroy(io_a);
+    lsquic_udp_io_destroy(io_b);
+    close(fd_a);
+    close(fd_b);
+    lsquic_engine_destroy(engine);
+}
+
+
+int
+main (void)
+{
+    lsquic_global_init(LSQUIC_GLOBAL_CLIENT);
+    test_send_and_read(0);
+    test_send_and_read(3);
+    test_send_and_read(1);
+    lsquic_global_cleanup();
+    return 0;
+}